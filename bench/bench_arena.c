@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <matrix.h>
+#include <arena.h>
+#include <buffer_pool.h>
+#include <optimizer.h>
+#include <multi_layer_net.h>
+#include <simple_convnet.h>
+
+//
+// Time and tensor allocations per training step (gradient + SGD update) of
+// MultiLayerNet and SimpleConvNet on random batches of 100, once with every
+// temporary on the heap and once inside an arena scope as the trainers run
+// it. Heap requests go through the buffer pool; "miss/step" counts the ones
+// it had to pass on to malloc (run with DL_POOL_LIMIT=0 to turn it off).
+//
+
+#define BATCH 100
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Vector* random_labels() {
+    Vector* t = create_vector(BATCH);
+    for (int i = 0; i < BATCH; ++i) {
+        t->elements[i] = rand() % 10;
+    }
+
+    return t;
+}
+
+static void mlnet_step(void* net, void* X, const Vector* t) {
+    MultiLayerNet* n = net;
+    multi_layer_net_gradient(n, X, t);
+    for (int i = 0; i < n->hidden_layer_num + 1; ++i) {
+        SGD_update_vector(n->b[i], n->A[i]->db, 0.01);
+        SGD_update_matrix(n->W[i], n->A[i]->dW, 0.01);
+    }
+}
+
+static void convnet_step(void* net, void* X, const Vector* t) {
+    SimpleConvNet* n = net;
+    simple_convnet_gradient(n, X, t);
+    SGD_update_vector(n->C->b, n->C->db, 0.01);
+    SGD_update_matrix_4d(n->C->W, n->C->dW, 0.01);
+    for (int i = 0; i < 2; ++i) {
+        SGD_update_vector(n->A[i]->b, n->A[i]->db, 0.01);
+        SGD_update_matrix(n->A[i]->W, n->A[i]->dW, 0.01);
+    }
+}
+
+static void run(const char* name, void (*step)(void*, void*, const Vector*), void* net, void* X, const Vector* t, int steps) {
+    for (int use_arena = 0; use_arena < 2; ++use_arena) {
+        // one step to fill the layer caches (and grow the arena)
+        if (use_arena) arena_begin();
+        step(net, X, t);
+        if (use_arena) arena_end();
+
+        arena_reset_stats();
+        buffer_pool_reset_stats();
+        const double start = now();
+        for (int i = 0; i < steps; ++i) {
+            if (use_arena) arena_begin();
+            step(net, X, t);
+            if (use_arena) arena_end();
+        }
+        const double ms = (now() - start) / steps * 1e3;
+        const ArenaStats s = arena_stats();
+        const BufferPoolStats p = buffer_pool_stats();
+
+        printf("%-14s %-6s %9.2lf %11.1lf %12.1lf %10.1lf %10.1lf %10.1lf\n", name, use_arena ? "arena" : "heap", ms,
+            (double)s.heap_allocs / steps, (double)s.arena_allocs / steps, (double)p.misses / steps,
+            s.peak_bytes / 1048576.0, s.capacity / 1048576.0);
+    }
+}
+
+int main(int argc, char** argv) {
+    const int steps = (argc > 1) ? atoi(argv[1]) : 20;
+    Vector* t = random_labels();
+
+    printf("%-14s %-6s %9s %11s %12s %10s %10s %10s\n", "net", "mode", "ms/step", "heap/step", "arena/step", "miss/step",
+        "peak MB", "arena MB");
+
+    MultiLayerNet* mlnet = create_multi_layer_net(784, 5, 100, 10, BATCH, He, 0, 0);
+    Matrix* X = create_matrix(BATCH, 784);
+    init_matrix_rand(X);
+    run("MultiLayerNet", mlnet_step, mlnet, X, t, steps);
+    free_matrix(X);
+    free_multi_layer_net(mlnet);
+
+    SimpleConvNet* convnet = create_simple_convnet(1, 28, 28, 30, 5, 0, 1, 100, 10, 0.01);
+    Matrix4d* X4d = create_matrix_4d(BATCH, 1, 28, 28);
+    init_matrix_4d_random(X4d);
+    run("SimpleConvNet", convnet_step, convnet, X4d, t, steps);
+    free_matrix_4d(X4d);
+    free_simple_convnet(convnet);
+
+    free_vector(t);
+
+    return 0;
+}
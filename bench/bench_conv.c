@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <matrix.h>
+#include <layer.h>
+
+//
+// Forward and backward latency and peak memory of each DeepConvNet
+// convolution (ch08) for a batch of 100, once per algorithm. Every run
+// happens in a forked child so that its peak RSS is its own; the column is
+// the growth over the RSS the child had once its input was allocated.
+//
+
+#define BATCH 100
+
+typedef struct ConvLayer ConvLayer;
+struct ConvLayer {
+    int C, H, W;
+    int FN, FS, pad, stride;
+};
+
+// the shapes DeepConvNet feeds its six convolutions
+static const ConvLayer LAYERS[] = {
+    { 1, 28, 28, 16, 3, 1, 1},
+    {16, 28, 28, 16, 3, 1, 1},
+    {16, 14, 14, 32, 3, 1, 1},
+    {32, 14, 14, 32, 3, 2, 1},
+    {32,  8,  8, 64, 3, 1, 1},
+    {64,  8,  8, 64, 3, 1, 1},
+};
+
+typedef struct Result Result;
+struct Result {
+    double forward_ms;
+    double backward_ms;
+    long   rss_kb;
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static Result run(const ConvLayer* L, ConvAlgo algo, int iters) {
+    Matrix4d* W = create_matrix_4d(L->FN, L->C, L->FS, L->FS);
+    init_matrix_4d_random(W);
+    Convolution* Conv = create_convolution(W, create_vector(L->FN), L->stride, L->pad);
+    Conv->algo = algo;
+
+    Matrix4d* X = create_matrix_4d(BATCH, L->C, L->H, L->W);
+    init_matrix_4d_random(X);
+    const long base_kb = peak_rss_kb();
+
+    Result r = {0};
+    for (int i = 0; i <= iters; ++i) {
+        const double t0 = now();
+        Matrix4d* Y = convolution_forward(Conv, X);
+        const double t1 = now();
+        Matrix4d* dx = convolution_backward(Conv, Y);
+        const double t2 = now();
+
+        // the first round only warms up the caches of the layer
+        if (i > 0) {
+            r.forward_ms  += (t1 - t0) * 1e3 / iters;
+            r.backward_ms += (t2 - t1) * 1e3 / iters;
+        }
+        free_matrix_4d(Y);
+        free_matrix_4d(dx);
+    }
+    r.rss_kb = peak_rss_kb() - base_kb;
+
+    free_matrix_4d(X);
+    free_convolution(Conv);
+
+    return r;
+}
+
+static int run_in_child(const ConvLayer* L, ConvAlgo algo, int iters, Result* r) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        const Result res = run(L, algo, iters);
+        const ssize_t written = write(fds[1], &res, sizeof(res));
+        _exit(written == sizeof(res) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    const ssize_t got = (pid > 0) ? read(fds[0], r, sizeof(*r)) : -1;
+    close(fds[0]);
+    int status = 0;
+    if (pid > 0) {
+        waitpid(pid, &status, 0);
+    }
+
+    return (got == sizeof(*r) && WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+    const int iters = (argc > 1) ? atoi(argv[1]) : 5;
+    static const char* names[] = {"auto", "im2col", "direct", "winograd"};
+
+    printf("%-6s %-22s %-9s %11s %11s %10s\n", "layer", "shape", "algo", "fwd ms", "bwd ms", "peak MB");
+    for (int i = 0; i < (int)(sizeof(LAYERS) / sizeof(LAYERS[0])); ++i) {
+        const ConvLayer* L = &LAYERS[i];
+        char shape[64];
+        snprintf(shape, sizeof(shape), "%dx%dx%d -> %d k%d p%d", L->C, L->H, L->W, L->FN, L->FS, L->pad);
+
+        Matrix4d* W = create_matrix_4d(L->FN, L->C, L->FS, L->FS);
+        Convolution* Conv = create_convolution(W, create_vector(L->FN), L->stride, L->pad);
+        Matrix4d* X = create_matrix_4d(BATCH, L->C, L->H, L->W);
+        const ConvAlgo pick = convolution_select_algo(Conv, X);
+        free_matrix_4d(X);
+        free_convolution(Conv);
+
+        for (int a = CONV_ALGO_IM2COL; a <= CONV_ALGO_WINOGRAD; ++a) {
+            Result r;
+            if (run_in_child(L, (ConvAlgo)a, iters, &r) != 0) {
+                fprintf(stderr, "layer %d %s failed.\n", i + 1, names[a]);
+                continue;
+            }
+            printf("conv%-2d %-22s %-8s%c %11.2lf %11.2lf %10.1lf\n", i + 1, shape, names[a], (a == (int)pick) ? '*' : ' ',
+                r.forward_ms, r.backward_ms, r.rss_kb / 1024.0);
+        }
+    }
+    printf("* = picked by CONV_ALGO_AUTO\n");
+
+    return 0;
+}
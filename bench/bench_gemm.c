@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <matrix.h>
+#include <thread_pool.h>
+
+//
+// GFLOPS of dot_matrix against the textbook i-j-k loop, at the shapes
+// MultiLayerNet (batch 100, 784-100-...-10) and DeepConvNet (batch 100,
+// im2col matrices times reshaped filters) actually multiply.
+//
+
+typedef struct Shape Shape;
+struct Shape {
+    const char* name;
+    int m;
+    int k;
+    int n;
+};
+
+static const Shape SHAPES[] = {
+    {"mlnet affine1 fwd",     100,   784, 100},
+    {"mlnet affine1 dW",      784,   100, 100},
+    {"mlnet affine1 dX",      100,   100, 784},
+    {"mlnet hidden fwd",      100,   100, 100},
+    {"mlnet output fwd",      100,   100,  10},
+    {"deepconv conv1",      78400,     9,  16},
+    {"deepconv conv2",      78400,   144,  16},
+    {"deepconv conv3",      19600,   144,  32},
+    {"deepconv conv4",      25600,   288,  32},
+    {"deepconv conv5",       6400,   288,  64},
+    {"deepconv conv6",       6400,   576,  64},
+    {"deepconv affine1",      100,  1024,  50},
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static Matrix* naive_dot_matrix(const Matrix* M, const Matrix* N) {
+    Matrix* A = create_matrix(M->rows, N->cols);
+    for (int i = 0; i < M->rows; ++i) {
+        for (int j = 0; j < N->cols; ++j) {
+            double d = 0.0;
+            for (int k = 0; k < M->cols; ++k) {
+                d += M->elements[i][k] * N->elements[k][j];
+            }
+            A->elements[i][j] = d;
+        }
+    }
+
+    return A;
+}
+
+// run f until at least min_sec has elapsed and return seconds per call
+static double measure(Matrix* (*f)(const Matrix*, const Matrix*), const Matrix* A, const Matrix* B, double min_sec) {
+    int reps = 0;
+    const double start = now();
+    double elapsed = 0.0;
+    do {
+        free_matrix(f(A, B));
+        ++reps;
+        elapsed = now() - start;
+    } while (elapsed < min_sec);
+
+    return elapsed / reps;
+}
+
+static double max_abs_diff(const Matrix* A, const Matrix* B) {
+    double d = 0.0;
+    for (int i = 0; i < matrix_size(A); ++i) {
+        d = fmax(d, fabs(A->data[i] - B->data[i]));
+    }
+
+    return d;
+}
+
+int main(int argc, char** argv) {
+    const double min_sec = (argc > 1) ? atof(argv[1]) : 0.5;
+
+    printf("threads: %d\n", thread_pool_num_threads());
+    printf("%-20s %17s %10s %10s %8s %10s\n", "shape", "(m x k) * (k x n)", "naive", "dot_matrix", "speedup", "max diff");
+    for (size_t s = 0; s < sizeof(SHAPES) / sizeof(SHAPES[0]); ++s) {
+        const Shape* sh = &SHAPES[s];
+        Matrix* A = create_matrix(sh->m, sh->k);
+        Matrix* B = create_matrix(sh->k, sh->n);
+        init_matrix_rand(A);
+        init_matrix_rand(B);
+
+        Matrix* R1 = naive_dot_matrix(A, B);
+        Matrix* R2 = dot_matrix(A, B);
+        const double diff = max_abs_diff(R1, R2);
+
+        const double flops = 2.0 * sh->m * sh->k * sh->n;
+        const double t1 = measure(naive_dot_matrix, A, B, min_sec);
+        const double t2 = measure(dot_matrix, A, B, min_sec);
+
+        char dims[64];
+        snprintf(dims, sizeof(dims), "%dx%d*%dx%d", sh->m, sh->k, sh->k, sh->n);
+        printf("%-20s %17s %7.2lf GF %7.2lf GF %7.2lfx %10.2e\n", sh->name, dims, flops / t1 * 1e-9, flops / t2 * 1e-9, t1 / t2, diff);
+
+        free_matrix(A);
+        free_matrix(B);
+        free_matrix(R1);
+        free_matrix(R2);
+    }
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <matrix.h>
+#include <mnist.h>
+#include <simple_convnet.h>
+#include <deep_convnet.h>
+
+//
+// Test accuracy, inference time and peak RSS of the trained SimpleConvNet
+// (ch07/data) and DeepConvNet (ch08/data) for the element type this binary
+// was built with. Run it once from a default build and once from a
+// `make FLOAT=1` build to compare double against float.
+//
+
+#define CHUNK 1000
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long peak_rss_kb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+// the load_params functions read ./data relative to their chapter folder
+static int load_in(const char* dir, int (*load)(void*), void* net) {
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == NULL || chdir(dir) != 0) {
+        fprintf(stderr, "Failed to enter %s.\n", dir);
+        return -1;
+    }
+    const int r = load(net);
+    if (chdir(cwd) != 0) {
+        fprintf(stderr, "Failed to return to %s.\n", cwd);
+        return -1;
+    }
+
+    return r;
+}
+
+static int load_simple_convnet(void* net) {
+    return simple_convnet_load_params(net);
+}
+
+static int load_deep_convnet(void* net) {
+    return deep_convnet_load_params(net);
+}
+
+int main() {
+    double**** test_images = load_mnist_images_4d("./../dataset/t10k-images-idx3-ubyte");
+    if (test_images == NULL) {
+        fprintf(stderr, "failed to load test images.\n");
+        return -1;
+    }
+
+    uint8_t* test_labels = load_mnist_labels("./../dataset/t10k-labels-idx1-ubyte");
+    if (test_labels == NULL) {
+        fprintf(stderr, "failed to load test labels.\n");
+        return -1;
+    }
+
+    printf("element type: %s (%zu bytes)\n", sizeof(real) == sizeof(float) ? "float" : "double", sizeof(real));
+    printf("%-14s %10s %10s\n", "net", "test acc", "seconds");
+
+    SimpleConvNet* simple = create_simple_convnet(1, 28, 28, 30, 5, 0, 1, 100, 10, 0.01);
+    if (load_in("./../ch07", load_simple_convnet, simple) == 0) {
+        double acc = 0.0;
+        const double start = now();
+        for (int i = 0; i < NUM_OF_TEST_IMAGES; i += CHUNK) {
+            acc += simple_convnet_accuracy(simple, test_images + i, test_labels + i, CHUNK, 1) * CHUNK;
+        }
+        printf("%-14s %10.4lf %10.2lf\n", "SimpleConvNet", acc / NUM_OF_TEST_IMAGES, now() - start);
+    }
+    free_simple_convnet(simple);
+
+    int input_dim[3] = {1, 28, 28};
+    ConvParam conv_param[6] = {
+        {16, 3, 1, 1},
+        {16, 3, 1, 1},
+        {32, 3, 1, 1},
+        {32, 3, 2, 1},
+        {64, 3, 1, 1},
+        {64, 3, 1, 1},
+    };
+    DeepConvNet* deep = create_deep_convnet(input_dim, conv_param, 50, 10);
+    if (load_in("./../ch08", load_deep_convnet, deep) == 0) {
+        double acc = 0.0;
+        const double start = now();
+        for (int i = 0; i < NUM_OF_TEST_IMAGES; i += CHUNK) {
+            acc += deep_convnet_accuracy(deep, test_images + i, test_labels + i, CHUNK, 1) * CHUNK;
+        }
+        printf("%-14s %10.4lf %10.2lf\n", "DeepConvNet", acc / NUM_OF_TEST_IMAGES, now() - start);
+    }
+    free_deep_convnet(deep);
+
+    printf("peak RSS: %ld KB\n", peak_rss_kb());
+
+    return 0;
+}
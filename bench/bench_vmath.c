@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <matrix.h>
+#include <vmath.h>
+
+//
+// Time per element of the vmath kernels at every level the CPU runs
+// against a libm call per element, on arrays of 1M random inputs, and the
+// largest relative difference from libm seen on the way.
+//
+
+#define SIZE (1 << 20)
+
+#ifdef USE_FLOAT
+#define EXP  expf
+#define LOG  logf
+#define TANH tanhf
+#else
+#define EXP  exp
+#define LOG  log
+#define TANH tanh
+#endif
+
+typedef void (*ArrayFn)(real* dst, const real* a, int n);
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void libm_exp(real* dst, const real* a, int n) {
+    for (int i = 0; i < n; ++i) {
+        dst[i] = EXP(a[i]);
+    }
+}
+
+static void libm_log(real* dst, const real* a, int n) {
+    for (int i = 0; i < n; ++i) {
+        dst[i] = LOG(a[i]);
+    }
+}
+
+static void libm_sigmoid(real* dst, const real* a, int n) {
+    for (int i = 0; i < n; ++i) {
+        dst[i] = 1 / (1 + EXP(-a[i]));
+    }
+}
+
+static void libm_tanh(real* dst, const real* a, int n) {
+    for (int i = 0; i < n; ++i) {
+        dst[i] = TANH(a[i]);
+    }
+}
+
+static double ns_per_element(ArrayFn fn, real* dst, const real* a, int iters) {
+    fn(dst, a, SIZE);
+    const double t0 = now();
+    for (int i = 0; i < iters; ++i) {
+        fn(dst, a, SIZE);
+    }
+
+    return (now() - t0) * 1e9 / iters / SIZE;
+}
+
+static ArrayFn kernel(const VmathKernels* K, int f) {
+    switch (f) {
+    case 0:  return K->exp;
+    case 1:  return K->log;
+    case 2:  return K->sigmoid;
+    default: return K->tanh;
+    }
+}
+
+int main(int argc, char** argv) {
+    const int iters = (argc > 1) ? atoi(argv[1]) : 20;
+    static const char* names[] = {"exp", "log", "sigmoid", "tanh"};
+    static const ArrayFn libm[] = {libm_exp, libm_log, libm_sigmoid, libm_tanh};
+    // log gets positive inputs spread over many binades
+    static const double lo[] = {-20, -20, -20, -5};
+    static const double hi[] = { 20,  20,  20,  5};
+
+    real* a   = malloc(sizeof(real) * SIZE);
+    real* ref = malloc(sizeof(real) * SIZE);
+    real* dst = malloc(sizeof(real) * SIZE);
+
+    printf("%-8s %-7s %10s %8s %12s\n", "func", "impl", "ns/elem", "speedup", "max rel err");
+    for (int f = 0; f < 4; ++f) {
+        for (int i = 0; i < SIZE; ++i) {
+            const double u = lo[f] + (hi[f] - lo[f]) * rand() / RAND_MAX;
+            a[i] = (f == 1) ? exp(u) : u;
+        }
+
+        const double base = ns_per_element(libm[f], ref, a, iters);
+        printf("%-8s %-7s %10.2lf %8s %12s\n", names[f], "libm", base, "1.00", "-");
+
+        for (int l = SIMD_SCALAR; l < SIMD_LEVEL_NUM; ++l) {
+            const VmathKernels* K = vmath_kernels_level((SimdLevel)l);
+            if (K == NULL) {
+                continue;
+            }
+
+            const double t = ns_per_element(kernel(K, f), dst, a, iters);
+            double err = 0;
+            for (int i = 0; i < SIZE; ++i) {
+                if (ref[i] != 0) {
+                    err = fmax(err, fabs((dst[i] - ref[i]) / ref[i]));
+                }
+            }
+            printf("%-8s %-7s %10.2lf %8.2lf %12.2le\n", names[f], K->name, t, base / t, err);
+        }
+    }
+
+    free(a);
+    free(ref);
+    free(dst);
+
+    return 0;
+}
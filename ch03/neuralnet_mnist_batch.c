@@ -47,10 +47,9 @@ int main() {
     }
 
     int accuracy_cnt = 0;
-    Vector* x = malloc(sizeof(Vector));
-    x->size = NUM_OF_PIXELS;
+    Vector* x = create_vector(NUM_OF_PIXELS);
     for (int i = 0; i < NUM_OF_TEST_IMAGES; ++i) {
-        x->elements = images[i];
+        init_vector_from_array(x, images[i]);
 
         Vector* t1 = dot_vector_matrix(x, W1);
         Vector* a1 = add_vector(t1, b1);
@@ -79,7 +78,7 @@ int main() {
 
     printf("Accuracy:%lf\n", (double)(accuracy_cnt) / NUM_OF_TEST_IMAGES);
 
-    free(x);
+    free_vector(x);
     free_matrix(W1);
     free_matrix(W2);
     free_matrix(W3);
@@ -65,7 +65,11 @@ double two_layer_net_accuracy(const TwoLayerNet* net, double** images, uint8_t*
         } 
     }
 
+    // only the scores are needed, not what backward would use
+    const bool grad = layer_set_grad_enabled(false);
     Matrix* Y = predict(net, X);
+    layer_set_grad_enabled(grad);
+
     int cnt = 0;
     for (int i = 0; i < Y->rows; ++i) {
         const int max_index = argmax(Y->elements[i], Y->cols);
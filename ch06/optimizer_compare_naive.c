@@ -18,7 +18,7 @@ static double df_y(double y) {
 static void run_SGD() {
     const double lr = 0.95;
     double x[30], y[30];
-    double param_x = -7.0, param_y = 2.0;
+    real param_x = -7.0, param_y = 2.0;
     double grads_x = 0.0, grads_y = 0.0;
 
     FILE* fp = fopen("naive_SGD.txt", "w");
@@ -47,9 +47,9 @@ static void run_Momentum() {
     const double momentum = 0.9;
 
     double x[30], y[30];
-    double param_x = -7.0, param_y = 2.0;
+    real param_x = -7.0, param_y = 2.0;
     double grads_x = 0.0, grads_y = 0.0;
-    double v_x = 0.0, v_y = 0.0;
+    real v_x = 0.0, v_y = 0.0;
 
     FILE* fp = fopen("naive_Momentum.txt", "w");
     if (!fp) {
@@ -75,9 +75,9 @@ static void run_Momentum() {
 static void run_AdaGrad() {
     const double lr = 1.5;
     double x[30], y[30];
-    double param_x = -7.0, param_y = 2.0;
+    real param_x = -7.0, param_y = 2.0;
     double grads_x = 0.0, grads_y = 0.0;
-    double h_x = 0.0, h_y = 0.0;
+    real h_x = 0.0, h_y = 0.0;
 
     FILE* fp = fopen("naive_AdaGrad.txt", "w");
     if (!fp) {
@@ -103,10 +103,10 @@ static void run_AdaGrad() {
 static void run_Adam() {
     const double lr = 0.3, beta1 = 0.9, beta2 = 0.999;
     double x[30], y[30];
-    double param_x = -7.0, param_y = 2.0;
+    real param_x = -7.0, param_y = 2.0;
     double grads_x = 0.0, grads_y = 0.0;
-    double m_x = 0.0, m_y = 0.0;
-    double v_x = 0.0, v_y = 0.0;
+    real m_x = 0.0, m_y = 0.0;
+    real v_x = 0.0, v_y = 0.0;
 
     FILE* fp = fopen("naive_Adam.txt", "w");
     if (!fp) {
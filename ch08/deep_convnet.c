@@ -6,6 +6,7 @@
 
 #include <mnist.h>
 #include <function.h>
+#include <evaluate.h>
 
 DeepConvNet* create_deep_convnet(int* input_dim, ConvParam* params, int hidden_size, int output_size) {
     DeepConvNet* net = malloc(sizeof(DeepConvNet));
@@ -55,29 +56,30 @@ DeepConvNet* create_deep_convnet(int* input_dim, ConvParam* params, int hidden_s
     net->D[0] = create_dropout(0.5);
     net->D[1] = create_dropout(0.5);
 
+    // (Convolution - Relu) x 2 - Pooling, three times, then
+    // Affine - Relu - Dropout - Affine - Dropout
+    net->seq = create_sequential();
+    for (int i = 0; i < 6; ++i) {
+        sequential_add(net->seq, &CONVOLUTION_OPS, net->C[i]);
+        sequential_add(net->seq, &RELU_4D_OPS, net->R4d[i]);
+        if (i % 2 == 1) {
+            sequential_add(net->seq, &POOLING_OPS, net->P[i / 2]);
+        }
+    }
+    sequential_add(net->seq, &AFFINE_OPS, net->A[0]);
+    sequential_add(net->seq, &RELU_OPS, net->R);
+    sequential_add(net->seq, &DROPOUT_OPS, net->D[0]);
+    sequential_add(net->seq, &AFFINE_OPS, net->A[1]);
+    sequential_add(net->seq, &DROPOUT_OPS, net->D[1]);
+
     // SoftmaxWithLoss
-    net->S = create_softmax_with_loss();
+    net->S = net->seq->S;
 
     return net;
 }
 
 void free_deep_convnet(DeepConvNet* net) {
-    for (int i = 0; i < 6; ++i) {
-        free_convolution(net->C[i]);
-        free_relu_4d(net->R4d[i]);
-    }
-
-    for (int i = 0; i < 3; ++i) {
-        free_pooling(net->P[i]);
-    }
-
-    for (int i = 0; i < 2; ++i) {
-        free_affine(net->A[i]);
-        free_dropout(net->D[i]);
-    }
-
-    free_softmax_with_loss(net->S);
-    free_relu(net->R);
+    free_sequential(net->seq);
 
     free(net);
 }
@@ -101,92 +103,58 @@ int deep_convnet_load_params(DeepConvNet* net) {
     if (init_vector_from_file(net->A[0]->b,    "./data/b7.csv")) { fprintf(stderr, "Failed to load ./data/b7.csv\n"); }
     if (init_vector_from_file(net->A[1]->b,    "./data/b8.csv")) { fprintf(stderr, "Failed to load ./data/b8.csv\n"); }
 
+    for (int i = 0; i < 6; ++i) {
+        convolution_invalidate_cache(net->C[i]);
+    }
+
     return 0; 
 }
 
+// inference runs each convolution and its ReLU as one fused layer
 Matrix* deep_convnet_predict(const DeepConvNet* net, Matrix4d* X, bool train_flg) {
-    Matrix4d* T   = convolution_forward(net->C[0], X);
-    Matrix4d* T2  = relu_4d_forward(net->R4d[0], T);
-    Matrix4d* T3  = convolution_forward(net->C[1], T2);
-    Matrix4d* T4  = relu_4d_forward(net->R4d[1], T3);
-    Matrix4d* T5  = pooling_forward(net->P[0], T4);
-
-    Matrix4d* T6  = convolution_forward(net->C[2], T5);
-    Matrix4d* T7  = relu_4d_forward(net->R4d[2], T6);
-    Matrix4d* T8  = convolution_forward(net->C[3], T7);
-    Matrix4d* T9  = relu_4d_forward(net->R4d[3], T8);
-    Matrix4d* T10 = pooling_forward(net->P[1], T9);
-
-    Matrix4d* T11 = convolution_forward(net->C[4], T10);
-    Matrix4d* T12 = relu_4d_forward(net->R4d[4], T11);
-    Matrix4d* T13 = convolution_forward(net->C[5], T12);
-    Matrix4d* T14 = relu_4d_forward(net->R4d[5], T13);
-    Matrix4d* T15 = pooling_forward(net->P[2], T14);
-
-    Matrix*   T16 = affine_4d_forward(net->A[0], T15);
-    Matrix*   T17 = relu_forward(net->R, T16);
-    Matrix*   T18 = dropout_forward(net->D[0], T17, train_flg);
-    Matrix*   T19 = affine_forward(net->A[1], T18);
-    Matrix*   Y   = dropout_forward(net->D[1], T19, train_flg);
-
-    free_matrix_4d(T);
-    free_matrix_4d(T2);
-    free_matrix_4d(T3);
-    // free_matrix_4d(T4);
-    free_matrix_4d(T5);
-    free_matrix_4d(T6);
-    free_matrix_4d(T7);
-    free_matrix_4d(T8);
-    // free_matrix_4d(T9);
-    free_matrix_4d(T10);
-    free_matrix_4d(T11);
-    free_matrix_4d(T12);
-    free_matrix_4d(T13);
-    // free_matrix_4d(T14);
-    free_matrix_4d(T15);
-    free_matrix(T16);
-    free_matrix(T17);
-    free_matrix(T18);
-    free_matrix(T19);
-
-    return Y;
+    return sequential_predict(net->seq, tensor_4d(X), train_flg).m;
 }
 
 double deep_convnet_loss(DeepConvNet* net, Matrix4d* X, const Vector* t) {
-    Matrix* Y = deep_convnet_predict(net, X, true);
-    const double v = softmax_with_loss_forward(net->S, Y, t); 
-
-    free_matrix(Y);
-    return v;
+    return sequential_loss(net->seq, tensor_4d(X), t);
 }
 
-void deep_convnet_gradient(DeepConvNet* net, Matrix4d* X, const Vector* t) {
-    // TODO
+int deep_convnet_gradient(DeepConvNet* net, Matrix4d* X, const Vector* t) {
+    return sequential_gradient(net->seq, tensor_4d(X), t);
 }
 
-double deep_convnet_accuracy(const DeepConvNet* net, double**** images, uint8_t* labels, int size, int num_channels) {
-    Matrix4d* X = create_matrix_4d(size, num_channels, NUM_OF_ROWS, NUM_OF_COLS);
-    for (int i = 0; i < size; ++i) {
-        for (int j = 0; j < num_channels; ++j) {
+typedef struct Batch Batch;
+struct Batch {
+    const DeepConvNet* net;
+    double**** images;
+    int num_channels;
+};
+
+static Matrix* score(const void* arg, int begin, int end) {
+    const Batch* b = arg;
+    Matrix4d* X = create_matrix_4d(end - begin, b->num_channels, NUM_OF_ROWS, NUM_OF_COLS);
+    for (int i = 0; i < X->sizes[0]; ++i) {
+        for (int j = 0; j < b->num_channels; ++j) {
             for (int k = 0; k < NUM_OF_ROWS; ++k) {
                 for (int l = 0; l < NUM_OF_COLS; ++l) {
-                    X->elements[i][j][k][l] = images[i][j][k][l];
+                    X->elements[i][j][k][l] = b->images[begin + i][j][k][l];
                 }
             }
         } 
     }
 
-    Matrix* Y = deep_convnet_predict(net, X, false);
-    int cnt = 0;
-    for (int i = 0; i < Y->rows; ++i) {
-        const int max_index = argmax(Y->elements[i], Y->cols);
-        if (max_index == labels[i]) {
-            ++cnt;
-        }
-    }
-
+    Matrix* Y = deep_convnet_predict(b->net, X, false);
     free_matrix_4d(X);
-    free_matrix(Y);
+
+    return Y;
+}
+
+double deep_convnet_accuracy(const DeepConvNet* net, double**** images, uint8_t* labels, int size, int num_channels) {
+    const Batch b = {net, images, num_channels};
+    const int cnt = eval_count_correct(score, &b, labels, size, true);
+    if (cnt < 0) {
+        return -1;
+    }
 
     return (double) cnt / size;
 }
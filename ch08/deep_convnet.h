@@ -3,6 +3,7 @@
 
 #include "matrix.h"
 #include "layer.h"
+#include "sequential.h"
 
 typedef struct ConvParam ConvParam;
 struct ConvParam {
@@ -21,6 +22,7 @@ struct DeepConvNet {
     Relu* R;
     Dropout* D[2];
     SoftmaxWithLoss* S;
+    Sequential* seq;    // owns every layer and S, in the order they run
 };
 
 DeepConvNet* create_deep_convnet(int* intput_dim, ConvParam* params, int hidden_size, int output_size); 
@@ -29,7 +31,7 @@ int deep_convnet_load_params(DeepConvNet* net);
 
 Matrix* deep_convnet_predict(const DeepConvNet* net, Matrix4d* X, bool train_flg);
 double deep_convnet_loss(DeepConvNet* net, Matrix4d* X, const Vector* t);
-void deep_convnet_gradient(DeepConvNet* net, Matrix4d* X, const Vector* t);
+int deep_convnet_gradient(DeepConvNet* net, Matrix4d* X, const Vector* t);
 double deep_convnet_accuracy(const DeepConvNet* net, double**** images, uint8_t* labels, int size, int num_channels);
 
 #endif
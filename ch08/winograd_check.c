@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <mnist.h>
+#include <matrix.h>
+#include <function.h>
+
+#include "deep_convnet.h"
+
+//
+// Runs the pretrained DeepConvNet (./data) over the test set twice: once
+// with every convolution on im2col and once with Winograd on the layers
+// that support it, and reports how far apart the two are.
+//
+
+#define CHUNK 500
+
+static void set_algo(DeepConvNet* net, ConvAlgo algo) {
+    for (int i = 0; i < 6; ++i) {
+        net->C[i]->algo = algo;
+    }
+}
+
+static Matrix4d* load_chunk(double**** images, int begin, int size) {
+    Matrix4d* X = create_matrix_4d(size, 1, NUM_OF_ROWS, NUM_OF_COLS);
+    for (int i = 0; i < size; ++i) {
+        for (int j = 0; j < NUM_OF_ROWS; ++j) {
+            for (int k = 0; k < NUM_OF_COLS; ++k) {
+                X->elements[i][0][j][k] = images[begin + i][0][j][k];
+            }
+        }
+    }
+
+    return X;
+}
+
+int main() {
+    double**** test_images = load_mnist_images_4d("./../dataset/t10k-images-idx3-ubyte");
+    if (test_images == NULL) {
+        fprintf(stderr, "failed to load test images.\n");
+        return -1;
+    }
+
+    uint8_t* test_labels = load_mnist_labels("./../dataset/t10k-labels-idx1-ubyte");
+    if (test_labels == NULL) {
+        fprintf(stderr, "failed to load test labels.\n");
+        return -1;
+    }
+
+    int input_dim[3] = {1, 28, 28};
+    ConvParam conv_param[6] = {
+        {16, 3, 1, 1},
+        {16, 3, 1, 1},
+        {32, 3, 1, 1},
+        {32, 3, 2, 1},
+        {64, 3, 1, 1},
+        {64, 3, 1, 1},
+    };
+    DeepConvNet* net = create_deep_convnet(input_dim, conv_param, 50, 10);
+    deep_convnet_load_params(net);
+
+    double max_diff = 0.0;
+    int correct[2] = {0, 0};
+    int disagree = 0;
+    for (int i = 0; i < NUM_OF_TEST_IMAGES; i += CHUNK) {
+        Matrix4d* X = load_chunk(test_images, i, CHUNK);
+
+        set_algo(net, CONV_ALGO_IM2COL);
+        Matrix* Y1 = deep_convnet_predict(net, X, false);
+        set_algo(net, CONV_ALGO_WINOGRAD);
+        Matrix* Y2 = deep_convnet_predict(net, X, false);
+
+        for (int j = 0; j < CHUNK; ++j) {
+            for (int k = 0; k < Y1->cols; ++k) {
+                const double d = fabs(Y1->elements[j][k] - Y2->elements[j][k]);
+                if (max_diff < d) {
+                    max_diff = d;
+                }
+            }
+            const int p1 = argmax(Y1->elements[j], Y1->cols);
+            const int p2 = argmax(Y2->elements[j], Y2->cols);
+            correct[0] += (p1 == test_labels[i + j]);
+            correct[1] += (p2 == test_labels[i + j]);
+            disagree += (p1 != p2);
+        }
+
+        free_matrix_4d(X);
+        free_matrix(Y1);
+        free_matrix(Y2);
+    }
+
+    printf("im2col   accuracy: %.4lf\n", (double)correct[0] / NUM_OF_TEST_IMAGES);
+    printf("winograd accuracy: %.4lf\n", (double)correct[1] / NUM_OF_TEST_IMAGES);
+    printf("max |score diff|:  %.3e\n", max_diff);
+    printf("predictions that differ: %d\n", disagree);
+
+    free_deep_convnet(net);
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include "arena.h"
+#include "buffer_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+// chunks start at 1 MB and double, so a step settles in a few of them
+#define ARENA_CHUNK_MIN   (1 << 20)
+#define ARENA_CHUNK_ALIGN 64
+
+typedef struct Chunk Chunk;
+struct Chunk {
+    Chunk* next;
+    char*  base;
+    size_t size;
+    size_t used;
+};
+
+typedef struct Arena Arena;
+struct Arena {
+    Chunk* head;
+    Chunk* tail;
+    Chunk* current;
+    int    depth;
+    int    suspended;
+    size_t in_use;
+    ArenaStats stats;
+};
+
+static __thread Arena arena;
+
+// Every block is preceded by a word saying where it came from, so that
+// arena_free needs no lookup in the chunks of the thread that made it:
+// ARENA_TAG for arena memory, else the distance back to the start of the
+// buffer pool block. Prefixes are multiples of a word, so the low bit is
+// free for the tag.
+#define ARENA_TAG ((size_t)1)
+
+static size_t prefix_of(size_t align) {
+    return (align > sizeof(size_t)) ? align : sizeof(size_t);
+}
+
+static void* tag(void* base, size_t prefix, size_t origin) {
+    char* p = (char*)base + prefix;
+    ((size_t*)p)[-1] = origin;
+
+    return p;
+}
+
+static Chunk* add_chunk(size_t min_size) {
+    size_t size = ARENA_CHUNK_MIN;
+    if (arena.tail != NULL && size < arena.tail->size * 2) {
+        size = arena.tail->size * 2;
+    }
+    while (size < min_size) {
+        size *= 2;
+    }
+
+    Chunk* c = malloc(sizeof(Chunk));
+    void* p = NULL;
+    if (c == NULL || posix_memalign(&p, ARENA_CHUNK_ALIGN, size) != 0) {
+        fprintf(stderr, "Failed to allocate an arena chunk of %zu bytes.\n", size);
+        free(c);
+        return NULL;
+    }
+    c->next = NULL;
+    c->base = p;
+    c->size = size;
+    c->used = 0;
+
+    if (arena.tail == NULL) {
+        arena.head = c;
+    } else {
+        arena.tail->next = c;
+    }
+    arena.tail = c;
+    arena.stats.capacity += size;
+    ++arena.stats.chunks;
+
+    return c;
+}
+
+static void* bump(size_t bytes, size_t align) {
+    for (Chunk* c = arena.current; c != NULL; c = c->next) {
+        const uintptr_t start = ((uintptr_t)c->base + c->used + align - 1) & ~(uintptr_t)(align - 1);
+        const size_t end = (start - (uintptr_t)c->base) + bytes;
+        if (end <= c->size) {
+            arena.in_use += end - c->used;
+            c->used = end;
+            arena.current = c;
+            return (void*)start;
+        }
+    }
+
+    Chunk* c = add_chunk(bytes + align);
+    if (c == NULL) {
+        return NULL;
+    }
+    arena.current = c;
+
+    return bump(bytes, align);
+}
+
+void arena_begin() {
+    if (arena.depth++ == 0) {
+        arena.current = arena.head;
+        arena.in_use = 0;
+    }
+}
+
+void arena_end() {
+    if (arena.depth == 0) {
+        fprintf(stderr, "arena_end without arena_begin.\n");
+        return;
+    }
+    if (--arena.depth > 0) {
+        return;
+    }
+
+    for (Chunk* c = arena.head; c != NULL; c = c->next) {
+        c->used = 0;
+    }
+    arena.current = arena.head;
+    arena.in_use = 0;
+}
+
+void arena_suspend() {
+    ++arena.suspended;
+}
+
+void arena_resume() {
+    --arena.suspended;
+}
+
+void* arena_alloc(size_t bytes, size_t align) {
+    const size_t prefix = prefix_of(align);
+    if (arena.depth > 0 && arena.suspended == 0) {
+        void* p = bump(prefix + bytes, align);
+        if (p != NULL) {
+            ++arena.stats.arena_allocs;
+            if (arena.stats.peak_bytes < arena.in_use) {
+                arena.stats.peak_bytes = arena.in_use;
+            }
+            return tag(p, prefix, ARENA_TAG);
+        }
+    }
+
+    ++arena.stats.heap_allocs;
+    void* p = buffer_pool_alloc(prefix + bytes, align);
+    if (p == NULL) {
+        return NULL;
+    }
+
+    return tag(p, prefix, prefix);
+}
+
+bool arena_owns(const void* p) {
+    for (const Chunk* c = arena.head; c != NULL; c = c->next) {
+        if ((const char*)p >= c->base && (const char*)p < c->base + c->size) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void arena_free(void* p) {
+    if (p == NULL) {
+        return;
+    }
+    const size_t origin = ((size_t*)p)[-1];
+    if (origin == ARENA_TAG) {
+        return;
+    }
+    buffer_pool_free((char*)p - origin);
+}
+
+ArenaStats arena_stats() {
+    return arena.stats;
+}
+
+void arena_reset_stats() {
+    const size_t capacity = arena.stats.capacity;
+    const int chunks = arena.stats.chunks;
+    arena.stats = (ArenaStats){0};
+    arena.stats.capacity = capacity;
+    arena.stats.chunks = chunks;
+}
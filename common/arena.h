@@ -0,0 +1,52 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+//
+// A per-thread bump allocator for the temporaries of one training step.
+//
+// Between arena_begin() and arena_end() every tensor the calling thread
+// creates is carved out of its arena, and free_* on such a tensor does
+// nothing. arena_end() takes all of it back at once; the chunks are kept for
+// the next step, so once the arena has grown to the size of a step no more
+// malloc calls are made. Scopes nest, only the outermost arena_end() resets.
+//
+// Tensors created in a scope must not be used, or freed, after it ends.
+// Anything that has to outlive the step (layer caches, parameters) is
+// created with the arena suspended, which is what the reuse_* factories do.
+//
+
+void arena_begin();
+void arena_end();
+
+// temporarily send allocations of the calling thread back to the heap
+void arena_suspend();
+void arena_resume();
+
+//
+// bytes with the given alignment (a power of two), from the arena while a
+// scope is open and not suspended, from the buffer pool otherwise (see
+// buffer_pool.h). arena_free returns heap memory to the pool and ignores
+// arena memory; each block records which it is, so it may be called on any
+// thread. arena_owns looks only at the chunks of the calling thread.
+//
+void* arena_alloc(size_t bytes, size_t align);
+void arena_free(void* p);
+bool arena_owns(const void* p);
+
+typedef struct ArenaStats ArenaStats;
+struct ArenaStats {
+    long   arena_allocs;  // served from the arena
+    long   heap_allocs;   // sent to the buffer pool by arena_alloc
+    size_t peak_bytes;    // most arena memory in use at once
+    size_t capacity;      // bytes held in arena chunks
+    int    chunks;
+};
+
+// counters of the calling thread since it started or since the last reset
+ArenaStats arena_stats();
+void arena_reset_stats();
+
+#endif
@@ -0,0 +1,275 @@
+#include "buffer_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// distinct (size, alignment) pairs a thread keeps; a network uses a few dozen
+#define POOL_CLASSES 256
+#define POOL_DEFAULT_LIMIT_MB 256
+
+// a class that has not been used in this many pool calls of its thread is
+// emptied the next time a new size shows up
+#define POOL_IDLE_CALLS 4096
+
+// sits right before the block it describes
+typedef struct BlockHeader BlockHeader;
+struct BlockHeader {
+    size_t bytes;
+    size_t align;
+    BlockHeader* next;
+    size_t pad;
+};
+
+typedef struct SizeClass SizeClass;
+struct SizeClass {
+    size_t bytes;   // 0 when the slot is unused
+    size_t align;
+    BlockHeader* head;
+    long last_use;  // pool.calls when a block last came or went
+};
+
+typedef struct BufferPool BufferPool;
+struct BufferPool {
+    SizeClass classes[POOL_CLASSES];
+    int used_classes;
+    long calls;
+    BufferPoolStats stats;
+    bool registered;
+};
+
+static __thread BufferPool pool;
+
+// the cap and the bytes cached by every thread together
+static size_t limit;
+static size_t total_cached;
+static pthread_key_t exit_key;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void release_on_exit(void* p) {
+    (void)p;
+    buffer_pool_trim();
+}
+
+static void init_buffer_pool() {
+    long mb = POOL_DEFAULT_LIMIT_MB;
+    const char* env = getenv(BUFFER_POOL_ENV);
+    if (env != NULL && atol(env) >= 0) {
+        mb = atol(env);
+    }
+    limit = (size_t)mb << 20;
+    pthread_key_create(&exit_key, release_on_exit);
+}
+
+static size_t prefix_of(size_t align) {
+    return (align > sizeof(BlockHeader)) ? align : sizeof(BlockHeader);
+}
+
+static BlockHeader* header_of(void* p) {
+    return (BlockHeader*)((char*)p - sizeof(BlockHeader));
+}
+
+static void release_block(BlockHeader* h) {
+    free((char*)(h + 1) - prefix_of(h->align));
+}
+
+// hands every cached block of c back to the heap
+static void release_class(SizeClass* c) {
+    while (c->head != NULL) {
+        BlockHeader* h = c->head;
+        c->head = h->next;
+        pool.stats.cached_bytes -= h->bytes;
+        --pool.stats.cached_blocks;
+        __atomic_sub_fetch(&total_cached, h->bytes, __ATOMIC_RELAXED);
+        release_block(h);
+    }
+}
+
+static size_t slot_of(size_t bytes, size_t align) {
+    return (bytes * 31 + align) % POOL_CLASSES;
+}
+
+static SizeClass* probe(SizeClass* classes, size_t bytes, size_t align) {
+    size_t i = slot_of(bytes, align);
+    for (int n = 0; n < POOL_CLASSES; ++n, i = (i + 1) % POOL_CLASSES) {
+        SizeClass* c = &classes[i];
+        if (c->bytes == 0 || (c->bytes == bytes && c->align == align)) {
+            return c;
+        }
+    }
+
+    return NULL;
+}
+
+// a new size: rebuild the table without the classes that have sat idle,
+// handing their blocks back, so that sizes a net no longer uses neither
+// hold memory nor fill the table
+static void drop_idle_classes() {
+    SizeClass old[POOL_CLASSES];
+    memcpy(old, pool.classes, sizeof(old));
+    memset(pool.classes, 0, sizeof(pool.classes));
+    pool.used_classes = 0;
+
+    for (int i = 0; i < POOL_CLASSES; ++i) {
+        SizeClass* c = &old[i];
+        if (c->bytes == 0) {
+            continue;
+        }
+        if (pool.calls - c->last_use > POOL_IDLE_CALLS) {
+            release_class(c);
+            continue;
+        }
+        *probe(pool.classes, c->bytes, c->align) = *c;
+        ++pool.used_classes;
+    }
+}
+
+static SizeClass* find_class(size_t bytes, size_t align, bool insert) {
+    SizeClass* c = probe(pool.classes, bytes, align);
+    if (c != NULL && c->bytes != 0) {
+        return c;
+    }
+    if (!insert) {
+        return NULL;
+    }
+
+    drop_idle_classes();
+    if (pool.used_classes == POOL_CLASSES) {
+        return NULL;
+    }
+    c = probe(pool.classes, bytes, align);
+    c->bytes = bytes;
+    c->align = align;
+    c->head = NULL;
+    c->last_use = pool.calls;
+    ++pool.used_classes;
+
+    return c;
+}
+
+// the class of this thread used longest ago that still holds blocks,
+// other than keep
+static SizeClass* least_recent_class(const SizeClass* keep) {
+    SizeClass* lru = NULL;
+    for (int i = 0; i < POOL_CLASSES; ++i) {
+        SizeClass* c = &pool.classes[i];
+        if (c != keep && c->head != NULL && (lru == NULL || c->last_use < lru->last_use)) {
+            lru = c;
+        }
+    }
+
+    return lru;
+}
+
+// makes room for bytes more under the process-wide cap by emptying the
+// least recently used classes of this thread
+static bool make_room(size_t bytes, const SizeClass* keep) {
+    if (bytes > limit) {
+        return false;
+    }
+    while (__atomic_load_n(&total_cached, __ATOMIC_RELAXED) + bytes > limit) {
+        SizeClass* c = least_recent_class(keep);
+        if (c == NULL) {
+            return false;
+        }
+        release_class(c);
+    }
+
+    return true;
+}
+
+void* buffer_pool_alloc(size_t bytes, size_t align) {
+    pthread_once(&init_once, init_buffer_pool);
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    if (align < sizeof(void*)) {
+        align = sizeof(void*);
+    }
+
+    ++pool.calls;
+    SizeClass* c = find_class(bytes, align, false);
+    if (c != NULL && c->head != NULL) {
+        BlockHeader* h = c->head;
+        c->head = h->next;
+        c->last_use = pool.calls;
+        pool.stats.cached_bytes -= bytes;
+        --pool.stats.cached_blocks;
+        __atomic_sub_fetch(&total_cached, bytes, __ATOMIC_RELAXED);
+        ++pool.stats.hits;
+        return h + 1;
+    }
+
+    ++pool.stats.misses;
+    const size_t prefix = prefix_of(align);
+    void* base = NULL;
+    if (posix_memalign(&base, align, prefix + bytes) != 0) {
+        return NULL;
+    }
+
+    BlockHeader* h = (BlockHeader*)((char*)base + prefix) - 1;
+    h->bytes = bytes;
+    h->align = align;
+    h->next  = NULL;
+
+    return h + 1;
+}
+
+void buffer_pool_free(void* p) {
+    if (p == NULL) {
+        return;
+    }
+    pthread_once(&init_once, init_buffer_pool);
+
+    ++pool.calls;
+    BlockHeader* h = header_of(p);
+    SizeClass* c = find_class(h->bytes, h->align, true);
+    if (c != NULL && !make_room(h->bytes, c)) {
+        c = NULL;
+    }
+    if (c == NULL) {
+        ++pool.stats.releases;
+        release_block(h);
+        return;
+    }
+
+    if (!pool.registered) {
+        // any non-NULL value makes the key's destructor run at thread exit
+        pthread_setspecific(exit_key, &pool);
+        pool.registered = true;
+    }
+    h->next = c->head;
+    c->head = h;
+    c->last_use = pool.calls;
+    pool.stats.cached_bytes += h->bytes;
+    ++pool.stats.cached_blocks;
+    __atomic_add_fetch(&total_cached, h->bytes, __ATOMIC_RELAXED);
+}
+
+void buffer_pool_trim() {
+    for (int i = 0; i < POOL_CLASSES; ++i) {
+        release_class(&pool.classes[i]);
+    }
+    memset(pool.classes, 0, sizeof(pool.classes));
+    pool.used_classes = 0;
+}
+
+void buffer_pool_set_limit(size_t bytes) {
+    pthread_once(&init_once, init_buffer_pool);
+    limit = bytes;
+}
+
+BufferPoolStats buffer_pool_stats() {
+    BufferPoolStats s = pool.stats;
+    s.total_cached_bytes = __atomic_load_n(&total_cached, __ATOMIC_RELAXED);
+    return s;
+}
+
+void buffer_pool_reset_stats() {
+    pool.stats.hits     = 0;
+    pool.stats.misses   = 0;
+    pool.stats.releases = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+//
+// A per-thread cache of freed heap blocks, keyed by their exact byte size
+// and alignment. Layers allocate the same shapes every iteration, so after
+// the first one nearly every request is served from a block freed by the
+// previous iteration instead of going to malloc.
+//
+// Blocks may be freed from any thread; they join the pool of the thread that
+// frees them. The pool of a thread is released when the thread exits. The
+// DL_POOL_LIMIT environment variable caps the bytes all threads together
+// keep cached (in MB, default 256); 0 turns the pool off. A thread that
+// would go over the cap first hands back its least recently used sizes,
+// and sizes left unused for a while are handed back when new ones show up.
+//
+
+#define BUFFER_POOL_ENV "DL_POOL_LIMIT"
+
+// bytes aligned to align (a power of two); the contents are not cleared
+void* buffer_pool_alloc(size_t bytes, size_t align);
+void buffer_pool_free(void* p);
+
+// hand every cached block of the calling thread back to the heap
+void buffer_pool_trim();
+
+// replaces the cap read from DL_POOL_LIMIT; blocks cached beyond a lowered
+// cap go back as their threads free more
+void buffer_pool_set_limit(size_t bytes);
+
+typedef struct BufferPoolStats BufferPoolStats;
+struct BufferPoolStats {
+    long   hits;          // served from a cached block
+    long   misses;        // went to the heap
+    long   releases;      // freed to the heap because the pool was full
+    size_t cached_bytes;  // bytes currently held in the pool
+    int    cached_blocks;
+    size_t total_cached_bytes;  // held by the pools of every thread
+};
+
+// counters of the calling thread since it started or since the last reset,
+// and the bytes cached process-wide
+BufferPoolStats buffer_pool_stats();
+void buffer_pool_reset_stats();
+
+#endif
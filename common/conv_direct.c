@@ -0,0 +1,359 @@
+#include "conv_direct.h"
+#include "thread_pool.h"
+#include "buffer_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// filters that share one pass over the input in the forward kernel
+#define FB 4
+
+typedef struct ConvShape ConvShape;
+struct ConvShape {
+    int N, C, H, W;
+    int FN, FH, FW;
+    int OH, OW;
+    int stride, pad;
+};
+
+typedef struct ConvTask ConvTask;
+struct ConvTask {
+    ConvShape s;
+    const real* x;
+    const real* w;
+    const real* b;
+    const real* dout;
+    real* out;
+    real* dw;
+    real* db;
+    bool relu;
+};
+
+static bool set_shape(ConvShape* s, const Matrix4d* X, const Matrix4d* W, const Matrix4d* Y, int stride, int pad) {
+    s->N  = X->sizes[0];
+    s->C  = X->sizes[1];
+    s->H  = X->sizes[2];
+    s->W  = X->sizes[3];
+    s->FN = W->sizes[0];
+    s->FH = W->sizes[2];
+    s->FW = W->sizes[3];
+    s->OH = 1 + (s->H + 2 * pad - s->FH) / stride;
+    s->OW = 1 + (s->W + 2 * pad - s->FW) / stride;
+    s->stride = stride;
+    s->pad    = pad;
+
+    if (W->sizes[1] != s->C || Y->sizes[0] != s->N || Y->sizes[1] != s->FN || Y->sizes[2] != s->OH || Y->sizes[3] != s->OW) {
+        fprintf(stderr, "Invalid size. X=(%d, %d, %d, %d), W=(%d, %d, %d, %d), out=(%d, %d, %d, %d)\n",
+            X->sizes[0], X->sizes[1], X->sizes[2], X->sizes[3],
+            W->sizes[0], W->sizes[1], W->sizes[2], W->sizes[3],
+            Y->sizes[0], Y->sizes[1], Y->sizes[2], Y->sizes[3]);
+        return false;
+    }
+    if (!matrix_4d_is_contiguous(X) || !matrix_4d_is_contiguous(W) || !matrix_4d_is_contiguous(Y)) {
+        fprintf(stderr, "Invalid layout. Direct convolution needs contiguous tensors.\n");
+        return false;
+    }
+
+    return true;
+}
+
+// outputs o in [*lo, *hi) whose input o * stride + k - pad lies in [0, n)
+static void clip_range(int n, int k, int stride, int pad, int out, int* lo, int* hi) {
+    const int first = pad - k;
+    const int last  = n - 1 + pad - k;
+    *lo = (first <= 0) ? 0 : (first + stride - 1) / stride;
+    *hi = (last < 0) ? 0 : last / stride + 1;
+    if (*hi > out) {
+        *hi = out;
+    }
+    if (*lo > *hi) {
+        *lo = *hi;
+    }
+}
+
+//
+// forward
+//
+
+// nf (1 to FB) output planes of image n, starting at filter f
+static void forward_block(const ConvTask* t, int n, int f, int nf) {
+    const ConvShape* s = &t->s;
+    const int plane = s->OH * s->OW;
+
+    real* o[FB];
+    for (int k = 0; k < nf; ++k) {
+        o[k] = t->out + ((size_t)n * s->FN + f + k) * plane;
+        const real bias = (t->b != NULL) ? t->b[f + k] : 0;
+        for (int i = 0; i < plane; ++i) {
+            o[k][i] = bias;
+        }
+    }
+
+    for (int c = 0; c < s->C; ++c) {
+        const real* xp = t->x + ((size_t)n * s->C + c) * s->H * s->W;
+        for (int kh = 0; kh < s->FH; ++kh) {
+            int oh_lo, oh_hi;
+            clip_range(s->H, kh, s->stride, s->pad, s->OH, &oh_lo, &oh_hi);
+            for (int kw = 0; kw < s->FW; ++kw) {
+                int ow_lo, ow_hi;
+                clip_range(s->W, kw, s->stride, s->pad, s->OW, &ow_lo, &ow_hi);
+
+                real w[FB];
+                for (int k = 0; k < nf; ++k) {
+                    w[k] = t->w[(((size_t)(f + k) * s->C + c) * s->FH + kh) * s->FW + kw];
+                }
+
+                for (int oh = oh_lo; oh < oh_hi; ++oh) {
+                    const real* xr = xp + (size_t)(oh * s->stride + kh - s->pad) * s->W + kw - s->pad;
+                    const int r = oh * s->OW;
+                    if (nf == FB && s->stride == 1) {
+                        real* o0 = o[0] + r;
+                        real* o1 = o[1] + r;
+                        real* o2 = o[2] + r;
+                        real* o3 = o[3] + r;
+                        for (int ow = ow_lo; ow < ow_hi; ++ow) {
+                            const real xv = xr[ow];
+                            o0[ow] += w[0] * xv;
+                            o1[ow] += w[1] * xv;
+                            o2[ow] += w[2] * xv;
+                            o3[ow] += w[3] * xv;
+                        }
+                    } else {
+                        for (int k = 0; k < nf; ++k) {
+                            real* ok = o[k] + r;
+                            for (int ow = ow_lo; ow < ow_hi; ++ow) {
+                                ok[ow] += w[k] * xr[ow * s->stride];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // the planes of this block were just written and are still in cache
+    if (t->relu) {
+        for (int k = 0; k < nf; ++k) {
+            for (int i = 0; i < plane; ++i) {
+                o[k][i] = (o[k][i] > 0) ? o[k][i] : 0;
+            }
+        }
+    }
+}
+
+static void forward_range(void* arg, int begin, int end) {
+    const ConvTask* t = arg;
+    const int blocks = (t->s.FN + FB - 1) / FB;
+    for (int i = begin; i < end; ++i) {
+        const int n = i / blocks;
+        const int f = (i % blocks) * FB;
+        const int nf = (t->s.FN - f < FB) ? t->s.FN - f : FB;
+        forward_block(t, n, f, nf);
+    }
+}
+
+int conv_direct_forward(Matrix4d* out, const Matrix4d* X, const Matrix4d* W, const Vector* b, int stride, int pad, bool relu) {
+    ConvTask t = {0};
+    if (!set_shape(&t.s, X, W, out, stride, pad)) {
+        return -1;
+    }
+    if (b != NULL && b->size != t.s.FN) {
+        fprintf(stderr, "Invalid size. b->size=%d, FN=%d\n", b->size, t.s.FN);
+        return -1;
+    }
+    t.x   = X->data;
+    t.w   = W->data;
+    t.b   = (b != NULL) ? b->elements : NULL;
+    t.out = out->data;
+    t.relu = relu;
+
+    parallel_for(t.s.N * ((t.s.FN + FB - 1) / FB), forward_range, &t);
+
+    return 0;
+}
+
+//
+// backward
+//
+
+//
+// dW[f][c][kh][kw] is a sum over n, oh and ow. The kernel keeps one partial
+// sum per output column for every tap (FH * FW rows of OW) and only reduces
+// the columns at the end, so the hot loop is an elementwise multiply-add
+// like the forward one instead of a chain of short dot products. CB input
+// channels are done together so that each row of dout is loaded once for
+// all of them.
+//
+#define CB 4
+
+static void backward_weights_range(void* arg, int begin, int end) {
+    const ConvTask* t = arg;
+    const ConvShape* s = &t->s;
+    const int plane = s->OH * s->OW;
+    const int taps  = s->FH * s->FW;
+    const size_t acc_size = (size_t)CB * taps * s->OW;
+    real* acc = buffer_pool_alloc(sizeof(real) * acc_size + sizeof(int) * 2 * s->FW, MATRIX_ALIGNMENT);
+
+    // the ow range of each kw is the same for every row
+    int* ow_lo = (int*)(acc + acc_size);
+    int* ow_hi = ow_lo + s->FW;
+    for (int kw = 0; kw < s->FW; ++kw) {
+        clip_range(s->W, kw, s->stride, s->pad, s->OW, &ow_lo[kw], &ow_hi[kw]);
+    }
+
+    for (int f = begin; f < end; ++f) {
+        real db = 0;
+        for (int n = 0; n < s->N; ++n) {
+            const real* dp = t->dout + ((size_t)n * s->FN + f) * plane;
+            for (int i = 0; i < plane; ++i) {
+                db += dp[i];
+            }
+        }
+        if (t->db != NULL) {
+            t->db[f] = db;
+        }
+
+        for (int c = 0; c < s->C; c += CB) {
+            const int nc = (s->C - c < CB) ? s->C - c : CB;
+            memset(acc, 0, sizeof(real) * acc_size);
+            for (int n = 0; n < s->N; ++n) {
+                const real* dp = t->dout + ((size_t)n * s->FN + f) * plane;
+                const real* xp = t->x + ((size_t)n * s->C + c) * s->H * s->W;
+                for (int kh = 0; kh < s->FH; ++kh) {
+                    int oh_lo, oh_hi;
+                    clip_range(s->H, kh, s->stride, s->pad, s->OH, &oh_lo, &oh_hi);
+                    for (int oh = oh_lo; oh < oh_hi; ++oh) {
+                        const real* dr = dp + oh * s->OW;
+                        const real* xr = xp + (size_t)(oh * s->stride + kh - s->pad) * s->W - s->pad;
+                        for (int kw = 0; kw < s->FW; ++kw) {
+                            const int lo = ow_lo[kw], hi = ow_hi[kw];
+                            real* a = acc + (kh * s->FW + kw) * s->OW;
+                            const real* xk = xr + kw;
+                            if (nc == CB && s->stride == 1) {
+                                const size_t xs = (size_t)s->H * s->W;
+                                const size_t as = (size_t)taps * s->OW;
+                                for (int ow = lo; ow < hi; ++ow) {
+                                    const real d = dr[ow];
+                                    a[ow]          += d * xk[ow];
+                                    a[as + ow]     += d * xk[xs + ow];
+                                    a[2 * as + ow] += d * xk[2 * xs + ow];
+                                    a[3 * as + ow] += d * xk[3 * xs + ow];
+                                }
+                            } else {
+                                for (int k = 0; k < nc; ++k) {
+                                    real* ak = a + (size_t)k * taps * s->OW;
+                                    const real* xkk = xk + (size_t)k * s->H * s->W;
+                                    for (int ow = lo; ow < hi; ++ow) {
+                                        ak[ow] += dr[ow] * xkk[ow * s->stride];
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (int k = 0; k < nc; ++k) {
+                real* dw = t->dw + ((size_t)f * s->C + c + k) * taps;
+                for (int i = 0; i < taps; ++i) {
+                    const real* a = acc + ((size_t)k * taps + i) * s->OW;
+                    real sum = 0;
+                    for (int ow = 0; ow < s->OW; ++ow) {
+                        sum += a[ow];
+                    }
+                    dw[i] = sum;
+                }
+            }
+        }
+    }
+
+    buffer_pool_free(acc);
+}
+
+int conv_direct_backward_weights(Matrix4d* dW, Vector* db, const Matrix4d* dout, const Matrix4d* X, int stride, int pad) {
+    ConvTask t = {0};
+    if (!set_shape(&t.s, X, dW, dout, stride, pad)) {
+        return -1;
+    }
+    if (db != NULL && db->size != t.s.FN) {
+        fprintf(stderr, "Invalid size. db->size=%d, FN=%d\n", db->size, t.s.FN);
+        return -1;
+    }
+    t.x    = X->data;
+    t.dout = dout->data;
+    t.dw   = dW->data;
+    t.db   = (db != NULL) ? db->elements : NULL;
+
+    parallel_for(t.s.FN, backward_weights_range, &t);
+
+    return 0;
+}
+
+// dx of images [begin, end): every filter tap scatters its output row back
+// onto the input row it was computed from, FB filters at a time so that a
+// row of dx is loaded and stored once per block
+static void backward_data_range(void* arg, int begin, int end) {
+    const ConvTask* t = arg;
+    const ConvShape* s = &t->s;
+    const int plane = s->OH * s->OW;
+
+    for (int n = begin; n < end; ++n) {
+        real* dxn = t->out + (size_t)n * s->C * s->H * s->W;
+        memset(dxn, 0, sizeof(real) * s->C * s->H * s->W);
+
+        for (int c = 0; c < s->C; ++c) {
+            real* dxp = dxn + (size_t)c * s->H * s->W;
+            for (int f = 0; f < s->FN; f += FB) {
+                const int nf = (s->FN - f < FB) ? s->FN - f : FB;
+                const real* dp = t->dout + ((size_t)n * s->FN + f) * plane;
+                for (int kh = 0; kh < s->FH; ++kh) {
+                    int oh_lo, oh_hi;
+                    clip_range(s->H, kh, s->stride, s->pad, s->OH, &oh_lo, &oh_hi);
+                    for (int kw = 0; kw < s->FW; ++kw) {
+                        int ow_lo, ow_hi;
+                        clip_range(s->W, kw, s->stride, s->pad, s->OW, &ow_lo, &ow_hi);
+
+                        real w[FB];
+                        for (int k = 0; k < nf; ++k) {
+                            w[k] = t->w[(((size_t)(f + k) * s->C + c) * s->FH + kh) * s->FW + kw];
+                        }
+
+                        for (int oh = oh_lo; oh < oh_hi; ++oh) {
+                            real* dxr = dxp + (size_t)(oh * s->stride + kh - s->pad) * s->W + kw - s->pad;
+                            const real* dr = dp + oh * s->OW;
+                            if (nf == FB && s->stride == 1) {
+                                const real* d1 = dr + plane;
+                                const real* d2 = dr + 2 * plane;
+                                const real* d3 = dr + 3 * plane;
+                                for (int ow = ow_lo; ow < ow_hi; ++ow) {
+                                    dxr[ow] += w[0] * dr[ow] + w[1] * d1[ow] + w[2] * d2[ow] + w[3] * d3[ow];
+                                }
+                            } else {
+                                for (int k = 0; k < nf; ++k) {
+                                    const real* dk = dr + k * plane;
+                                    for (int ow = ow_lo; ow < ow_hi; ++ow) {
+                                        dxr[ow * s->stride] += w[k] * dk[ow];
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+int conv_direct_backward_data(Matrix4d* dx, const Matrix4d* dout, const Matrix4d* W, int stride, int pad) {
+    ConvTask t = {0};
+    if (!set_shape(&t.s, dx, W, dout, stride, pad)) {
+        return -1;
+    }
+    t.w    = W->data;
+    t.dout = dout->data;
+    t.out  = dx->data;
+
+    parallel_for(t.s.N, backward_data_range, &t);
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+#ifndef CONV_DIRECT_H
+#define CONV_DIRECT_H
+
+#include <stdbool.h>
+
+#include "matrix.h"
+
+//
+// Direct convolution on NCHW tensors, without the im2col expansion.
+//
+// X is (N, C, H, W), W is (FN, C, FH, FW) and out / dout are
+// (N, FN, OH, OW) with OH = 1 + (H + 2 * pad - FH) / stride, likewise OW.
+// Padding is never materialised: each kernel clips its loops to the part
+// of the window that falls inside the image. The work is split over images
+// or filters so that no two threads write the same output, which keeps the
+// results independent of the number of threads.
+//
+// All three return 0, or -1 if a shape does not match.
+//
+
+// out = conv(X, W) + b, passed through ReLU if relu is set
+int conv_direct_forward(Matrix4d* out, const Matrix4d* X, const Matrix4d* W, const Vector* b, int stride, int pad, bool relu);
+
+// dW and db from the input of the forward pass and the output gradient
+int conv_direct_backward_weights(Matrix4d* dW, Vector* db, const Matrix4d* dout, const Matrix4d* X, int stride, int pad);
+
+// dx, the gradient with respect to the input
+int conv_direct_backward_data(Matrix4d* dx, const Matrix4d* dout, const Matrix4d* W, int stride, int pad);
+
+#endif
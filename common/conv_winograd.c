@@ -0,0 +1,235 @@
+#include "conv_winograd.h"
+#include "gemm.h"
+#include "thread_pool.h"
+#include "buffer_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// F(2x2, 3x3): 2x2 outputs from 4x4 inputs
+#define TILE_OUT 2
+#define TILE_IN  4
+#define TILE_SIZE (TILE_IN * TILE_IN)
+
+typedef struct WinogradTask WinogradTask;
+struct WinogradTask {
+    int N, C, H, W;
+    int FN, OH, OW;
+    int TH, TW, T;
+    int pad;
+    bool relu;
+    const real* x;
+    const real* b;
+    real* v;    // (16, C, T) input tiles
+    real* m;    // (16, FN, T) products
+    real* out;
+};
+
+bool conv_winograd_supported(const Matrix4d* W, int stride) {
+    return stride == 1 && W->sizes[2] == 3 && W->sizes[3] == 3;
+}
+
+//
+// filter
+//
+
+// G = [1 0 0; 1/2 1/2 1/2; 1/2 -1/2 1/2; 0 0 1], u = G g G^T
+static void transform_filter(const real* g, real* u) {
+    real t[TILE_IN][3];
+    for (int j = 0; j < 3; ++j) {
+        t[0][j] = g[j];
+        t[1][j] = (g[j] + g[3 + j] + g[6 + j]) * 0.5;
+        t[2][j] = (g[j] - g[3 + j] + g[6 + j]) * 0.5;
+        t[3][j] = g[6 + j];
+    }
+    for (int i = 0; i < TILE_IN; ++i) {
+        u[i * TILE_IN + 0] = t[i][0];
+        u[i * TILE_IN + 1] = (t[i][0] + t[i][1] + t[i][2]) * 0.5;
+        u[i * TILE_IN + 2] = (t[i][0] - t[i][1] + t[i][2]) * 0.5;
+        u[i * TILE_IN + 3] = t[i][2];
+    }
+}
+
+int conv_winograd_transform_filter_into(Matrix* U, const Matrix4d* W) {
+    const int FN = W->sizes[0];
+    const int C  = W->sizes[1];
+    if (W->sizes[2] != 3 || W->sizes[3] != 3 || U->rows != TILE_SIZE * FN || U->cols != C) {
+        fprintf(stderr, "Invalid size. U=(%d, %d), W=(%d, %d, %d, %d)\n",
+            U->rows, U->cols, W->sizes[0], W->sizes[1], W->sizes[2], W->sizes[3]);
+        return -1;
+    }
+
+    for (int f = 0; f < FN; ++f) {
+        for (int c = 0; c < C; ++c) {
+            real u[TILE_SIZE];
+            transform_filter(W->data + ((size_t)f * C + c) * 9, u);
+            for (int xi = 0; xi < TILE_SIZE; ++xi) {
+                U->elements[xi * FN + f][c] = u[xi];
+            }
+        }
+    }
+
+    return 0;
+}
+
+//
+// input
+//
+
+// B^T = [1 0 -1 0; 0 1 1 0; 0 -1 1 0; 0 1 0 -1], v = B^T d B
+static void transform_input(const real d[TILE_IN][TILE_IN], real* v) {
+    real t[TILE_IN][TILE_IN];
+    for (int j = 0; j < TILE_IN; ++j) {
+        t[0][j] = d[0][j] - d[2][j];
+        t[1][j] = d[1][j] + d[2][j];
+        t[2][j] = d[2][j] - d[1][j];
+        t[3][j] = d[1][j] - d[3][j];
+    }
+    for (int i = 0; i < TILE_IN; ++i) {
+        v[i * TILE_IN + 0] = t[i][0] - t[i][2];
+        v[i * TILE_IN + 1] = t[i][1] + t[i][2];
+        v[i * TILE_IN + 2] = t[i][2] - t[i][1];
+        v[i * TILE_IN + 3] = t[i][1] - t[i][3];
+    }
+}
+
+// tiles of input channels [begin, end) for every image
+static void input_range(void* arg, int begin, int end) {
+    const WinogradTask* w = arg;
+    for (int c = begin; c < end; ++c) {
+        for (int n = 0; n < w->N; ++n) {
+            const real* xp = w->x + ((size_t)n * w->C + c) * w->H * w->W;
+            for (int th = 0; th < w->TH; ++th) {
+                for (int tw = 0; tw < w->TW; ++tw) {
+                    // out-of-image rows and columns are the zero padding
+                    real d[TILE_IN][TILE_IN];
+                    const int ih0 = th * TILE_OUT - w->pad;
+                    const int iw0 = tw * TILE_OUT - w->pad;
+                    for (int i = 0; i < TILE_IN; ++i) {
+                        const int ih = ih0 + i;
+                        for (int j = 0; j < TILE_IN; ++j) {
+                            const int iw = iw0 + j;
+                            d[i][j] = (ih >= 0 && ih < w->H && iw >= 0 && iw < w->W) ? xp[ih * w->W + iw] : 0;
+                        }
+                    }
+
+                    real v[TILE_SIZE];
+                    transform_input(d, v);
+                    const size_t t = ((size_t)n * w->TH + th) * w->TW + tw;
+                    for (int xi = 0; xi < TILE_SIZE; ++xi) {
+                        w->v[((size_t)xi * w->C + c) * w->T + t] = v[xi];
+                    }
+                }
+            }
+        }
+    }
+}
+
+//
+// output
+//
+
+// A^T = [1 1 1 0; 0 1 -1 -1], y = A^T m A
+static void transform_output(const real* m, real y[TILE_OUT][TILE_OUT]) {
+    real t[TILE_OUT][TILE_IN];
+    for (int j = 0; j < TILE_IN; ++j) {
+        t[0][j] = m[j] + m[TILE_IN + j] + m[2 * TILE_IN + j];
+        t[1][j] = m[TILE_IN + j] - m[2 * TILE_IN + j] - m[3 * TILE_IN + j];
+    }
+    for (int i = 0; i < TILE_OUT; ++i) {
+        y[i][0] = t[i][0] + t[i][1] + t[i][2];
+        y[i][1] = t[i][1] - t[i][2] - t[i][3];
+    }
+}
+
+// output planes of filters [begin, end) for every image
+static void output_range(void* arg, int begin, int end) {
+    const WinogradTask* w = arg;
+    for (int f = begin; f < end; ++f) {
+        const real bias = (w->b != NULL) ? w->b[f] : 0;
+        for (int n = 0; n < w->N; ++n) {
+            real* op = w->out + ((size_t)n * w->FN + f) * w->OH * w->OW;
+            for (int th = 0; th < w->TH; ++th) {
+                for (int tw = 0; tw < w->TW; ++tw) {
+                    const size_t t = ((size_t)n * w->TH + th) * w->TW + tw;
+                    real m[TILE_SIZE];
+                    for (int xi = 0; xi < TILE_SIZE; ++xi) {
+                        m[xi] = w->m[((size_t)xi * w->FN + f) * w->T + t];
+                    }
+
+                    real y[TILE_OUT][TILE_OUT];
+                    transform_output(m, y);
+                    // the last tile of an odd-sized output hangs over the edge
+                    for (int i = 0; i < TILE_OUT && th * TILE_OUT + i < w->OH; ++i) {
+                        for (int j = 0; j < TILE_OUT && tw * TILE_OUT + j < w->OW; ++j) {
+                            const real v = y[i][j] + bias;
+                            op[(th * TILE_OUT + i) * w->OW + tw * TILE_OUT + j] = (w->relu && v < 0) ? 0 : v;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// input transform, the 16 GEMMs of the tile positions, output transform
+static int winograd_run(WinogradTask* w, const Matrix* U) {
+    parallel_for(w->C, input_range, w);
+    for (int xi = 0; xi < TILE_SIZE; ++xi) {
+        const int ret = gemm(false, false, w->FN, w->T, w->C, 1,
+            U->data + (size_t)xi * w->FN * w->C, w->C,
+            w->v + (size_t)xi * w->C * w->T, w->T,
+            0, w->m + (size_t)xi * w->FN * w->T, w->T);
+        if (ret != 0) {
+            return -1;
+        }
+    }
+    parallel_for(w->FN, output_range, w);
+
+    return 0;
+}
+
+int conv_winograd_forward(Matrix4d* out, const Matrix4d* X, const Matrix* U, const Vector* b, int pad, bool relu) {
+    WinogradTask w = {0};
+    w.N  = X->sizes[0];
+    w.C  = X->sizes[1];
+    w.H  = X->sizes[2];
+    w.W  = X->sizes[3];
+    w.FN = U->rows / TILE_SIZE;
+    w.OH = w.H + 2 * pad - 2;
+    w.OW = w.W + 2 * pad - 2;
+    if (U->rows != TILE_SIZE * w.FN || U->cols != w.C || out->sizes[0] != w.N || out->sizes[1] != w.FN
+            || out->sizes[2] != w.OH || out->sizes[3] != w.OW || (b != NULL && b->size != w.FN)) {
+        fprintf(stderr, "Invalid size. X=(%d, %d, %d, %d), U=(%d, %d), out=(%d, %d, %d, %d)\n",
+            X->sizes[0], X->sizes[1], X->sizes[2], X->sizes[3], U->rows, U->cols,
+            out->sizes[0], out->sizes[1], out->sizes[2], out->sizes[3]);
+        return -1;
+    }
+    if (!matrix_4d_is_contiguous(X) || !matrix_4d_is_contiguous(out)) {
+        fprintf(stderr, "Invalid layout. Winograd convolution needs contiguous tensors.\n");
+        return -1;
+    }
+
+    w.TH  = (w.OH + TILE_OUT - 1) / TILE_OUT;
+    w.TW  = (w.OW + TILE_OUT - 1) / TILE_OUT;
+    w.T   = w.N * w.TH * w.TW;
+    w.pad = pad;
+    w.relu = relu;
+    w.x   = X->data;
+    w.b   = (b != NULL) ? b->elements : NULL;
+    w.out = out->data;
+    w.v   = buffer_pool_alloc(sizeof(real) * TILE_SIZE * w.C * w.T, MATRIX_ALIGNMENT);
+    w.m   = buffer_pool_alloc(sizeof(real) * TILE_SIZE * w.FN * w.T, MATRIX_ALIGNMENT);
+
+    int ret = -1;
+    if (w.v == NULL || w.m == NULL) {
+        fprintf(stderr, "Failed to allocate the Winograd tile buffers.\n");
+    } else {
+        ret = winograd_run(&w, U);
+    }
+
+    buffer_pool_free(w.v);
+    buffer_pool_free(w.m);
+
+    return ret;
+}
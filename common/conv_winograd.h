@@ -0,0 +1,35 @@
+#ifndef CONV_WINOGRAD_H
+#define CONV_WINOGRAD_H
+
+#include <stdbool.h>
+
+#include "matrix.h"
+
+//
+// Winograd F(2x2, 3x3) convolution for 3x3 filters with stride 1.
+//
+// Each 2x2 output tile is computed from a 4x4 input tile with 16
+// multiplies per input channel instead of 36:
+//
+//   Y = A^T [ (G g G^T) .* (B^T d B) ] A
+//
+// The filter transform U = G g G^T depends only on the weights, so it is
+// computed once by conv_winograd_transform_filter_into and can be kept
+// until the weights change. The products for all tiles are then 16
+// GEMMs of (FN, C) x (C, tiles), one per element of the 4x4 tile.
+//
+// Tensors are NCHW as in conv_direct.h: X is (N, C, H, W), W is
+// (FN, C, 3, 3) and out is (N, FN, OH, OW).
+//
+
+bool conv_winograd_supported(const Matrix4d* W, int stride);
+
+// U is (16 * FN, C): row xi * FN + f holds element xi of every channel's
+// transformed filter f
+int conv_winograd_transform_filter_into(Matrix* U, const Matrix4d* W);
+
+// out = conv(X, W) + b with U from W, passed through ReLU if relu is set;
+// -1 on a size mismatch or when the tile buffers or a GEMM fail
+int conv_winograd_forward(Matrix4d* out, const Matrix4d* X, const Matrix* U, const Vector* b, int pad, bool relu);
+
+#endif
@@ -0,0 +1,71 @@
+#include "evaluate.h"
+#include "function.h"
+#include "layer.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct EvalTask EvalTask;
+struct EvalTask {
+    EvalScoreFn score;
+    const void* arg;
+    const uint8_t* labels;
+    int size;
+    int* correct;   // per chunk, summed once every chunk is done
+};
+
+// chunks [begin, end)
+static void chunk_range(void* arg, int begin, int end) {
+    const EvalTask* t = arg;
+
+    // the flag is per thread, so each worker turns it off for itself
+    const bool grad = layer_set_grad_enabled(false);
+    for (int c = begin; c < end; ++c) {
+        const int lo = c * EVAL_CHUNK;
+        const int hi = (t->size - lo < EVAL_CHUNK) ? t->size : lo + EVAL_CHUNK;
+
+        Matrix* Y = t->score(t->arg, lo, hi);
+        if (Y == NULL) {
+            t->correct[c] = -1;
+            continue;
+        }
+        int cnt = 0;
+        for (int i = 0; i < Y->rows; ++i) {
+            if (argmax(Y->elements[i], Y->cols) == t->labels[lo + i]) {
+                ++cnt;
+            }
+        }
+        t->correct[c] = cnt;
+
+        free_matrix(Y);
+    }
+    layer_set_grad_enabled(grad);
+}
+
+int eval_count_correct(EvalScoreFn score, const void* arg, const uint8_t* labels, int size, bool parallel) {
+    if (size <= 0) {
+        return 0;
+    }
+
+    const int chunks = (size + EVAL_CHUNK - 1) / EVAL_CHUNK;
+    EvalTask t = {score, arg, labels, size, malloc(sizeof(int) * chunks)};
+    if (t.correct == NULL) {
+        fprintf(stderr, "Failed to allocate %zu bytes.\n", sizeof(int) * chunks);
+        return -1;
+    }
+    // with fewer chunks than threads the layers make better use of the pool
+    if (parallel && chunks >= thread_pool_num_threads()) {
+        parallel_for(chunks, chunk_range, &t);
+    } else {
+        chunk_range(&t, 0, chunks);
+    }
+
+    int cnt = 0;
+    for (int c = 0; c < chunks && cnt >= 0; ++c) {
+        cnt = (t.correct[c] < 0) ? -1 : cnt + t.correct[c];
+    }
+    free(t.correct);
+
+    return cnt;
+}
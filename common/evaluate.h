@@ -0,0 +1,32 @@
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "matrix.h"
+
+//
+// Accuracy over a data set of any size. The inputs are scored EVAL_CHUNK at
+// a time: each chunk is built, run through the net and freed before the
+// next one, so memory follows the chunk size rather than the data set, and
+// the buffer pool hands every chunk the blocks of the one before it.
+// Gradient tracking is off while scoring (see layer.h).
+//
+// With parallel set the chunks are spread over the thread pool, a run of
+// consecutive chunks per thread, and the layers of each chunk run inline on
+// its thread. That needs a net whose forward only reads its layers. With
+// fewer chunks than threads they run one after another on the caller.
+//
+
+#define EVAL_CHUNK 128
+
+// scores (end - begin, classes) of inputs [begin, end), freed by the
+// caller; NULL when the inputs could not be scored
+typedef Matrix* (*EvalScoreFn)(const void* arg, int begin, int end);
+
+// number of inputs in [0, size) whose highest score is at their label; -1
+// when a chunk could not be scored
+int eval_count_correct(EvalScoreFn score, const void* arg, const uint8_t* labels, int size, bool parallel);
+
+#endif
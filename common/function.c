@@ -1,4 +1,5 @@
 #include "function.h"
+#include "vmath.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,9 +12,7 @@ double sigmoid(double x) {
 
 Vector* vector_sigmoid(const Vector* v) {
     Vector* r = create_vector(v->size);
-    for (int i = 0; i < r->size; ++i) {
-        r->elements[i] = sigmoid(v->elements[i]);
-    }
+    vmath_kernels()->sigmoid(r->elements, v->elements, v->size);
 
     return r;
 }
@@ -21,78 +20,77 @@ Vector* vector_sigmoid(const Vector* v) {
 Matrix* matrix_sigmoid(const Matrix* M) {
     Matrix* R = create_matrix(M->rows, M->cols);
     
+    const VmathKernels* K = vmath_kernels();
     for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            R->elements[i][j] = sigmoid(M->elements[i][j]);
-        }
+        K->sigmoid(R->elements[i], M->elements[i], M->cols);
     }
 
     return R;
 }
 
+// s (1 - s) from one sigmoid per element
 Matrix* sigmoid_grad(const Matrix* M) {
     Matrix* R = create_matrix(M->rows, M->cols);
     
+    const VmathKernels* K = vmath_kernels();
     for (int i = 0; i < M->rows; ++i) {
+        real* r = R->elements[i];
+        K->sigmoid(r, M->elements[i], M->cols);
         for (int j = 0; j < M->cols; ++j) {
-            R->elements[i][j] = (1.0 - sigmoid(M->elements[i][j])) * sigmoid(M->elements[i][j]);
+            r[j] = (1.0 - r[j]) * r[j];
         }
     }
 
     return R;
 }
 
-Vector* vector_softmax(const Vector* v) {
-    Vector* r = create_vector(v->size);
+// dst = softmax(x) over n elements, shifted by the max so exp cannot overflow
+static void softmax_row(real* dst, const real* x, int n) {
+    real max = x[0];
+    for (int j = 1; j < n; ++j) {
+        max = (x[j] > max) ? x[j] : max;
+    }
 
-    double max = 0.0;
-    for (int i = 0; i < v->size; ++i) {
-        max = ((max > v->elements[i]) ? max : v->elements[i]);
-    }   
+    for (int j = 0; j < n; ++j) {
+        dst[j] = x[j] - max;
+    }
+    vmath_kernels()->exp(dst, dst, n);
 
     double sum = 0.0;
-    for (int i = 0; i < v->size; ++i) {
-        sum += exp(v->elements[i] - max);
-    }   
+    for (int j = 0; j < n; ++j) {
+        sum += dst[j];
+    }
+    simd_kernels()->scale(dst, dst, 1.0 / sum, n);
+}
 
-    for (int i = 0; i < v->size; ++i) {
-        r->elements[i] = exp(v->elements[i] - max) / sum;
-    }   
+Vector* vector_softmax(const Vector* v) {
+    Vector* r = create_vector(v->size);
+    softmax_row(r->elements, v->elements, v->size);
 
     return r;
 }
 
-Matrix* matrix_softmax(const Matrix* M) {
-    Matrix* N = create_matrix(M->rows, M->cols);
+int matrix_softmax_into(Matrix* N, const Matrix* M) {
+    if (N->rows != M->rows || N->cols != M->cols) {
+        fprintf(stderr, "Invalid size. dst (%d, %d), expected (%d, %d)\n", N->rows, N->cols, M->rows, M->cols);
+        return -1;
+    }
 
-    Vector* max_vals = create_vector(M->rows);
     for (int i = 0; i < M->rows; ++i) {
-        double max = M->elements[i][0];
-        for (int j = 1; j < M->cols; ++j) {
-            if (max < M->elements[i][j]) {
-                max =  M->elements[i][j];
-            }
-        }
-        max_vals->elements[i] = max;
+        softmax_row(N->elements[i], M->elements[i], M->cols);
     }
 
-    for (int i = 0; i < M->rows; ++i) {
-        double sum = 0.0;
-        for (int j = 0; j < M->cols; ++j) {
-            N->elements[i][j] = exp(M->elements[i][j] - max_vals->elements[i]);
-            sum += N->elements[i][j];
-        }
+    return 0;
+}
 
-        for (int j = 0; j < M->cols; ++j) {
-            N->elements[i][j] /= sum;
-        }
-    }
+Matrix* matrix_softmax(const Matrix* M) {
+    Matrix* N = create_matrix(M->rows, M->cols);
+    matrix_softmax_into(N, M);
 
-    free_vector(max_vals);
     return N;
 }
 
-int argmax(const double* v, int size) {
+int argmax(const real* v, int size) {
     int index = 0;
     double max = v[0];
     for (int i = 1; i < size; ++i) {
@@ -120,7 +118,12 @@ int vector_argmax(const Vector* v) {
 
 int* matrix_argmax_row(const Matrix* M) {
     int* arg_max = (int*)malloc(sizeof(int) * M->rows);
+    matrix_argmax_row_into(arg_max, M);
 
+    return arg_max;
+}
+
+void matrix_argmax_row_into(int* arg_max, const Matrix* M) {
     for (int i = 0; i < M->rows; ++i) {
         int idx = 0;
         double max = - DBL_MAX;
@@ -133,6 +136,4 @@ int* matrix_argmax_row(const Matrix* M) {
 
         arg_max[i] = idx;
     }
-
-    return arg_max;
 }
@@ -11,9 +11,11 @@ Matrix* sigmoid_grad(const Matrix* M);
 
 Vector* vector_softmax(const Vector* v);
 Matrix* matrix_softmax(const Matrix* M);
+int matrix_softmax_into(Matrix* N, const Matrix* M);
 
-int argmax(const double* v, int size);
+int argmax(const real* v, int size);
 int vector_argmax(const Vector* v);
 int* matrix_argmax_row(const Matrix* M);
+void matrix_argmax_row_into(int* arg_max, const Matrix* M);
 
 #endif
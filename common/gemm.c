@@ -0,0 +1,362 @@
+#include "gemm.h"
+#include "matrix.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// The blocking follows the usual Goto/BLIS layering:
+//   - a KC x NC panel of B is packed once and reused for every block of A,
+//   - an MC x KC block of A is packed so that it stays resident in L2,
+//   - the micro-kernel keeps an MR x NR tile of C in registers while it
+//     streams one MR-wide sliver of A and one NR-wide sliver of B from L1.
+//
+
+#define MR 4
+#define NR 8
+
+#define MC 96
+#define KC 256
+#define NC 2048
+
+// below this many multiply-adds a product is not worth waking the pool
+#define PARALLEL_MIN_FLOPS (64.0 * 64.0 * 64.0)
+
+static inline int min_int(int a, int b) {
+    return (a < b) ? a : b;
+}
+
+static real* alloc_pack(int n) {
+    void* p = NULL;
+    if (posix_memalign(&p, MATRIX_ALIGNMENT, sizeof(real) * n) != 0) {
+        fprintf(stderr, "Failed to allocate gemm pack buffer.\n");
+        return NULL;
+    }
+
+    return p;
+}
+
+// A(i, p) = A[i * rs + p * cs]; packed as MR-row slivers, zero padded.
+// Exactly one of rs and cs is 1, and the loop order follows the unit stride.
+static void pack_a(int mc, int kc, const real* A, int rs, int cs, real* buf) {
+    for (int i = 0; i < mc; i += MR) {
+        const int mr = min_int(MR, mc - i);
+        const real* a = A + (size_t)i * rs;
+        if (cs == 1) {
+            for (int ii = 0; ii < mr; ++ii) {
+                const real* row = a + (size_t)ii * rs;
+                for (int p = 0; p < kc; ++p) {
+                    buf[p * MR + ii] = row[p];
+                }
+            }
+        } else {
+            for (int p = 0; p < kc; ++p) {
+                const real* col = a + (size_t)p * cs;
+                for (int ii = 0; ii < mr; ++ii) {
+                    buf[p * MR + ii] = col[ii];
+                }
+            }
+        }
+        for (int ii = mr; ii < MR; ++ii) {
+            for (int p = 0; p < kc; ++p) {
+                buf[p * MR + ii] = 0.0;
+            }
+        }
+        buf += MR * kc;
+    }
+}
+
+// B(p, j) = B[p * rs + j * cs]; packed as NR-column slivers, zero padded.
+static void pack_b(int kc, int nc, const real* B, int rs, int cs, real* buf) {
+    for (int j = 0; j < nc; j += NR) {
+        const int nr = min_int(NR, nc - j);
+        const real* b = B + (size_t)j * cs;
+        if (cs == 1) {
+            for (int p = 0; p < kc; ++p) {
+                const real* row = b + (size_t)p * rs;
+                for (int jj = 0; jj < nr; ++jj) {
+                    buf[p * NR + jj] = row[jj];
+                }
+            }
+        } else {
+            for (int jj = 0; jj < nr; ++jj) {
+                const real* col = b + (size_t)jj * cs;
+                for (int p = 0; p < kc; ++p) {
+                    buf[p * NR + jj] = col[p];
+                }
+            }
+        }
+        for (int jj = nr; jj < NR; ++jj) {
+            for (int p = 0; p < kc; ++p) {
+                buf[p * NR + jj] = 0.0;
+            }
+        }
+        buf += NR * kc;
+    }
+}
+
+// bias and ReLU over C[0:mr, 0:nr] in place; bias points at the first
+// column's value. Only for products with no multiply-adds to fold them into.
+static void epilogue_tile(real* C, int ldc, int mr, int nr, const real* bias, bool relu) {
+    for (int i = 0; i < mr; ++i) {
+        real* c = C + (size_t)i * ldc;
+        if (bias != NULL) {
+            for (int j = 0; j < nr; ++j) {
+                c[j] += bias[j];
+            }
+        }
+        if (relu) {
+            for (int j = 0; j < nr; ++j) {
+                c[j] = (c[j] > 0) ? c[j] : 0;
+            }
+        }
+    }
+}
+
+// C[0:mr, 0:nr] += alpha * a * b for one packed sliver pair. C already holds
+// beta * C and the earlier KC panels, so with ep set (on the last panel) the
+// bias and ReLU are applied to that sum before it is stored, and the tile is
+// written once.
+static void micro_kernel(
+    int kc,
+    const real* restrict a,
+    const real* restrict b,
+    real* restrict C, int ldc,
+    int mr, int nr,
+    real alpha,
+    const GemmEpilogue* ep, int col
+) {
+    real ab[MR][NR] = {{0}};
+
+    for (int p = 0; p < kc; ++p) {
+        for (int i = 0; i < MR; ++i) {
+            const real ai = a[i];
+            for (int j = 0; j < NR; ++j) {
+                ab[i][j] += ai * b[j];
+            }
+        }
+        a += MR;
+        b += NR;
+    }
+
+    if (ep == NULL) {
+        if (mr == MR && nr == NR) {
+            for (int i = 0; i < MR; ++i) {
+                real* c = C + (size_t)i * ldc;
+                for (int j = 0; j < NR; ++j) {
+                    c[j] += alpha * ab[i][j];
+                }
+            }
+        } else {
+            for (int i = 0; i < mr; ++i) {
+                real* c = C + (size_t)i * ldc;
+                for (int j = 0; j < nr; ++j) {
+                    c[j] += alpha * ab[i][j];
+                }
+            }
+        }
+        return;
+    }
+
+    real bias[NR] = {0};
+    if (ep->col_bias != NULL) {
+        for (int j = 0; j < nr; ++j) {
+            bias[j] = ep->col_bias[col + j];
+        }
+    }
+    for (int i = 0; i < mr; ++i) {
+        real* c = C + (size_t)i * ldc;
+        for (int j = 0; j < nr; ++j) {
+            const real v = c[j] + alpha * ab[i][j] + bias[j];
+            c[j] = (ep->relu && v < 0) ? 0 : v;
+        }
+    }
+}
+
+static void scale_c(int m, int n, real beta, real* C, int ldc) {
+    if (beta == 1.0) {
+        return;
+    }
+
+    for (int i = 0; i < m; ++i) {
+        real* c = C + (size_t)i * ldc;
+        if (beta == 0.0) {
+            memset(c, 0, sizeof(real) * n);
+        } else {
+            for (int j = 0; j < n; ++j) {
+                c[j] *= beta;
+            }
+        }
+    }
+}
+
+typedef struct GemmPanel GemmPanel;
+struct GemmPanel {
+    int m, kc, nc;
+    real alpha;
+    const real* A;
+    int rsa, csa;
+    const real* pb;
+    real* C;
+    int ldc;
+    int col_chunks;
+    int chunk_nr;
+    const GemmEpilogue* ep;     // only set for the last KC panel
+    int jc;
+    int failed;                 // set by a task that could not get its buffer
+};
+
+// per-thread buffers for packed blocks of A and panels of B, kept for the
+// life of the thread so that steady-state products allocate nothing. The B
+// buffer grows to the largest panel the thread has packed, at most
+// KC * (NC + NR) values.
+static __thread real* pack_a_buf = NULL;
+static __thread real* pack_b_buf = NULL;
+static __thread int pack_b_size = 0;
+
+static real* thread_pack_b(int n) {
+    if (n > pack_b_size) {
+        free(pack_b_buf);
+        pack_b_buf = alloc_pack(n);
+        pack_b_size = (pack_b_buf != NULL) ? n : 0;
+    }
+
+    return pack_b_buf;
+}
+
+// One task is one MC row block of C crossed with one range of NR panels.
+static void gemm_panel_tasks(void* arg, int begin, int end) {
+    GemmPanel* g = arg;
+    if (pack_a_buf == NULL) {
+        pack_a_buf = alloc_pack(MC * KC);
+        if (pack_a_buf == NULL) {
+            __atomic_store_n(&g->failed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    for (int t = begin; t < end; ++t) {
+        const int ic = (t / g->col_chunks) * MC;
+        const int jr_begin = (t % g->col_chunks) * g->chunk_nr * NR;
+        const int jr_end = min_int(g->nc, jr_begin + g->chunk_nr * NR);
+        const int mc = min_int(MC, g->m - ic);
+        if (jr_begin >= jr_end) {
+            continue;
+        }
+
+        pack_a(mc, g->kc, g->A + (size_t)ic * g->rsa, g->rsa, g->csa, pack_a_buf);
+
+        for (int jr = jr_begin; jr < jr_end; jr += NR) {
+            for (int ir = 0; ir < mc; ir += MR) {
+                micro_kernel(
+                    g->kc,
+                    pack_a_buf + (size_t)ir * g->kc,
+                    g->pb + (size_t)jr * g->kc,
+                    g->C + (size_t)(ic + ir) * g->ldc + jr, g->ldc,
+                    min_int(MR, mc - ir), min_int(NR, g->nc - jr),
+                    g->alpha,
+                    g->ep, g->jc + jr
+                );
+            }
+        }
+    }
+}
+
+static int gemm_strided(
+    int m, int n, int k,
+    real alpha,
+    const real* A, int rsa, int csa,
+    const real* B, int rsb, int csb,
+    real beta,
+    real* C, int ldc,
+    const GemmEpilogue* ep
+) {
+    scale_c(m, n, beta, C, ldc);
+    if (m == 0 || n == 0 || k == 0 || alpha == 0.0) {
+        if (ep != NULL) {
+            epilogue_tile(C, ldc, m, n, ep->col_bias, ep->relu);
+        }
+        return 0;
+    }
+
+    real* pb = thread_pack_b(KC * (min_int(n, NC) + NR));
+    if (pb == NULL) {
+        return -1;
+    }
+
+    // Every element of C is owned by exactly one task and accumulated in the
+    // same order whatever the split, so results do not depend on the number
+    // of threads. Small products stay on the calling thread.
+    const int threads = ((double)m * n * k >= PARALLEL_MIN_FLOPS) ? thread_pool_num_threads() : 1;
+    const int row_blocks = (m + MC - 1) / MC;
+
+    for (int jc = 0; jc < n; jc += NC) {
+        const int nc = min_int(NC, n - jc);
+        const int panels = (nc + NR - 1) / NR;
+
+        int col_chunks = (threads + row_blocks - 1) / row_blocks;
+        col_chunks = min_int(col_chunks, panels);
+
+        for (int pc = 0; pc < k; pc += KC) {
+            const int kc = min_int(KC, k - pc);
+            pack_b(kc, nc, B + (size_t)pc * rsb + (size_t)jc * csb, rsb, csb, pb);
+
+            GemmPanel g = {
+                .m = m, .kc = kc, .nc = nc,
+                .alpha = alpha,
+                .A = A + (size_t)pc * csa, .rsa = rsa, .csa = csa,
+                .pb = pb,
+                .C = C + jc, .ldc = ldc,
+                .col_chunks = col_chunks,
+                .chunk_nr = (panels + col_chunks - 1) / col_chunks,
+                .ep = (pc + KC >= k) ? ep : NULL,
+                .jc = jc,
+                .failed = 0,
+            };
+
+            if (threads == 1) {
+                gemm_panel_tasks(&g, 0, row_blocks * col_chunks);
+            } else {
+                parallel_for(row_blocks * col_chunks, gemm_panel_tasks, &g);
+            }
+            if (g.failed) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int gemm(
+    bool trans_a, bool trans_b,
+    int m, int n, int k,
+    real alpha,
+    const real* A, int lda,
+    const real* B, int ldb,
+    real beta,
+    real* C, int ldc
+) {
+    return gemm_fused(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, NULL);
+}
+
+int gemm_fused(
+    bool trans_a, bool trans_b,
+    int m, int n, int k,
+    real alpha,
+    const real* A, int lda,
+    const real* B, int ldb,
+    real beta,
+    real* C, int ldc,
+    const GemmEpilogue* ep
+) {
+    // a transposed operand is the same buffer read with its strides swapped
+    const int rsa = trans_a ? 1 : lda;
+    const int csa = trans_a ? lda : 1;
+    const int rsb = trans_b ? 1 : ldb;
+    const int csb = trans_b ? ldb : 1;
+
+    return gemm_strided(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, ldc, ep);
+}
@@ -0,0 +1,55 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stdbool.h>
+
+#include "matrix.h"
+
+//
+// General matrix multiply on row-major buffers of `real`, in the style of
+// BLAS dgemm/sgemm.
+//
+//   C = alpha * op(A) * op(B) + beta * C
+//
+// op(X) is X, or X transposed when trans_x is set. op(A) is (m, k), op(B) is
+// (k, n) and C is (m, n). lda, ldb and ldc are the row strides of A, B and C
+// as they are stored, so a transposed A is stored as (k, m) with row stride lda.
+//
+// Returns 0, or -1 when a pack buffer could not be allocated, in which case
+// C is left partly computed.
+//
+
+int gemm(
+    bool trans_a, bool trans_b,
+    int m, int n, int k,
+    real alpha,
+    const real* A, int lda,
+    const real* B, int ldb,
+    real beta,
+    real* C, int ldc
+);
+
+//
+// Work applied to each tile of C right after its last update, while the
+// tile is still in registers, instead of in another pass over C.
+//
+
+typedef struct GemmEpilogue GemmEpilogue;
+struct GemmEpilogue {
+    const real* col_bias;   // NULL, or n values: col_bias[j] is added to column j
+    bool relu;              // negative results become 0
+};
+
+// gemm followed by ep (which may be NULL)
+int gemm_fused(
+    bool trans_a, bool trans_b,
+    int m, int n, int k,
+    real alpha,
+    const real* A, int lda,
+    const real* B, int ldb,
+    real beta,
+    real* C, int ldc,
+    const GemmEpilogue* ep
+);
+
+#endif
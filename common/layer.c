@@ -1,10 +1,37 @@
 #include "layer.h"
 #include "function.h"
-
+#include "buffer_pool.h"
+#include "gemm.h"
+#include "conv_direct.h"
+#include "conv_winograd.h"
+#include "pool_max.h"
+#include "simd.h"
+#include "vmath.h"
+
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
+//
+// Gradient tracking
+//
+
+// per thread, like the arena: a worker evaluating a model must not turn it
+// off for a thread that is training one
+static __thread bool grad_disabled = false;
+
+bool layer_set_grad_enabled(bool enabled) {
+    const bool prev = !grad_disabled;
+    grad_disabled = !enabled;
+
+    return prev;
+}
+
+bool layer_grad_enabled() {
+    return !grad_disabled;
+}
+
 //
 // Affine
 //
@@ -30,104 +57,71 @@ void free_affine(Affine* A) {
 }
 
 Matrix* affine_forward(Affine* A, const Matrix* X) { 
-    if (A->X != NULL) {
-        free_matrix(A->X);
+    if (grad_disabled) {
+        Matrix* B = dot_matrix(X, A->W);
+        matrix_add_vector_into(B, B, A->b);
+        return B;
     }
-    A->X = create_matrix(X->rows, X->cols);
+
+    A->X = reuse_matrix(A->X, X->rows, X->cols);
     copy_matrix(A->X, X);
 
     Matrix* B = dot_matrix(X, A->W);
-    for (int i = 0; i < B->rows; ++i) {
-        for (int j = 0; j < B->cols; ++j) {
-            B->elements[i][j] += A->b->elements[j];
-        }
-    }
+    matrix_add_vector_into(B, B, A->b);
+
     return B;
 }
 
 Matrix* affine_4d_forward(Affine* A, const Matrix4d* X) { 
-   for (int i = 0; i < 4; ++i) {
-        A->original_x_shape[i] = X->sizes[i];
+    if (grad_disabled) {
+        // a view of X, as nothing has to survive the call
+        Matrix* X2d = matrix_reshape_to_2d(X, X->sizes[0], -1);
+        Matrix* B = dot_matrix(X2d, A->W);
+        matrix_add_vector_into(B, B, A->b);
+        free_matrix(X2d);
+        return B;
     }
 
-    Matrix* R = matrix_reshape_to_2d(X, X->sizes[0], -1);  
-
-    if (A->X != NULL) {
-        free_matrix(A->X);
+   for (int i = 0; i < 4; ++i) {
+        A->original_x_shape[i] = X->sizes[i];
     }
-    A->X = create_matrix(R->rows, R->cols);
-    copy_matrix(A->X, R);
 
-    Matrix* B = dot_matrix(R, A->W);
-    for (int i = 0; i < B->rows; ++i) {
-        for (int j = 0; j < B->cols; ++j) {
-            B->elements[i][j] += A->b->elements[j];
-        }
-    }
+    A->X = reuse_matrix(A->X, X->sizes[0], matrix_4d_size(X) / X->sizes[0]);
+    matrix_reshape_to_2d_into(A->X, X);
 
-    free_matrix(R);
+    Matrix* B = dot_matrix(A->X, A->W);
+    matrix_add_vector_into(B, B, A->b);
 
     return B;
 }
 
 Matrix* affine_backward(Affine* A, const Matrix* D) { 
-    Matrix* W_T = transpose(A->W);
-    Matrix* X_T = transpose(A->X);
-
-    Matrix* dX = dot_matrix(D, W_T);
-    if (A->dW != NULL) {
-        free_matrix(A->dW);
-    }
-    A->dW = dot_matrix(X_T, D);
+    // dX = D * W^T, dW = X^T * D
+    Matrix* dX = dot_matrix_trans(D, false, A->W, true);
 
-    if (A->db != NULL) {
-        free_vector(A->db);
-    }
-    A->db = create_vector(D->cols);
+    A->dW = reuse_matrix(A->dW, A->W->rows, A->W->cols);
+    dot_matrix_trans_into(A->dW, A->X, true, D, false);
 
-    for (int i = 0; i < D->cols; ++i) {
-        double sum = 0;
-        for (int j = 0; j < D->rows; ++j) {
-            sum += D->elements[j][i];
-        }
-        A->db->elements[i] = sum;
-    }
+    A->db = reuse_vector(A->db, D->cols);
+    matrix_col_sum_into(A->db, D);
 
-    free_matrix(W_T);
-    free_matrix(X_T);
     return dX;
 }
 
 Matrix4d* affine_4d_backward(Affine* A, const Matrix* D) { 
-    Matrix* W_T = transpose(A->W);
-    Matrix* X_T = transpose(A->X);
+    // dX = D * W^T, dW = X^T * D
+    Matrix* dX = dot_matrix_trans(D, false, A->W, true);
 
-    Matrix* dX = dot_matrix(D, W_T);
-    if (A->dW != NULL) {
-        free_matrix(A->dW);
-    }
-
-    A->dW = dot_matrix(X_T, D);
+    A->dW = reuse_matrix(A->dW, A->W->rows, A->W->cols);
+    dot_matrix_trans_into(A->dW, A->X, true, D, false);
 
-    if (A->db != NULL) {
-        free_vector(A->db);
-    }
-    A->db = create_vector(D->cols);
-
-    for (int i = 0; i < D->cols; ++i) {
-        double sum = 0;
-        for (int j = 0; j < D->rows; ++j) {
-            sum += D->elements[j][i];
-        }
-        A->db->elements[i] = sum;
-    }
+    A->db = reuse_vector(A->db, D->cols);
+    matrix_col_sum_into(A->db, D);
 
     // reshape
     Matrix4d* dXR = matrix_reshape_to_4d(dX, A->original_x_shape[0], A->original_x_shape[1], A->original_x_shape[2], A->original_x_shape[3]); 
 
     free_matrix(dX);
-    free_matrix(W_T);
-    free_matrix(X_T);
     return dXR;
 }
 
@@ -135,24 +129,27 @@ Matrix4d* affine_4d_backward(Affine* A, const Matrix* D) {
 // Relu
 //
 
-static Mask* create_mask(int rows, int cols) {
-    Mask* m     = malloc(sizeof(Mask));
-    m->rows     = rows;
-    m->cols     = cols;
-    m->elements = calloc(rows, sizeof(bool*));
-    for (int i = 0; i < rows; ++i) {
-        m->elements[i] = calloc(cols, sizeof(bool));
-    }
+// the Mask and its words are one pooled block
+static Mask* create_mask(int size) {
+    Mask* m = buffer_pool_alloc(sizeof(Mask) + sizeof(uint64_t) * SIMD_MASK_WORDS(size), sizeof(uint64_t));
+    m->size = size;
+    m->bits = (uint64_t*)(m + 1);
 
     return m;
 }
 
 static void free_mask(Mask* m) {
-    for (int i = 0; i < m->rows; ++i) {
-        free(m->elements[i]);
+    buffer_pool_free(m);
+}
+
+// masks are overwritten by every forward, so one of the same size is kept
+static Mask* reuse_mask(Mask* m, int size) {
+    if (m != NULL && m->size == size) {
+        return m;
     }
-    free(m->elements);
-    free(m);
+    free_mask(m);
+
+    return create_mask(size);
 }
 
 Relu* create_relu() {
@@ -167,37 +164,28 @@ void free_relu(Relu* R) {
 }
 
 Matrix* relu_forward(Relu* R, const Matrix* X) {
-    if (R->mask != NULL) {
-        free_mask(R->mask);
-    }
-    R->mask = create_mask(X->rows, X->cols);
     Matrix* M = create_matrix(X->rows, X->cols);
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            if (X->elements[i][j] <= 0) {
-                R->mask->elements[i][j] = true;
-                M->elements[i][j] = 0;
-            } else {
-                R->mask->elements[i][j] = false;
-                M->elements[i][j] = X->elements[i][j];
+    if (grad_disabled) {
+        for (int i = 0; i < M->rows; ++i) {
+            const real* x = X->elements[i];
+            real* m = M->elements[i];
+            for (int j = 0; j < M->cols; ++j) {
+                m[j] = (x[j] <= 0) ? 0 : x[j];
             }
         }
+        return M;
     }
 
+    const int n = X->rows * X->cols;
+    R->mask = reuse_mask(R->mask, n);
+    simd_kernels()->relu_mask(M->data, R->mask->bits, X->data, n);
+
     return M;
 }
 
 Matrix* relu_backward(Relu* R, const Matrix* D) {
     Matrix* M = create_matrix(D->rows, D->cols);
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            if (R->mask->elements[i][j]) {
-                M->elements[i][j] = 0;
-            } else {
-                M->elements[i][j] = D->elements[i][j];
-            }
-        }
-    }
+    simd_kernels()->select_mask(M->data, D->data, R->mask->bits, D->rows * D->cols);
 
     return M;
 }
@@ -206,40 +194,6 @@ Matrix* relu_backward(Relu* R, const Matrix* D) {
 // Relu4d
 //
 
-static Mask4d* create_mask_4d(const int* sizes) {
-    Mask4d* m   = malloc(sizeof(Mask4d));
-    m->sizes[0] = sizes[0];
-    m->sizes[1] = sizes[1];
-    m->sizes[2] = sizes[2];
-    m->sizes[3] = sizes[3];
-    m->elements = calloc(sizes[0], sizeof(bool***));
-    for (int i = 0; i < sizes[0]; ++i) {
-        m->elements[i] = calloc(sizes[1], sizeof(bool**));
-        for (int j = 0; j < sizes[1]; ++j) {
-            m->elements[i][j] = calloc(sizes[2], sizeof(bool*));
-            for (int k = 0; k < sizes[2]; ++k) {
-                m->elements[i][j][k] = calloc(sizes[3], sizeof(bool));
-            }
-        }
-    }
-
-    return m;
-}
-
-static void free_mask_4d(Mask4d* m) {
-    for (int i = 0; i < m->sizes[0]; ++i) {
-        for (int j = 0; j < m->sizes[1]; ++j) {
-            for (int k = 0; k < m->sizes[2]; ++k) {
-                free(m->elements[i][j][k]);
-            }
-            free(m->elements[i][j]);
-        }
-        free(m->elements[i]);
-    }
-    free(m->elements);
-    free(m);
-}
-
 Relu4d* create_relu_4d() {
     Relu4d* r = malloc(sizeof(Relu4d));
     r->mask = NULL;
@@ -247,50 +201,36 @@ Relu4d* create_relu_4d() {
 }
 
 void free_relu_4d(Relu4d* R) {
-    free_mask_4d(R->mask);
+    free_mask(R->mask);
     free(R);
 }
 
 Matrix4d* relu_4d_forward(Relu4d* R, const Matrix4d* X) {
-    if (R->mask != NULL) {
-        free_mask_4d(R->mask);
-    }
-    R->mask = create_mask_4d(X->sizes);
     Matrix4d* M = create_matrix_4d(X->sizes[0], X->sizes[1], X->sizes[2], X->sizes[3]);
-    for (int i = 0; i < M->sizes[0]; ++i) {
-        for (int j = 0; j < M->sizes[1]; ++j) {
-            for (int k = 0; k < M->sizes[2]; ++k) {
-                for (int l = 0; l < M->sizes[3]; ++l) {
-                    if (X->elements[i][j][k][l] <= 0) {
-                        R->mask->elements[i][j][k][l] = true;
-                        M->elements[i][j][k][l] = 0;
-                    } else {
-                        R->mask->elements[i][j][k][l] = false;
-                        M->elements[i][j][k][l] = X->elements[i][j][k][l];
-                    }
-                }
-            }
+    Matrix4d* x = matrix_4d_contiguous(X);
+    const int n = matrix_4d_size(M);
+    if (grad_disabled) {
+        for (int i = 0; i < n; ++i) {
+            M->data[i] = (x->data[i] <= 0) ? 0 : x->data[i];
         }
+        free_matrix_4d(x);
+        return M;
     }
 
+    R->mask = reuse_mask(R->mask, n);
+    simd_kernels()->relu_mask(M->data, R->mask->bits, x->data, n);
+
+    free_matrix_4d(x);
+
     return M;
 }
 
 Matrix4d* relu_4d_backward(Relu4d* R, const Matrix4d* D) {
     Matrix4d* M = create_matrix_4d(D->sizes[0], D->sizes[1], D->sizes[2], D->sizes[3]);
-    for (int i = 0; i < M->sizes[0]; ++i) {
-        for (int j = 0; j < M->sizes[1]; ++j) {
-            for (int k = 0; k < M->sizes[2]; ++k) {
-                for (int l = 0; l < M->sizes[3]; ++l) {
-                    if (R->mask->elements[i][j][k][l]) {
-                        M->elements[i][j][k][l] = 0;
-                    } else {
-                        M->elements[i][j][k][l] = D->elements[i][j][k][l];
-                    }
-                }
-            }
-        }
-    }
+    Matrix4d* d = matrix_4d_contiguous(D);
+    simd_kernels()->select_mask(M->data, d->data, R->mask->bits, matrix_4d_size(M));
+
+    free_matrix_4d(d);
 
     return M;
 }
@@ -305,57 +245,80 @@ SoftmaxWithLoss* create_softmax_with_loss() {
 }
 
 void free_softmax_with_loss(SoftmaxWithLoss* S) {
-    free_matrix(S->Y);
-    free_vector(S->t);
+    free_matrix(S->dX);
     free(S);
 }
 
-static double cross_entropy_error(const Matrix* Y, const Vector* t) {
-    static const double delta = 1e-7;
-   
-    double sum = 0.0;
-    for (int i = 0; i < Y->rows; ++i) {
-        for (int j = 0; j < Y->cols; ++j) {
-            if (j != t->elements[i]) {
-                continue;
-            }
+//
+// -log softmax(x)[t] of one row through the log-sum-exp,
+//
+//   log(sum_j exp(x_j - max)) + max - x_t
+//
+// which stays finite however far apart the scores are. exp(x_j - max) goes
+// to e; with grad set e is the row of the gradient and is turned into
+// (softmax(x) - onehot(t)) / n in the same pass. A label outside the row
+// adds nothing, as before.
+//
+static double softmax_cross_entropy_row(const real* x, int cols, int t, real* e, bool grad, int n) {
+    real max = x[0];
+    for (int j = 1; j < cols; ++j) {
+        max = (x[j] > max) ? x[j] : max;
+    }
 
-            double d = Y->elements[i][j] + delta;
-            sum += log(d);
-        }
+    for (int j = 0; j < cols; ++j) {
+        e[j] = x[j] - max;
+    }
+    vmath_kernels()->exp(e, e, cols);
+
+    double sum = 0;
+    for (int j = 0; j < cols; ++j) {
+        sum += e[j];
+    }
+    if (grad) {
+        simd_kernels()->scale(e, e, 1.0 / (sum * n), cols);
+    }
+
+    if (t < 0 || t >= cols) {
+        return 0;
+    }
+    if (grad) {
+        e[t] -= 1.0 / n;
     }
 
-    return -1.0 * sum / Y->rows;
+    return log(sum) + max - x[t];
 }
 
 double softmax_with_loss_forward(SoftmaxWithLoss* sft, const Matrix* X, const Vector* t) {
-    if (sft->t != NULL) {
-        free_vector(sft->t);
+    const bool grad = !grad_disabled;
+    real* e = NULL;
+    if (grad) {
+        sft->dX = reuse_matrix(sft->dX, X->rows, X->cols);
+        e = sft->dX->data;
+    } else {
+        e = buffer_pool_alloc(sizeof(real) * X->cols, MATRIX_ALIGNMENT);
     }
-    sft->t = create_vector(t->size);
-    copy_vector(sft->t, t);
 
-    if (sft->Y != NULL) {
-        free_matrix(sft->Y);
+    double sum = 0.0;
+    for (int i = 0; i < X->rows; ++i) {
+        real* ei = grad ? e + (size_t)i * X->cols : e;
+        sum += softmax_cross_entropy_row(X->elements[i], X->cols, (int)t->elements[i], ei, grad, t->size);
     }
-    sft->Y = matrix_softmax(X);
 
-    return cross_entropy_error(sft->Y, t);
+    if (!grad) {
+        buffer_pool_free(e);
+    }
+
+    return sum / X->rows;
 }
 
+// the gradient was written by forward; a view of it, so nothing is copied
 Matrix* softmax_with_loss_backward(const SoftmaxWithLoss* sft) {
-    Matrix* dX = create_matrix(sft->Y->rows, sft->Y->cols);
-    for (int i = 0; i < dX->rows; ++i) {
-        for (int j = 0; j < dX->cols; ++j) {
-            dX->elements[i][j] = sft->Y->elements[i][j];
-            if (j == sft->t->elements[i]) {
-                dX->elements[i][j] -= 1.0;
-            }
-            dX->elements[i][j] /= sft->t->size;
-        }
+    if (sft->dX == NULL) {
+        fprintf(stderr, "Invalid state. softmax_with_loss_backward before a forward with gradients.\n");
+        return NULL;
     }
 
-    return dX;
+    return matrix_reshape(sft->dX, sft->dX->rows, sft->dX->cols);
 }
 
 BatchNormalization* create_batch_normalization(Vector* g, Vector* b, double momentum) {
@@ -365,11 +328,10 @@ BatchNormalization* create_batch_normalization(Vector* g, Vector* b, double mome
 
     B->dg  = NULL;
     B->db  = NULL;
-    B->xc  = NULL;
     B->xn  = NULL;
     B->std = NULL;
-    B->running_mean = NULL;
-    B->running_var  = NULL;
+    B->running_mean = create_vector(g->size);
+    B->running_var  = create_vector(g->size);
     B->momentum = momentum;
 
     return B;
@@ -381,7 +343,6 @@ void free_batch_normalization(BatchNormalization* B) {
     free_vector(B->dg);
     free_vector(B->db);
 
-    free_matrix(B->xc);
     free_matrix(B->xn);
     free_vector(B->std);
     free_vector(B->running_mean);
@@ -390,126 +351,172 @@ void free_batch_normalization(BatchNormalization* B) {
     free(B);
 }
 
-Matrix* batch_normalization_forward(BatchNormalization* B, const Matrix* X) {
-    if (B->xc != NULL) {
-        free_matrix(B->xc);
-        free_matrix(B->xn);
-        free_vector(B->std);
+//
+// BatchNormalization runs its arithmetic a row at a time through the simd
+// kernels; a row of scratch stays in L1, so each sweep reads the batch once
+// instead of writing a matrix for every step of the formula.
+//
+
+#define BATCH_NORM_EPS 10e-7
+
+// inference with the running statistics is y = x * k + c per column
+static void batch_normalization_eval_coeffs(const BatchNormalization* B, real* k, real* c) {
+    for (int j = 0; j < B->g->size; ++j) {
+        k[j] = B->g->elements[j] / sqrt(B->running_var->elements[j] + BATCH_NORM_EPS);
+        c[j] = B->b->elements[j] - B->running_mean->elements[j] * k[j];
+    }
+}
+
+static Matrix* batch_normalization_forward_eval(const BatchNormalization* B, const Matrix* X) {
+    const SimdKernels* K = simd_kernels();
+    const int D = X->cols;
+
+    real* k = buffer_pool_alloc(sizeof(real) * D * 2, MATRIX_ALIGNMENT);
+    real* c = k + D;
+    batch_normalization_eval_coeffs(B, k, c);
+
+    Matrix* out = create_matrix(X->rows, D);
+    for (int i = 0; i < X->rows; ++i) {
+        K->mul(out->elements[i], X->elements[i], k, D);
+        K->add(out->elements[i], out->elements[i], c, D);
     }
 
-    if (B->running_mean == NULL) {
-        B->running_mean = create_vector(B->g->size);
-        B->running_var  = create_vector(B->g->size);
+    buffer_pool_free(k);
+
+    return out;
+}
+
+// three sweeps over X: the mean, the variance around it (two passes keep
+// their precision when the mean is large next to the spread), then xn and
+// the output together
+Matrix* batch_normalization_forward(BatchNormalization* B, const Matrix* X, bool train_flg) {
+    if (!train_flg) {
+        return batch_normalization_forward_eval(B, X);
     }
-    B->batch_size = X->rows;
 
-    // mu
-    Vector* mu = matrix_col_mean(X);
+    const SimdKernels* K = simd_kernels();
+    const int N = X->rows;
+    const int D = X->cols;
+    B->batch_size = N;
 
-    // xc
-    B->xc = matrix_sub_vector(X, mu); 
+    B->xn  = reuse_matrix(B->xn, N, D);
+    B->std = reuse_vector(B->std, D);
 
-    // var 
-    Matrix* xc_tmp = pow_matrix(B->xc, 2);
-    Vector* var = matrix_col_mean(xc_tmp);
+    // mu, 1 / std once the variance is known, and a row of scratch
+    real* mu  = buffer_pool_alloc(sizeof(real) * D * 3, MATRIX_ALIGNMENT);
+    real* inv = mu + D;
+    real* tmp = inv + D;
+    real* var = B->std->elements;
 
-    // std 
-    Vector* var_tmp = vector_add_scalar(var, 10e-7);
-    B->std = sqrt_vector(var_tmp);
+    memset(mu, 0, sizeof(real) * D);
+    for (int i = 0; i < N; ++i) {
+        K->add(mu, mu, X->elements[i], D);
+    }
+    K->scale(mu, mu, 1.0 / N, D);
 
-    // xn 
-    B->xn = matrix_div_vector(B->xc, B->std);
+    memset(var, 0, sizeof(real) * D);
+    for (int i = 0; i < N; ++i) {
+        K->sub(tmp, X->elements[i], mu, D);
+        K->mul(tmp, tmp, tmp, D);
+        K->add(var, var, tmp, D);
+    }
+    K->scale(var, var, 1.0 / N, D);
 
-    Vector* prev_running_mean = B->running_mean;
-    Vector* prev_running_var = B->running_var;
- 
-    // running_mean
-    scalar_vector(prev_running_mean, B->momentum);
-    scalar_vector(mu, 1.0 - B->momentum);
-    B->running_mean = add_vector(prev_running_mean, mu);
+    for (int j = 0; j < D; ++j) {
+        B->running_mean->elements[j] = B->momentum * B->running_mean->elements[j] + (1.0 - B->momentum) * mu[j];
+        B->running_var->elements[j]  = B->momentum * B->running_var->elements[j] + (1.0 - B->momentum) * var[j];
+        B->std->elements[j] = sqrt(var[j] + BATCH_NORM_EPS);
+        inv[j] = 1.0 / B->std->elements[j];
+    }
 
-    // running_var
-    scalar_vector(prev_running_var, B->momentum);
-    scalar_vector(var, 1.0 - B->momentum);
-    B->running_var = add_vector(prev_running_var, var);
-   
-    // out
-    Matrix* l = product_vector_matrix(B->g, B->xn);
-    Matrix* out = matrix_add_vector(l, B->b);
+    Matrix* out = create_matrix(N, D);
+    for (int i = 0; i < N; ++i) {
+        real* xn = B->xn->elements[i];
+        real* y  = out->elements[i];
+        K->sub(xn, X->elements[i], mu, D);
+        K->mul(xn, xn, inv, D);
+        K->mul(y, xn, B->g->elements, D);
+        K->add(y, y, B->b->elements, D);
+    }
 
-    free_vector(mu);
-    free_vector(var);
-    free_vector(var_tmp);
-    free_vector(prev_running_mean);
-    free_vector(prev_running_var);
-    free_matrix(xc_tmp);
-    free_matrix(l);
+    buffer_pool_free(mu);
 
     return out;
 }
 
+//
+// With xn = (x - mu) / std and dxn = g * dout the chain through std and mu
+// collapses to
+//
+//   dx = g / (N * std) * (N * dout - dbeta - xn * dgamma)
+//
+// so one sweep gathers dbeta and dgamma and a second writes dx.
+//
 Matrix* batch_normalization_backward(BatchNormalization* B, const Matrix* D) {
-    // dbeta
-    Vector* dbeta = matrix_col_sum(D);
+    const SimdKernels* K = simd_kernels();
+    const int N = D->rows;
+    const int C = D->cols;
 
-    // dgamma  
-    Matrix* tmp = product_matrix(B->xn, D);
-    Vector* dgamma = matrix_col_sum(tmp);
+    B->db = reuse_vector(B->db, C);
+    B->dg = reuse_vector(B->dg, C);
+    real* db = B->db->elements;
+    real* dg = B->dg->elements;
 
-    // dxn
-    Matrix* dxn = product_vector_matrix(B->g, D);
+    // g / (N * std) and a row of scratch
+    real* k   = buffer_pool_alloc(sizeof(real) * C * 2, MATRIX_ALIGNMENT);
+    real* tmp = k + C;
 
-    // dxc
-    Matrix* dxc = matrix_div_vector(dxn, B->std);
-    
-    // dstd 
-    Matrix* tmp2 = product_matrix(dxn, B->xc);
-    Vector* tmp3 = product_vector(B->std, B->std);
-    Matrix* tmp4 = matrix_div_vector(tmp2, tmp3);
-    Vector* dstd = matrix_col_sum(tmp4);
-    scalar_vector(dstd, -1);
-
-    // dvar
-    Vector* tmp5 = create_vector(dstd->size);
-    copy_vector(tmp5, dstd);
-    scalar_vector(tmp5, 0.5);
-    Vector* dvar = vector_div_vector(tmp5, B->std);
-    
-    // dxc
-    Matrix* tmp6 = create_matrix(B->xc->rows, B->xc->cols);
-    copy_matrix(tmp6, B->xc);
-    scalar_matrix(tmp6, 2.0 / B->batch_size);
-    Matrix* tmp7 = product_vector_matrix(dvar, tmp6);
-    Matrix* _dxc = matrix_add_matrix(dxc, tmp7);
-
-    // dmu
-    Vector* dmu = matrix_col_sum(_dxc); 
-
-    // dx
-    scalar_vector(dmu, 1.0 / B->batch_size);
-    Matrix* dx = matrix_sub_vector(_dxc, dmu);
-
-    B->dg = dgamma;
-    B->db = dbeta;
-
-    free_vector(tmp3);
-    free_vector(dstd);
-    free_vector(tmp5);
-    free_vector(dvar);
-    free_vector(dmu); 
-
-    free_matrix(tmp);
-    free_matrix(dxn);
-    free_matrix(dxc);
-    free_matrix(tmp2);
-    free_matrix(tmp4);
-    free_matrix(tmp6);
-    free_matrix(tmp7);
-    free_matrix(_dxc);
+    memset(db, 0, sizeof(real) * C);
+    memset(dg, 0, sizeof(real) * C);
+    for (int i = 0; i < N; ++i) {
+        K->add(db, db, D->elements[i], C);
+        K->mul(tmp, D->elements[i], B->xn->elements[i], C);
+        K->add(dg, dg, tmp, C);
+    }
+
+    for (int j = 0; j < C; ++j) {
+        k[j] = B->g->elements[j] / (N * B->std->elements[j]);
+    }
+
+    Matrix* dx = create_matrix(N, C);
+    for (int i = 0; i < N; ++i) {
+        real* r = dx->elements[i];
+        K->scale(r, D->elements[i], N, C);
+        K->sub(r, r, db, C);
+        K->mul(tmp, B->xn->elements[i], dg, C);
+        K->sub(r, r, tmp, C);
+        K->mul(r, r, k, C);
+    }
+
+    buffer_pool_free(k);
 
     return dx;
 }
 
+int batch_normalization_fold_into(const BatchNormalization* B, Matrix* W, Vector* b) {
+    const int D = B->g->size;
+    if (W->cols != D || b->size != D) {
+        fprintf(stderr, "Invalid size. W=(%d, %d), b=%d, g=%d\n", W->rows, W->cols, b->size, D);
+        return -1;
+    }
+
+    const SimdKernels* K = simd_kernels();
+    real* k = buffer_pool_alloc(sizeof(real) * D * 2, MATRIX_ALIGNMENT);
+    real* c = k + D;
+    batch_normalization_eval_coeffs(B, k, c);
+
+    // (x W + b) * k + c = x (W * k) + (b * k + c)
+    for (int i = 0; i < W->rows; ++i) {
+        K->mul(W->elements[i], W->elements[i], k, D);
+    }
+    K->mul(b->elements, b->elements, k, D);
+    K->add(b->elements, b->elements, c, D);
+
+    buffer_pool_free(k);
+
+    return 0;
+}
+
 Dropout* create_dropout(double dropout_ratio) {
     Dropout* d = malloc(sizeof(Dropout));
     d->dropout_ratio = dropout_ratio;
@@ -524,28 +531,26 @@ void free_dropout(Dropout* D) {
 
 Matrix* dropout_forward(Dropout* D, const Matrix* X, bool train_flag) {
     if (train_flag) {
-        if (D->mask != NULL) {
-            free_mask(D->mask);
-        }
-
-        Matrix* RND = create_matrix(X->rows, X->cols);
-        init_matrix_rand(RND);
         Matrix* M = create_matrix(X->rows, X->cols);
-        D->mask = create_mask(X->rows, X->cols);
+        const int n = X->rows * X->cols;
 
-        for (int i = 0; i < M->rows; ++i) {
-            for (int j = 0; j < M->cols; ++j) {
-                if (RND->elements[i][j] > D->dropout_ratio) {
-                    D->mask->elements[i][j] = true;
-                    M->elements[i][j] = X->elements[i][j];
-                } else {
-                    D->mask->elements[i][j] = false;
-                    M->elements[i][j] = 0;
-                }
+        // same draws, in the same order, as init_matrix_rand
+        if (grad_disabled) {
+            for (int i = 0; i < n; ++i) {
+                const real rnd = (double)rand() / (double)RAND_MAX;
+                M->data[i] = (rnd > D->dropout_ratio) ? X->data[i] : 0;
             }
+            return M;
         }
 
-        free_matrix(RND);
+        D->mask = reuse_mask(D->mask, n);
+        uint64_t* bits = D->mask->bits;
+        memset(bits, 0, sizeof(uint64_t) * SIMD_MASK_WORDS(n));
+        for (int i = 0; i < n; ++i) {
+            const real rnd = (double)rand() / (double)RAND_MAX;
+            bits[i >> 6] |= (uint64_t)(rnd > D->dropout_ratio) << (i & 63);
+        }
+        simd_kernels()->select_mask(M->data, X->data, bits, n);
 
         return M;
     } else {
@@ -556,15 +561,7 @@ Matrix* dropout_forward(Dropout* D, const Matrix* X, bool train_flag) {
 
 Matrix* dropout_backward(const Dropout* D, const Matrix* X) {
     Matrix* M = create_matrix(X->rows, X->cols);
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            if (D->mask->elements[i][j]) {
-                M->elements[i][j] = X->elements[i][j];
-            } else {
-                M->elements[i][j] = 0;
-            }
-        }
-    }
+    simd_kernels()->select_mask(M->data, X->data, D->mask->bits, X->rows * X->cols);
 
     return M;
 }
@@ -575,10 +572,13 @@ Convolution* create_convolution(Matrix4d* W, Vector* b, int stride, int pad) {
     Conv->b = b;
     Conv->stride = stride;
     Conv->pad = pad;
+    Conv->algo = CONV_ALGO_AUTO;
+    Conv->used = CONV_ALGO_IM2COL;
 
+    memset(Conv->x_shape, 0, sizeof(int) * 4);
     Conv->x = NULL;
     Conv->col = NULL;
-    Conv->col_W = NULL;
+    Conv->U = NULL;
     Conv->db = NULL;
     Conv->dW = NULL;
 
@@ -588,181 +588,325 @@ Convolution* create_convolution(Matrix4d* W, Vector* b, int stride, int pad) {
 void free_convolution(Convolution* C) {
     free_matrix_4d(C->W);
     free_vector(C->b);
-    // free_matrix_4d(C->x);
+    free_matrix_4d(C->x);
     free_matrix(C->col);
-    free_matrix(C->col_W);
+    free_matrix(C->U);
+    free_vector(C->db);
+    free_matrix_4d(C->dW);
+    free(C);
+}
+
+//
+// The direct kernels vectorise along output rows, so they win when the rows
+// are long or when each output needs only a short dot product (few input
+// channels) or there are too few filters to fill a GEMM tile. GEMM based
+// forms win on small images with many channels: Winograd for 3x3 stride 1
+// filters, im2col for the rest. Beyond that, a col matrix larger than
+// CONV_IM2COL_MAX_BYTES (FH * FW times the input) is never built.
+// bench/bench_conv measures both per DeepConvNet layer.
+//
+#define CONV_DIRECT_MAX_PATCH   32
+#define CONV_DIRECT_MIN_FILTERS 8
+#define CONV_DIRECT_MIN_ROW     24
+#define CONV_IM2COL_MAX_BYTES   ((size_t)256 << 20)
+
+ConvAlgo convolution_select_algo(const Convolution* Conv, const Matrix4d* X) {
+    if (Conv->algo == CONV_ALGO_WINOGRAD && !conv_winograd_supported(Conv->W, Conv->stride)) {
+        return CONV_ALGO_DIRECT;
+    }
+    if (Conv->algo != CONV_ALGO_AUTO) {
+        return Conv->algo;
+    }
+
+    const int FN = Conv->W->sizes[0];
+    const int FH = Conv->W->sizes[2];
+    const int FW = Conv->W->sizes[3];
+    const int patch = X->sizes[1] * FH * FW;
+    const int out_h = 1 + (X->sizes[2] + 2 * Conv->pad - FH) / Conv->stride;
+    const int out_w = 1 + (X->sizes[3] + 2 * Conv->pad - FW) / Conv->stride;
+    if (patch <= CONV_DIRECT_MAX_PATCH || FN < CONV_DIRECT_MIN_FILTERS || out_w >= CONV_DIRECT_MIN_ROW) {
+        return CONV_ALGO_DIRECT;
+    }
+
+    const size_t col_bytes = sizeof(real) * X->sizes[0] * out_h * out_w * patch;
+    if (col_bytes > CONV_IM2COL_MAX_BYTES) {
+        return CONV_ALGO_DIRECT;
+    }
+
+    return conv_winograd_supported(Conv->W, Conv->stride) ? CONV_ALGO_WINOGRAD : CONV_ALGO_IM2COL;
+}
+
+void convolution_invalidate_cache(Convolution* Conv) {
+    free_matrix(Conv->U);
+    Conv->U = NULL;
+}
+
+// CONV_ALGO_DIRECT and CONV_ALGO_WINOGRAD on a contiguous input. Without a
+// cached filter transform U the Winograd form builds a temporary one, so that
+// callers which must leave the layer untouched can still run it.
+// Returns -1 when the kernel failed, leaving out unwritten.
+static int convolution_run_direct(const Convolution* Conv, ConvAlgo algo, Matrix4d* out, const Matrix4d* x, bool relu) {
+    if (algo != CONV_ALGO_WINOGRAD) {
+        return conv_direct_forward(out, x, Conv->W, Conv->b, Conv->stride, Conv->pad, relu);
+    }
+
+    Matrix* U = Conv->U;
+    if (U == NULL) {
+        U = create_matrix(16 * Conv->W->sizes[0], Conv->W->sizes[1]);
+        conv_winograd_transform_filter_into(U, Conv->W);
+    }
+    const int ret = conv_winograd_forward(out, x, U, Conv->b, Conv->pad, relu);
+    if (U != Conv->U) {
+        free_matrix(U);
+    }
+
+    return ret;
+}
+
+// CONV_ALGO_IM2COL: col * W2d^T + b with W2d the (FN, C * FH * FW) matrix
+// that W's data already is, bias and ReLU done by the GEMM epilogue, then
+// back to NCHW. W is handed to the GEMM as it is rather than through a
+// view, so that nothing of the layer is touched.
+static Matrix4d* convolution_run_im2col(const Convolution* Conv, const Matrix* col, int N, int out_h, int out_w, bool relu) {
+    const int FN = Conv->W->sizes[0];
+    Matrix* out = create_matrix(col->rows, FN);
+
+    const GemmEpilogue ep = {Conv->b->elements, relu};
+    gemm_fused(false, true, col->rows, FN, col->cols, 1, col->data, col->cols, Conv->W->data, col->cols, 0, out->data, FN, &ep);
+
+    Matrix4d* out_r = matrix_reshape_to_4d(out, N, out_h, out_w, -1);
+    Matrix4d* out_rt = matrix_4d_transpose(out_r, 0, 3, 1, 2);
+
+    free_matrix(out);
+    free_matrix_4d(out_r);
+
+    return out_rt;
+}
+
+// forward that keeps nothing for a backward pass: neither the input nor the
+// layer is written, so several threads may run it on one layer at once
+static Matrix4d* convolution_forward_nograd(const Convolution* Conv, const Matrix4d* X, bool relu) {
+    const int FN = Conv->W->sizes[0];
+    const int FH = Conv->W->sizes[2];
+    const int FW = Conv->W->sizes[3];
+
+    const int N  = X->sizes[0];
+    const int H  = X->sizes[2];
+    const int W  = X->sizes[3];
+
+    const int out_h = 1 + (H + 2 * Conv->pad - FH) / Conv->stride;
+    const int out_w = 1 + (W + 2 * Conv->pad - FW) / Conv->stride;
+
+    const ConvAlgo algo = convolution_select_algo(Conv, X);
+    if (algo != CONV_ALGO_IM2COL) {
+        Matrix4d* x = matrix_4d_contiguous(X);
+        Matrix4d* out = create_matrix_4d(N, FN, out_h, out_w);
+        if (convolution_run_direct(Conv, algo, out, x, relu) != 0) {
+            free_matrix_4d(out);
+            out = NULL;
+        }
+
+        free_matrix_4d(x);
+
+        return out;
+    }
+
+    Matrix* col = create_matrix(N * out_h * out_w, X->sizes[1] * FH * FW);
+    im2col_into(col, X, FH, FW, Conv->stride, Conv->pad);
+    Matrix4d* out = convolution_run_im2col(Conv, col, N, out_h, out_w, relu);
+
+    free_matrix(col);
+
+    return out;
 }
 
 Matrix4d* convolution_forward(Convolution* Conv, Matrix4d* X) {
     const int FN = Conv->W->sizes[0];
-    // const int C  = Conv->W->sizes[1];
     const int FH = Conv->W->sizes[2];
     const int FW = Conv->W->sizes[3];
     
     const int N  = X->sizes[0];
-    // const int C2 = X->sizes[1];
     const int H  = X->sizes[2];
     const int W  = X->sizes[3];
 
     const int out_h = 1 + (int)((H + 2 * Conv->pad - FH) / Conv->stride);
     const int out_w = 1 + (int)((W + 2 * Conv->pad - FW) / Conv->stride);
 
-    Matrix* col = im2col(X, FH, FW, Conv->stride, Conv->pad);
-    Matrix* tmp2 = matrix_reshape_to_2d(Conv->W, FN, -1);
-    Matrix* col_W = transpose(tmp2);
+    if (grad_disabled) {
+        return convolution_forward_nograd(Conv, X, false);
+    }
 
-    Matrix* tmp = dot_matrix(col, col_W);
+    memcpy(Conv->x_shape, X->sizes, sizeof(int) * 4);
+    Conv->used = convolution_select_algo(Conv, X);
+    if (Conv->used != CONV_ALGO_IM2COL) {
+        // X is usually freed before backward runs, so keep a copy of it
+        Conv->x = reuse_matrix_4d(Conv->x, N, X->sizes[1], H, W);
+        matrix_4d_transpose_into(Conv->x, X, 0, 1, 2, 3);
+        if (Conv->used == CONV_ALGO_DIRECT) {
+            free_matrix(Conv->col);
+            Conv->col = NULL;
+        }
 
-    Matrix* out = matrix_add_vector(tmp, Conv->b);
-    Matrix4d* out_r = matrix_reshape_to_4d(out, N, out_h, out_w, -1);
-    Matrix4d* out_rt = matrix_4d_transpose(out_r, 0, 3, 1, 2);
+        if (Conv->used == CONV_ALGO_WINOGRAD && Conv->U == NULL) {
+            Conv->U = reuse_matrix(NULL, 16 * FN, X->sizes[1]);
+            conv_winograd_transform_filter_into(Conv->U, Conv->W);
+        }
 
-    if (Conv->x != NULL) {
-        // free_matrix_4d(Conv->x);
+        Matrix4d* out = create_matrix_4d(N, FN, out_h, out_w);
+        if (convolution_run_direct(Conv, Conv->used, out, Conv->x, false) != 0) {
+            free_matrix_4d(out);
+            return NULL;
+        }
+        return out;
     }
-    Conv->x = X;
+    free_matrix_4d(Conv->x);
+    Conv->x = NULL;
 
-    if (Conv->col != NULL) {
-        free_matrix(Conv->col);
-    }
-    Conv->col = col;
+    Conv->col = reuse_matrix(Conv->col, N * out_h * out_w, X->sizes[1] * FH * FW);
+    im2col_into(Conv->col, X, FH, FW, Conv->stride, Conv->pad);
 
-    if (Conv->col_W != NULL) {
-        free_matrix(Conv->col_W);
-    }
-    Conv->col_W = col_W;
+    return convolution_run_im2col(Conv, Conv->col, N, out_h, out_w, false);
+}
 
-    free_matrix(tmp);
-    free_matrix(tmp2);
-    free_matrix(out);
-    free_matrix_4d(out_r);
+Matrix4d* convolution_relu_forward(const Convolution* Conv, const Matrix4d* X) {
+    return convolution_forward_nograd(Conv, X, true);
+}
 
-    return out_rt;
+static Matrix4d* convolution_backward_direct(Convolution* Conv, const Matrix4d* X) {
+    // the kernels want NCHW rows in order; a permuted view is copied first
+    Matrix4d* dout = matrix_4d_contiguous(X);
+
+    Conv->db = reuse_vector(Conv->db, Conv->W->sizes[0]);
+    Conv->dW = reuse_matrix_4d(Conv->dW, Conv->W->sizes[0], Conv->W->sizes[1], Conv->W->sizes[2], Conv->W->sizes[3]);
+    conv_direct_backward_weights(Conv->dW, Conv->db, dout, Conv->x, Conv->stride, Conv->pad);
+
+    Matrix4d* dx = create_matrix_4d(Conv->x_shape[0], Conv->x_shape[1], Conv->x_shape[2], Conv->x_shape[3]);
+    conv_direct_backward_data(dx, dout, Conv->W, Conv->stride, Conv->pad);
+
+    free_matrix_4d(dout);
+
+    return dx;
 }
 
 Matrix4d* convolution_backward(Convolution* Conv, const Matrix4d* X) {
+    // an optimizer step on W follows
+    convolution_invalidate_cache(Conv);
+    if (Conv->used == CONV_ALGO_DIRECT) {
+        return convolution_backward_direct(Conv, X);
+    }
+
     const int FN = Conv->W->sizes[0];
     const int C  = Conv->W->sizes[1];
     const int FH = Conv->W->sizes[2];
     const int FW = Conv->W->sizes[3];
+
+    if (Conv->used == CONV_ALGO_WINOGRAD) {
+        // forward built no col matrix, backward wants one for its GEMMs
+        const int out_h = X->sizes[2];
+        const int out_w = X->sizes[3];
+        Conv->col = reuse_matrix(Conv->col, Conv->x_shape[0] * out_h * out_w, C * FH * FW);
+        im2col_into(Conv->col, Conv->x, FH, FW, Conv->stride, Conv->pad);
+    }
     
     Matrix4d* tmp = matrix_4d_transpose(X, 0, 2, 3, 1);  
     Matrix* dout = matrix_reshape_to_2d(tmp, -1, FN);
 
     // db
-    if (Conv->db != NULL) {
-        free_vector(Conv->db);
-    }
-    Conv->db = matrix_col_sum(dout);
+    Conv->db = reuse_vector(Conv->db, FN);
+    matrix_col_sum_into(Conv->db, dout);
 
-    // dW
-    Matrix* col_T = transpose(Conv->col);
-    Matrix* dW = dot_matrix(col_T, dout);
-    Matrix* dW_T = transpose(dW);
-    if (Conv->dW != NULL) {
-        free_matrix_4d(Conv->dW);
-    }
-    Conv->dW = matrix_reshape_to_4d(dW_T, FN, C, FH, FW);
+    // dW = (col^T * dout)^T = dout^T * col, written through a 2d view
+    Conv->dW = reuse_matrix_4d(Conv->dW, FN, C, FH, FW);
+    Matrix* dW_T = matrix_reshape_to_2d(Conv->dW, FN, -1);
+    dot_matrix_trans_into(dW_T, dout, true, Conv->col, false);
 
-    // dcol
-    Matrix* col_W_T = transpose(Conv->col_W);
-    Matrix* dcol = dot_matrix(dout, col_W_T);
+    // dcol = dout * W2d
+    Matrix* W2d = matrix_reshape_to_2d(Conv->W, FN, -1);
+    Matrix* dcol = dot_matrix(dout, W2d);
 
-    Matrix4d* dx = col2im(dcol, Conv->x->sizes, FH, FW, Conv->stride, Conv->pad);  
+    Matrix4d* dx = col2im(dcol, Conv->x_shape, FH, FW, Conv->stride, Conv->pad);  
 
     free_matrix_4d(tmp);
     free_matrix(dout);
-    free_matrix(col_T);
-    free_matrix(dW);
     free_matrix(dW_T);
-    free_matrix(col_W_T);
+    free_matrix(W2d);
     free_matrix(dcol);
 
     return dx;
 }
 
 Pooling* create_pooling(int pool_h, int pool_w, int stride, int pad) {
+    // arg_max keeps a byte per output, which can only tell this many taps apart
+    if (pool_h <= 0 || pool_w <= 0 || stride <= 0 || pool_h * pool_w > POOL_MAX_WINDOW) {
+        fprintf(stderr, "Invalid size. pool=(%d, %d), stride=%d; windows may have at most %d taps.\n",
+            pool_h, pool_w, stride, POOL_MAX_WINDOW);
+        return NULL;
+    }
+
     Pooling* P = malloc(sizeof(Pooling));
     P->pool_h  = pool_h;
     P->pool_w  = pool_w;
     P->stride  = stride;
     P->pad     = pad;
-    P->x       = NULL;
     P->arg_max = NULL;
+    memset(P->x_shape, 0, sizeof(int) * 4);
     return P;
 }
 
 void free_pooling(Pooling* P) {
-    free_matrix_4d(P->x);
-    free(P->arg_max);
+    buffer_pool_free(P->arg_max);
     free(P);
 }
 
-Matrix4d* pooling_forward(Pooling* P, Matrix4d* X) {
+Matrix4d* pooling_forward(Pooling* P, const Matrix4d* X) {
     const int N  = X->sizes[0];
     const int C  = X->sizes[1];
     const int H  = X->sizes[2];
     const int W  = X->sizes[3];
 
-    const int out_h = 1 + (H - P->pool_h) / P->stride;
-    const int out_w = 1 + (W - P->pool_w) / P->stride;
+    const int out_h = 1 + (H + 2 * P->pad - P->pool_h) / P->stride;
+    const int out_w = 1 + (W + 2 * P->pad - P->pool_w) / P->stride;
 
-    Matrix* tmp = im2col(X, P->pool_h, P->pool_w, P->stride, P->pad);
-    Matrix* col = matrix_reshape(tmp, -1, P->pool_h * P->pool_w);
+    // the kernel wants NCHW rows in order; a permuted view is copied first
+    Matrix4d* x = matrix_4d_contiguous(X);
+    Matrix4d* out = create_matrix_4d(N, C, out_h, out_w);
 
-    if (P->arg_max != NULL) {
-        free(P->arg_max);
+    if (grad_disabled) {
+        const int r = pool_max_forward(out, NULL, x, P->pool_h, P->pool_w, P->stride, P->pad);
+        free_matrix_4d(x);
+        if (r != 0) {
+            free_matrix_4d(out);
+            return NULL;
+        }
+        return out;
     }
-    P->arg_max = matrix_argmax_row(col); 
-
-    Vector* tmp2 = matrix_row_max(col);
 
-    Matrix4d* tmp3 = vector_reshape_to_4d(tmp2, N, out_h, out_w, C);
-    Matrix4d* out = matrix_4d_transpose(tmp3, 0, 3, 1, 2);
-   
-    if (P->x != NULL) {
-        free_matrix_4d(P->x);
+    // same size every iteration, so the pool hands the old block back
+    buffer_pool_free(P->arg_max);
+    P->arg_max = buffer_pool_alloc(sizeof(uint8_t) * matrix_4d_size(out), sizeof(uint8_t));
+    if (P->arg_max == NULL || pool_max_forward(out, P->arg_max, x, P->pool_h, P->pool_w, P->stride, P->pad) != 0) {
+        free_matrix_4d(x);
+        free_matrix_4d(out);
+        return NULL;
     }
-    P->x = X;
 
-    free_matrix(tmp);
-    free_matrix(col);
-    free_vector(tmp2);
-    free_matrix_4d(tmp3);
+    memcpy(P->x_shape, X->sizes, sizeof(int) * 4);
+
+    free_matrix_4d(x);
 
     return out;
 }
 
 Matrix4d* pooling_backward(const Pooling* P, const Matrix4d* X) {
-    Matrix4d* dout = matrix_4d_transpose(X, 0, 2, 3, 1);
-
-    const int pool_size = P->pool_h * P->pool_w;
-    const int dout_size = dout->sizes[0] * dout->sizes[1] * dout->sizes[2] * dout->sizes[3];
-    Matrix* dmax = create_matrix(dout_size, pool_size); 
+    Matrix4d* dout = matrix_4d_contiguous(X);
+    Matrix4d* dx = create_matrix_4d(P->x_shape[0], P->x_shape[1], P->x_shape[2], P->x_shape[3]);
+    const int r = pool_max_backward(dx, dout, P->arg_max, P->pool_h, P->pool_w, P->stride, P->pad);
 
-    Vector* dout_flat = matrix_4d_flatten(dout);
-    for (int i = 0; i < dmax->rows; ++i) {
-        dmax->elements[i][P->arg_max[i]] = dout_flat->elements[i];
+    free_matrix_4d(dout);
+    if (r != 0) {
+        free_matrix_4d(dx);
+        return NULL;
     }
 
-    Matrix* dcol = create_matrix(dout->sizes[0] * dout->sizes[1] * dout->sizes[2], dout->sizes[3] * pool_size);
-    int r_pos = 0, c_pos = 0;
-    for (int i = 0; i < dmax->rows; ++i) {
-        for (int j = 0; j < dmax->cols; ++j) {
-            dcol->elements[r_pos][c_pos++] = dmax->elements[i][j];
-            if (c_pos == dcol->cols) {
-                c_pos = 0;
-                ++r_pos;
-            }
-        }
-    }
-    int sizes[4] = {P->x->sizes[0], P->x->sizes[1], P->x->sizes[2], P->x->sizes[3]};
-    Matrix4d* dx = col2im(dcol, sizes, P->pool_h, P->pool_w, P->stride, P->pad);
-
-    free_matrix_4d(dout); 
-    free_matrix(dmax); 
-    free_vector(dout_flat); 
-    free_matrix(dcol); 
-
     return dx;
 }
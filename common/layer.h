@@ -24,11 +24,12 @@ struct Affine4d {
     Vector*  db;
 };
 
+// one bit per element in row-major order, packed into 64-bit words (see
+// SIMD_MASK_WORDS); a set bit lets the value and its gradient through
 typedef struct Mask Mask;
 struct Mask {
-    int    rows;
-    int    cols;
-    bool** elements;
+    int       size;
+    uint64_t* bits;
 };
 
 typedef struct Relu Relu;
@@ -36,22 +37,15 @@ struct Relu {
     Mask* mask;
 };
 
-typedef struct Mask4d Mask4d;
-struct Mask4d {
-    int sizes[4];
-    bool**** elements;
-};
-
 typedef struct Relu4d Relu4d;
 struct Relu4d {
-    Mask4d* mask;
+    Mask* mask;
 };
 
 typedef struct SoftmaxWithLoss SoftmaxWithLoss;
 struct SoftmaxWithLoss {
     double  loss;
-    Matrix*    Y;
-    Vector*    t;
+    Matrix* dX;     // gradient of the last loss, written by forward
 };
 
 typedef struct BatchNormalization BatchNormalization;
@@ -61,8 +55,7 @@ struct BatchNormalization {
     Vector* dg;
     Vector* db;  
 
-    Matrix* xc;
-    Matrix* xn;
+    Matrix* xn;       // normalised input of the last forward
     Vector* std;
     Vector* running_mean;
     Vector* running_var;
@@ -77,15 +70,36 @@ struct Dropout {
     Mask* mask;
 };
 
+//
+// How a Convolution computes its products. CONV_ALGO_IM2COL expands the
+// input into a (N * OH * OW, C * FH * FW) matrix and runs one GEMM over it;
+// CONV_ALGO_DIRECT (conv_direct.h) works on the NCHW tensors in place and
+// keeps only a copy of the input for backward. CONV_ALGO_WINOGRAD
+// (conv_winograd.h) runs the forward pass of 3x3 stride 1 layers with
+// Winograd F(2x2, 3x3) on a copy of the input, and builds the col matrix
+// from that copy only in backward. Its transformed filters are cached in U.
+// CONV_ALGO_AUTO, the default, picks one per call with
+// convolution_select_algo.
+//
+typedef enum {
+    CONV_ALGO_AUTO,
+    CONV_ALGO_IM2COL,
+    CONV_ALGO_DIRECT,
+    CONV_ALGO_WINOGRAD,
+} ConvAlgo;
+
 typedef struct Convolution Convolution;
 struct Convolution {
     Matrix4d* W;
     Vector* b;
     int stride;
     int pad;
-    Matrix4d* x;
-    Matrix* col;
-    Matrix* col_W;
+    ConvAlgo algo;
+    ConvAlgo used;    // what the last forward ran
+    int x_shape[4];
+    Matrix4d* x;      // CONV_ALGO_DIRECT, WINOGRAD: copy of the last input
+    Matrix* col;      // CONV_ALGO_IM2COL, WINOGRAD: im2col of the last input
+    Matrix* U;        // CONV_ALGO_WINOGRAD: transformed W, NULL when stale
     Vector* db;
     Matrix4d* dW;
 };
@@ -96,10 +110,32 @@ struct Pooling {
     int pool_w;
     int stride;
     int pad;
-    Matrix4d* x;
-    int* arg_max;
+    int x_shape[4];
+    uint8_t* arg_max;   // position of the maximum inside each window
 };
 
+//
+// Gradient tracking, on by default. While it is off for a thread, forward
+// passes on that thread keep nothing for backward: Affine does not copy its
+// input, Relu, Relu4d and Dropout build no masks, Pooling keeps no argmax,
+// Convolution keeps neither its input nor the col matrix and
+// SoftmaxWithLoss writes no gradient. backward must not be called after such
+// a forward. BatchNormalization in training is not affected.
+//
+// Affine, Relu, Relu4d, Pooling, Convolution, and BatchNormalization and
+// Dropout outside training then only read their layer, so several threads
+// may run one net at once.
+//
+// layer_set_grad_enabled returns the previous setting, so that a caller
+// can put it back:
+//
+//   const bool grad = layer_set_grad_enabled(false);
+//   ... evaluate ...
+//   layer_set_grad_enabled(grad);
+//
+bool layer_set_grad_enabled(bool enabled);
+bool layer_grad_enabled();
+
 Affine* create_affine(Matrix* W, Vector* b);
 void free_affine(Affine* A);
 Matrix* affine_forward(Affine* A, const Matrix* X);
@@ -120,12 +156,18 @@ Matrix4d* relu_4d_backward(Relu4d* R, const Matrix4d* D);
 SoftmaxWithLoss* create_softmax_with_loss();
 void free_softmax_with_loss(SoftmaxWithLoss* S);
 double softmax_with_loss_forward(SoftmaxWithLoss* sft, const Matrix* X, const Vector* t);
+// a view of the gradient forward wrote, which the next forward overwrites
 Matrix* softmax_with_loss_backward(const SoftmaxWithLoss* sft);
 
 BatchNormalization* create_batch_normalization(Vector* g, Vector* b, double momentum);
 void free_batch_normalization(BatchNormalization* B);
-Matrix* batch_normalization_forward(BatchNormalization* B, const Matrix* X);
+// with train_flg unset X is normalised with the running statistics, and B is
+// only read
+Matrix* batch_normalization_forward(BatchNormalization* B, const Matrix* X, bool train_flg);
 Matrix* batch_normalization_backward(BatchNormalization* B, const Matrix* D);
+// rewrites the W and b of the Affine feeding B so that the Affine alone
+// computes what the pair does with train_flg unset
+int batch_normalization_fold_into(const BatchNormalization* B, Matrix* W, Vector* b);
 
 Dropout* create_dropout(double dropout_ratio);
 void free_dropout(Dropout* D);
@@ -134,12 +176,24 @@ Matrix* dropout_backward(const Dropout* D, const Matrix* X);
 
 Convolution* create_convolution(Matrix4d* W, Vector* b, int stride, int pad);
 void free_convolution(Convolution* C);
+// NULL when the convolution kernel failed
 Matrix4d* convolution_forward(Convolution* C, Matrix4d* X);
+// inference only: relu(conv(X)) with bias and ReLU fused into the kernel
+// epilogue; keeps nothing for a backward pass and does not write C, so
+// threads may share the layer
+Matrix4d* convolution_relu_forward(const Convolution* C, const Matrix4d* X);
 Matrix4d* convolution_backward(Convolution* C, const Matrix4d* X);
+ConvAlgo convolution_select_algo(const Convolution* C, const Matrix4d* X);
+
+// call after writing W other than through backward + an optimizer step
+// (loading parameters, for one), so that cached transforms are rebuilt
+void convolution_invalidate_cache(Convolution* C);
 
+// NULL for a window of more than POOL_MAX_WINDOW taps (see pool_max.h);
+// forward and backward return NULL when the kernel fails
 Pooling* create_pooling(int pool_h, int pool_w, int stride, int pad);
 void free_pooling(Pooling* P);
-Matrix4d* pooling_forward(Pooling* P, Matrix4d* X);
+Matrix4d* pooling_forward(Pooling* P, const Matrix4d* X);
 Matrix4d* pooling_backward(const Pooling* P, const Matrix4d* X);
 
 #endif
@@ -1,27 +1,178 @@
 #include "matrix.h" 
+#include "gemm.h"
+#include "simd.h"
 #include "mnist.h"
+#include "thread_pool.h"
+#include "arena.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <time.h>
 #include <math.h>
 #include <float.h>
 
+//
+// storage
+//
+
+// the Storage header takes the first MATRIX_ALIGNMENT bytes of the block,
+// so the values that follow stay aligned and need no second allocation.
+// Tensor memory comes from the arena while one is open (see arena.h).
+static Storage* create_storage(int n) {
+    const size_t bytes = (n > 0 ? n : 1) * sizeof(real);
+    void* p = arena_alloc(MATRIX_ALIGNMENT + bytes, MATRIX_ALIGNMENT);
+    if (p == NULL) {
+        fprintf(stderr, "Failed to allocate %zu bytes.\n", bytes);
+        return NULL;
+    }
+
+    Storage* S = p;
+    S->refs = 1;
+    S->size = n;
+    memset((char*)p + MATRIX_ALIGNMENT, 0, bytes);
+
+    return S;
+}
+
+static real* storage_data(Storage* S) {
+    return (real*)((char*)S + MATRIX_ALIGNMENT);
+}
+
+// views of one tensor may be taken and freed on several threads at once
+// (layers shared by the workers of a parallel evaluation), so the count is
+// kept with atomic operations
+static Storage* retain_storage(Storage* S) {
+    __atomic_add_fetch(&S->refs, 1, __ATOMIC_RELAXED);
+    return S;
+}
+
+static void release_storage(Storage* S) {
+    if (__atomic_sub_fetch(&S->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        arena_free(S);
+    }
+}
+
+static void bind_matrix_rows(Matrix* M) {
+    for (int i = 0; i < M->rows; ++i) {
+        M->elements[i] = M->data + (size_t)i * M->cols;
+    }
+}
+
+// address of M[i][j][k][l] through the strides, so also for views
+static real* matrix_4d_at(const Matrix4d* M, int i, int j, int k, int l) {
+    return M->data + (size_t)i * M->strides[0] + (size_t)j * M->strides[1] + (size_t)k * M->strides[2] + (size_t)l * M->strides[3];
+}
+
+static int matrix_4d_table_size(const Matrix4d* M) {
+    return M->sizes[0] + M->sizes[0] * M->sizes[1] + M->sizes[0] * M->sizes[1] * M->sizes[2];
+}
+
+static void bind_matrix_4d_rows(Matrix4d* M) {
+    const int s1 = M->sizes[0], s2 = M->sizes[1], s3 = M->sizes[2];
+    real*** l2 = (real***)(M->elements + s1);
+    real**  l3 = (real**)(l2 + s1 * s2);
+
+    for (int i = 0; i < s1; ++i) {
+        M->elements[i] = l2 + i * s2;
+        for (int j = 0; j < s2; ++j) {
+            M->elements[i][j] = l3 + (i * s2 + j) * s3;
+            for (int k = 0; k < s3; ++k) {
+                M->elements[i][j][k] = M->data + (size_t)i * M->strides[0] + (size_t)j * M->strides[1] + (size_t)k * M->strides[2];
+            }
+        }
+    }
+}
+
 //
 // factory
 //
-Vector* create_vector(int size) {
-    Vector* v = calloc(1, sizeof(Vector));
+// wrap_* build a tensor header over a storage reference they take over.
+// They return NULL when S is NULL or the header can not be allocated, and
+// the reference is dropped then.
+
+// the header block, or NULL with S released
+static void* alloc_header(Storage* S, size_t bytes) {
+    if (S == NULL) {
+        return NULL;
+    }
+
+    void* p = arena_alloc(bytes, sizeof(void*));
+    if (p == NULL) {
+        fprintf(stderr, "Failed to allocate %zu bytes.\n", bytes);
+        release_storage(S);
+    }
+
+    return p;
+}
+
+static Vector* wrap_vector(Storage* S, int size) {
+    Vector* v = alloc_header(S, sizeof(Vector));
+    if (v == NULL) {
+        return NULL;
+    }
     v->size = size;
-    v->elements = calloc(size, sizeof(double));
+    v->storage = S;
+    v->elements = storage_data(S);
     return v;
 }
 
+static Matrix* wrap_matrix(Storage* S, int rows, int cols) {
+    // header and row table share one block
+    Matrix* M = alloc_header(S, sizeof(Matrix) + sizeof(real*) * rows);
+    if (M == NULL) {
+        return NULL;
+    }
+    M->rows = rows;
+    M->cols = cols;
+    M->storage = S;
+    M->data = storage_data(S);
+    M->elements = (real**)(M + 1);
+    bind_matrix_rows(M);
+
+    return M;
+}
+
+// a view (table unset) gets no elements table, which would cost as much
+// as a copy of the pointers to every row; matrix_4d_elements builds it on
+// first use
+static Matrix4d* wrap_matrix_4d(Storage* S, int s1, int s2, int s3, int s4, bool table) {
+    const int tables = table ? s1 + s1 * s2 + s1 * s2 * s3 : 0;
+    Matrix4d* M = alloc_header(S, sizeof(Matrix4d) + sizeof(void*) * tables);
+    if (M == NULL) {
+        return NULL;
+    }
+    M->sizes[0] = s1;
+    M->sizes[1] = s2;
+    M->sizes[2] = s3;
+    M->sizes[3] = s4;
+
+    M->strides[3] = 1;
+    M->strides[2] = s4;
+    M->strides[1] = s3 * s4;
+    M->strides[0] = s2 * s3 * s4;
+
+    M->storage = S;
+    M->data = storage_data(S);
+    M->elements = NULL;
+    if (table) {
+        M->elements = (real****)(M + 1);
+        bind_matrix_4d_rows(M);
+    }
+
+    return M;
+}
+
+Vector* create_vector(int size) {
+    return wrap_vector(create_storage(size), size);
+}
+
 Vector* create_vector_initval(int size, double init_val) {
-    Vector* v = calloc(1, sizeof(Vector));
-    v->size = size;
-    v->elements = calloc(size, sizeof(double));
+    Vector* v = create_vector(size);
+    if (v == NULL) {
+        return NULL;
+    }
 
     for (int i = 0; i < size; ++i) {
         v->elements[i] = init_val;
@@ -32,6 +183,9 @@ Vector* create_vector_initval(int size, double init_val) {
 
 Vector* create_vector_from_file(const char* file_path, int size) {
     Vector* v = create_vector(size);
+    if (v == NULL) {
+        return NULL;
+    }
     if (init_vector_from_file(v, file_path) != 0) {
         fprintf(stderr, "Failed to init vector from file=%s\n", file_path);
         return NULL;
@@ -41,19 +195,14 @@ Vector* create_vector_from_file(const char* file_path, int size) {
 }
 
 Matrix* create_matrix(int rows, int cols) {
-    Matrix* M = malloc(sizeof(Matrix));
-    M->rows = rows;
-    M->cols = cols;
-    M->elements = calloc(rows, sizeof(double*));
-    for (int i = 0; i < rows; ++i) {
-        M->elements[i] = calloc(cols, sizeof(double));
-    }
-
-    return M;
+    return wrap_matrix(create_storage(rows * cols), rows, cols);
 }
 
 Matrix* create_matrix_from_file(const char* file_path, int rows, int cols) {
     Matrix* M = create_matrix(rows, cols);
+    if (M == NULL) {
+        return NULL;
+    }
     if (init_matrix_from_file(M, file_path) != 0) {
         fprintf(stderr, "Failed to init matrix from file=%s\n", file_path); 
         return NULL;
@@ -63,28 +212,14 @@ Matrix* create_matrix_from_file(const char* file_path, int rows, int cols) {
 }
 
 Matrix4d* create_matrix_4d(int s1, int s2, int s3, int s4) {
-    Matrix4d* M = malloc(sizeof(Matrix4d));
-    M->sizes[0] = s1;
-    M->sizes[1] = s2;
-    M->sizes[2] = s3;
-    M->sizes[3] = s4;
-
-    M->elements = calloc(s1, sizeof(double***));
-    for (int i = 0; i < s1; ++i) {
-        M->elements[i] = calloc(s2, sizeof(double**));
-        for (int j = 0; j < s2; ++j) {
-            M->elements[i][j] = calloc(s3, sizeof(double*));
-            for (int k = 0; k < s3; ++k) {
-                M->elements[i][j][k] = calloc(s4, sizeof(double));
-            }
-        }
-    }
-
-    return M;
+    return wrap_matrix_4d(create_storage(s1 * s2 * s3 * s4), s1, s2, s3, s4, true);
 }
 
 Matrix4d* create_matrix_4d_from_file(const char* file_path, int s1, int s2, int s3, int s4) {
     Matrix4d* M = create_matrix_4d(s1, s2, s3, s4);
+    if (M == NULL) {
+        return NULL;
+    }
     if (init_matrix_4d_from_file(M, file_path) != 0) {
         fprintf(stderr, "Failed to init matrix4d from file=%s\n", file_path); 
         return NULL;
@@ -92,6 +227,50 @@ Matrix4d* create_matrix_4d_from_file(const char* file_path, int s1, int s2, int
 
     return M;
 }
+
+// the buffer itself when it already has the requested shape, else a new one
+
+// reused buffers outlive the step, so they never come from the arena
+
+Vector* reuse_vector(Vector* v, int size) {
+    if (v != NULL && v->size == size) {
+        return v;
+    }
+    free_vector(v);
+
+    arena_suspend();
+    v = create_vector(size);
+    arena_resume();
+
+    return v;
+}
+
+Matrix* reuse_matrix(Matrix* M, int rows, int cols) {
+    if (M != NULL && M->rows == rows && M->cols == cols) {
+        return M;
+    }
+    free_matrix(M);
+
+    arena_suspend();
+    M = create_matrix(rows, cols);
+    arena_resume();
+
+    return M;
+}
+
+Matrix4d* reuse_matrix_4d(Matrix4d* M, int s1, int s2, int s3, int s4) {
+    if (M != NULL && M->sizes[0] == s1 && M->sizes[1] == s2 && M->sizes[2] == s3 && M->sizes[3] == s4) {
+        return M;
+    }
+    free_matrix_4d(M);
+
+    arena_suspend();
+    M = create_matrix_4d(s1, s2, s3, s4);
+    arena_resume();
+
+    return M;
+}
+
 //
 // init
 //
@@ -160,7 +339,7 @@ int init_matrix_4d_from_file(Matrix4d* M, const char* file_path) {
                         fclose(fp);
                         return -1;
                     }
-                    M->elements[i][j][k][l] = d;
+                    *matrix_4d_at(M, i, j, k, l) = d;
                 }
             }
         }
@@ -171,17 +350,11 @@ int init_matrix_4d_from_file(Matrix4d* M, const char* file_path) {
 }
 
 void copy_matrix(Matrix* dst, const Matrix* src) {
-    for (int i = 0; i < src->rows; ++i) {
-        for (int j = 0; j < src->cols; ++j) {
-            dst->elements[i][j] = src->elements[i][j];
-        }
-    }
+    memcpy(dst->data, src->data, sizeof(real) * matrix_size(src));
 }
 
 void copy_vector(Vector* dst, const Vector* src) {
-    for (int i = 0; i < src->size; ++i) {
-        dst->elements[i] = src->elements[i];
-    }
+    memcpy(dst->elements, src->elements, sizeof(real) * src->size);
 }
 
 static double rand_normal() {
@@ -191,30 +364,23 @@ static double rand_normal() {
 }
 
 void init_matrix_random(Matrix* M) {
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            M->elements[i][j] = rand_normal();
-        }
+    const int n = matrix_size(M);
+    for (int i = 0; i < n; ++i) {
+        M->data[i] = rand_normal();
     }
 }
 
 void init_matrix_4d_random(Matrix4d* M) {
-    for (int i = 0; i < M->sizes[0]; ++i) {
-        for (int j = 0; j < M->sizes[1]; ++j) {
-            for (int k = 0; k < M->sizes[2]; ++k) {
-                for (int l = 0; l < M->sizes[3]; ++l) {
-                    M->elements[i][j][k][l] = rand_normal();
-                }
-            }
-        }
+    const int n = matrix_4d_size(M);
+    for (int i = 0; i < n; ++i) {
+        M->data[i] = rand_normal();
     }
 }
 
 void init_matrix_rand(Matrix* M) {
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            M->elements[i][j] = (double)rand() / (double)RAND_MAX;
-        }
+    const int n = matrix_size(M);
+    for (int i = 0; i < n; ++i) {
+        M->data[i] = (double)rand() / (double)RAND_MAX;
     }
 }
 
@@ -229,164 +395,321 @@ void init_vector_from_array(Vector* v, double* vals) {
 //
 
 void free_vector(Vector* v) {
-    free(v->elements);
-    free(v);
+    if (v == NULL) {
+        return;
+    }
+    release_storage(v->storage);
+    arena_free(v);
 }
 
 void free_matrix(Matrix* M) {
-    for (int i = 0; i < M->rows; ++i) {
-        free(M->elements[i]);
+    if (M == NULL) {
+        return;
     }
-    free(M->elements);
-    free(M);
+    release_storage(M->storage);
+    arena_free(M);
 }
 
 void free_matrix_4d(Matrix4d* M) {
-    for (int i = 0; i < M->sizes[0]; ++i) {
-        for (int j = 0; j < M->sizes[1]; ++j) {
-            for (int k = 0; k < M->sizes[2]; ++k) {
-                free(M->elements[i][j][k]);
-            }
-            free(M->elements[i][j]);
-        }
-        free(M->elements[i]);
+    if (M == NULL) {
+        return;
+    }
+    if (M->elements != NULL && M->elements != (real****)(M + 1)) {
+        // built by matrix_4d_elements
+        free(M->elements);
+    }
+    release_storage(M->storage);
+    arena_free(M);
+}
+
+real**** matrix_4d_elements(Matrix4d* M) {
+    if (M->elements != NULL) {
+        return M->elements;
     }
-    free(M->elements);
-    free(M);
+    if (!matrix_4d_is_contiguous(M)) {
+        fprintf(stderr, "Invalid view. A permuted view has no elements table.\n");
+        return NULL;
+    }
+
+    // from the heap rather than the arena: the view may outlive the
+    // arena scope it was built in, and the table must live as long
+    const size_t bytes = sizeof(void*) * matrix_4d_table_size(M);
+    M->elements = malloc(bytes);
+    if (M->elements == NULL) {
+        fprintf(stderr, "Failed to allocate %zu bytes.\n", bytes);
+        return NULL;
+    }
+    bind_matrix_4d_rows(M);
+
+    return M->elements;
+}
+
+//
+// shape
+//
+
+int matrix_size(const Matrix* M) {
+    return M->rows * M->cols;
+}
+
+int matrix_4d_size(const Matrix4d* M) {
+    return M->sizes[0] * M->sizes[1] * M->sizes[2] * M->sizes[3];
 }
 
 //
 // Operator
 //
+// The allocating forms create a result of the right shape and hand it to
+// the matching _into form. A result that could not be allocated is NULL,
+// which the size checks turn into a failure.
+//
 
-Vector* add_vector(const Vector* a, const Vector* b) {
+static int check_vector_size(const Vector* v, int size) {
+    if (v == NULL) {
+        return -1;
+    }
+    if (v->size != size) {
+        fprintf(stderr, "Invalid size. dst %d, expected %d\n", v->size, size);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int check_matrix_size(const Matrix* M, int rows, int cols) {
+    if (M == NULL) {
+        return -1;
+    }
+    if (M->rows != rows || M->cols != cols) {
+        fprintf(stderr, "Invalid size. dst (%d, %d), expected (%d, %d)\n", M->rows, M->cols, rows, cols);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int check_matrix_4d_size(const Matrix4d* M, int s1, int s2, int s3, int s4) {
+    if (M == NULL) {
+        return -1;
+    }
+    if (M->sizes[0] != s1 || M->sizes[1] != s2 || M->sizes[2] != s3 || M->sizes[3] != s4) {
+        fprintf(stderr, "Invalid size. dst (%d, %d, %d, %d), expected (%d, %d, %d, %d)\n",
+            M->sizes[0], M->sizes[1], M->sizes[2], M->sizes[3], s1, s2, s3, s4);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int check_count(int dst, int src) {
+    if (dst != src) {
+        fprintf(stderr, "Invalid size. dst has %d elements, src has %d\n", dst, src);
+        return -1;
+    }
+
+    return 0;
+}
+
+int add_vector_into(Vector* r, const Vector* a, const Vector* b) {
     if (a->size != b->size) {
         fprintf(stderr, "Invalid size. %d and %d\n", a->size, b->size);
-        return NULL;
+        return -1;
+    }
+    if (check_vector_size(r, a->size) != 0) {
+        return -1;
     }
 
+    simd_kernels()->add(r->elements, a->elements, b->elements, r->size);
+
+    return 0;
+}
+
+Vector* add_vector(const Vector* a, const Vector* b) {
     Vector* r = create_vector(a->size);
-    for (int i = 0; i < r->size; ++i) {
-        r->elements[i] = a->elements[i] + b->elements[i];
+    if (add_vector_into(r, a, b) != 0) {
+        free_vector(r);
+        return NULL;
     }
 
     return r;
 }
 
-Vector* dot_vector_matrix(const Vector* v, const Matrix* M) {
+int dot_vector_matrix_into(Vector* r, const Vector* v, const Matrix* M) {
     if (v->size != M->rows) {
         fprintf(stderr, "Invalid size. %d and (%d, %d)\n", v->size, M->rows, M->cols);
-        return NULL;
+        return -1;
+    }
+    if (check_vector_size(r, M->cols) != 0) {
+        return -1;
     }
 
+    return gemm(false, false, 1, M->cols, M->rows, 1.0, v->elements, v->size, M->data, M->cols, 0.0, r->elements, r->size);
+}
+
+Vector* dot_vector_matrix(const Vector* v, const Matrix* M) {
     Vector* r = create_vector(M->cols);
-    for (int i = 0; i < r->size; ++i) {
-        double d = 0.0;
-        for (int j = 0; j < M->rows; ++j) {
-            d += (v->elements[j] * M->elements[j][i]);
-        }
-        r->elements[i] = d;
+    if (dot_vector_matrix_into(r, v, M) != 0) {
+        free_vector(r);
+        return NULL;
     }
 
     return r;
 }
 
+int dot_matrix_into(Matrix* A, const Matrix* M, const Matrix* N) {
+    return dot_matrix_trans_into(A, M, false, N, false);
+}
+
 Matrix* dot_matrix(const Matrix* M, const Matrix* N) {
-    if (M->cols != N->rows) {
-        fprintf(stderr, "Invalid size. (%d, %d) and (%d, %d)\n", M->rows, M->cols, N->rows, N->cols);
-        return NULL;
+    return dot_matrix_trans(M, false, N, false);
+}
+
+int dot_matrix_trans_into(Matrix* A, const Matrix* M, bool trans_m, const Matrix* N, bool trans_n) {
+    const int m_rows = trans_m ? M->cols : M->rows;
+    const int m_cols = trans_m ? M->rows : M->cols;
+    const int n_rows = trans_n ? N->cols : N->rows;
+    const int n_cols = trans_n ? N->rows : N->cols;
+    if (m_cols != n_rows) {
+        fprintf(stderr, "Invalid size. (%d, %d) and (%d, %d)\n", m_rows, m_cols, n_rows, n_cols);
+        return -1;
+    }
+    if (check_matrix_size(A, m_rows, n_cols) != 0) {
+        return -1;
     }
 
-    Matrix* A = create_matrix(M->rows, N->cols);
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < N->cols; ++j) {
-            double d = 0.0;
-            for (int k = 0; k < M->cols; ++k) {
-                d += M->elements[i][k] * N->elements[k][j];
-            }
-            A->elements[i][j] = d;
-        }
+    return gemm(trans_m, trans_n, m_rows, n_cols, m_cols, 1.0, M->data, M->cols, N->data, N->cols, 0.0, A->data, A->cols);
+}
+
+Matrix* dot_matrix_trans(const Matrix* M, bool trans_m, const Matrix* N, bool trans_n) {
+    Matrix* A = create_matrix(trans_m ? M->cols : M->rows, trans_n ? N->rows : N->cols);
+    if (dot_matrix_trans_into(A, M, trans_m, N, trans_n) != 0) {
+        free_matrix(A);
+        return NULL;
     }
 
     return A;
 }
 
-Matrix* product_vector_matrix(const Vector* V, const Matrix* M) {
+int product_vector_matrix_into(Matrix* A, const Vector* V, const Matrix* M) {
     if (V->size != M->cols) {
         fprintf(stderr, "Invalid size. %d and (%d, %d)\n", V->size, M->rows, M->cols);
-        return NULL;
+        return -1;
+    }
+    if (check_matrix_size(A, M->rows, M->cols) != 0) {
+        return -1;
     }
 
-    Matrix* A = create_matrix(M->rows, M->cols);
+    const SimdKernels* K = simd_kernels();
     for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            A->elements[i][j] = M->elements[i][j] * V->elements[j];
-        }
+        K->mul(A->elements[i], M->elements[i], V->elements, M->cols);
+    }
+
+    return 0;
+}
+
+Matrix* product_vector_matrix(const Vector* V, const Matrix* M) {
+    Matrix* A = create_matrix(M->rows, M->cols);
+    if (product_vector_matrix_into(A, V, M) != 0) {
+        free_matrix(A);
+        return NULL;
     }
 
     return A;
 }
 
-Matrix* product_matrix(const Matrix* M, const Matrix* N) {
+int product_matrix_into(Matrix* A, const Matrix* M, const Matrix* N) {
     if (!(M->rows == N->rows && M->cols == N->cols)) {
         fprintf(stderr, "Invalid size. (%d, %d) and (%d, %d)\n", M->rows, M->cols, N->rows, N->cols);
-        return NULL;
+        return -1;
+    }
+    if (check_matrix_size(A, M->rows, M->cols) != 0) {
+        return -1;
     }
-    
+
+    simd_kernels()->mul(A->data, M->data, N->data, matrix_size(A));
+
+    return 0;
+}
+
+Matrix* product_matrix(const Matrix* M, const Matrix* N) {
     Matrix* A = create_matrix(M->rows, M->cols);
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            A->elements[i][j] = M->elements[i][j] * N->elements[i][j];
-        }
+    if (product_matrix_into(A, M, N) != 0) {
+        free_matrix(A);
+        return NULL;
     }
-   
+
     return A;
 }
 
-Vector* product_vector(const Vector* V, const Vector* U) {
+int product_vector_into(Vector* R, const Vector* V, const Vector* U) {
     if (V->size != U->size) {
         fprintf(stderr, "Invalid size. %d and %d\n", V->size, U->size);
-        return NULL;
+        return -1;
     }
+    if (check_vector_size(R, V->size) != 0) {
+        return -1;
+    }
+
+    simd_kernels()->mul(R->elements, V->elements, U->elements, V->size);
 
+    return 0;
+}
+
+Vector* product_vector(const Vector* V, const Vector* U) {
     Vector* R = create_vector(V->size);
-    for (int i = 0; i < V->size; ++i) {
-        R->elements[i] = V->elements[i] * U->elements[i];
+    if (product_vector_into(R, V, U) != 0) {
+        free_vector(R);
+        return NULL;
     }
 
     return R;
 }
 
+int matrix_col_mean_into(Vector* V, const Matrix* M) {
+    if (matrix_col_sum_into(V, M) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < V->size; ++i) {
+        V->elements[i] /= M->rows;
+    }
+
+    return 0;
+}
+
 Vector* matrix_col_mean(const Matrix* M) {
     Vector* V = create_vector(M->cols);
+    matrix_col_mean_into(V, M);
+
+    return V;
+}
 
-    for (int i = 0; i < M->cols; ++i) {
-        double sum = 0.0;
-        for (int j = 0; j < M->rows; ++j) {
-            sum += M->elements[j][i];
+int matrix_col_sum_into(Vector* v, const Matrix* M) {
+    if (check_vector_size(v, M->cols) != 0) {
+        return -1;
+    }
+
+    memset(v->elements, 0, sizeof(real) * v->size);
+    for (int i = 0; i < M->rows; ++i) {
+        const real* m = M->elements[i];
+        for (int j = 0; j < M->cols; ++j) {
+            v->elements[j] += m[j];
         }
-        V->elements[i] = sum / M->rows; 
     }
 
-    return V;
+    return 0;
 }
 
 Vector* matrix_col_sum(const Matrix* M) {
     Vector* v = create_vector(M->cols);
-
-    for (int i = 0; i < M->cols; ++i) {
-        double sum = 0.0;
-        for (int j = 0; j < M->rows; ++j) {
-            sum += M->elements[j][i];
-        }
-        v->elements[i] = sum;
-    }
+    matrix_col_sum_into(v, M);
 
     return v;
 }
 
-Vector* matrix_row_max(const Matrix* M) {
-    Vector* v = create_vector(M->rows);
+int matrix_row_max_into(Vector* v, const Matrix* M) {
+    if (check_vector_size(v, M->rows) != 0) {
+        return -1;
+    }
 
     for (int i = 0; i < M->rows; ++i) {
         double max_val = -DBL_MAX;
@@ -396,330 +719,531 @@ Vector* matrix_row_max(const Matrix* M) {
         v->elements[i] = max_val;
     }
 
+    return 0;
+}
+
+Vector* matrix_row_max(const Matrix* M) {
+    Vector* v = create_vector(M->rows);
+    matrix_row_max_into(v, M);
+
     return v;
 }
 
 void scalar_matrix(Matrix* M, double k) {
-    for (int i = 0; i < M->rows; ++i) {
-       for (int j = 0; j < M->cols; ++j) {
-            M->elements[i][j] *= k;
-       }
-    }
+    simd_kernels()->scale(M->data, M->data, k, matrix_size(M));
 }
 
 void scalar_matrix_4d(Matrix4d* M, double v) {
-    for (int i = 0; i < M->sizes[0]; ++i) {
-        for (int j = 0; j < M->sizes[1]; ++j) {
-            for (int k = 0; k < M->sizes[2]; ++k) {
-                for (int l = 0; l < M->sizes[3]; ++l) {
-                    M->elements[i][j][k][l] *= v;
-                }
-            }
-       }
+    simd_kernels()->scale(M->data, M->data, v, matrix_4d_size(M));
+}
+
+int scalar_matrix_into(Matrix* R, const Matrix* M, double k) {
+    if (check_matrix_size(R, M->rows, M->cols) != 0) {
+        return -1;
     }
+
+    simd_kernels()->scale(R->data, M->data, k, matrix_size(M));
+
+    return 0;
 }
 
 Matrix* _scalar_matrix(const Matrix* M, double k) {
     Matrix* R = create_matrix(M->rows, M->cols);
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            R->elements[i][j] = M->elements[i][j] * k;
-        }
-    }
+    scalar_matrix_into(R, M, k);
 
     return R;
 }
 
 void scalar_vector(Vector* V, double k) {
-    for (int i = 0; i < V->size; ++i) {
-        V->elements[i] *= k;
+    simd_kernels()->scale(V->elements, V->elements, k, V->size);
+}
+
+// dst (cols, rows) = src (rows, cols)^T, a tile at a time so that both
+// sides stay in cache
+#define TRANSPOSE_TILE 32
+
+static void transpose_block(real* dst, const real* src, int rows, int cols) {
+    for (int i0 = 0; i0 < rows; i0 += TRANSPOSE_TILE) {
+        const int i1 = (i0 + TRANSPOSE_TILE < rows) ? i0 + TRANSPOSE_TILE : rows;
+        for (int j0 = 0; j0 < cols; j0 += TRANSPOSE_TILE) {
+            const int j1 = (j0 + TRANSPOSE_TILE < cols) ? j0 + TRANSPOSE_TILE : cols;
+            for (int j = j0; j < j1; ++j) {
+                real* d = dst + (size_t)j * rows;
+                for (int i = i0; i < i1; ++i) {
+                    d[i] = src[(size_t)i * cols + j];
+                }
+            }
+        }
+    }
+}
+
+int transpose_into(Matrix* N, const Matrix* M) {
+    if (check_matrix_size(N, M->cols, M->rows) != 0) {
+        return -1;
     }
+
+    transpose_block(N->data, M->data, M->rows, M->cols);
+
+    return 0;
 }
 
 Matrix* transpose(const Matrix* M) {
     Matrix* N = create_matrix(M->cols, M->rows);
+    transpose_into(N, M);
+
+    return N;
+}
 
-    for (int i = 0; i < N->rows; ++i) {
-        for (int j = 0; j < N->cols; ++j) {
-            N->elements[i][j] = M->elements[j][i];
+static bool strides_contiguous(const int* sizes, const int* strides) {
+    int expected = 1;
+    for (int i = 3; i >= 0; --i) {
+        if (sizes[i] != 1 && strides[i] != expected) {
+            return false;
         }
+        expected *= sizes[i];
     }
 
-    return N;
+    return true;
 }
 
-Matrix4d* matrix_4d_transpose(const Matrix4d* M, int n1, int n2, int n3, int n4) {
-    Matrix4d* R = create_matrix_4d(M->sizes[n1], M->sizes[n2], M->sizes[n3], M->sizes[n4]);
+bool matrix_4d_is_contiguous(const Matrix4d* M) {
+    return strides_contiguous(M->sizes, M->strides);
+}
 
-    int idx[4] = {0};
-    int n[4] = {n1, n2, n3, n4};
-    for (int i = 0; i < M->sizes[0]; ++i) {
-        for (int j = 0; j < M->sizes[1]; ++j) {
-            for (int k = 0; k < M->sizes[2]; ++k) {
-                for (int l = 0; l < M->sizes[3]; ++l) {
-                    const int org[] = {i, j, k, l};
-                    for (int i = 0; i < 4; ++i) {
-                        idx[i] = org[n[i]];
-                    }
+Matrix4d* matrix_4d_permute(const Matrix4d* M, int n1, int n2, int n3, int n4) {
+    const int n[4] = {n1, n2, n3, n4};
+    int seen = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (n[i] < 0 || n[i] > 3 || (seen & (1 << n[i]))) {
+            fprintf(stderr, "Invalid axes. (%d, %d, %d, %d)\n", n1, n2, n3, n4);
+            return NULL;
+        }
+        seen |= 1 << n[i];
+    }
+
+    int sizes[4], strides[4];
+    for (int i = 0; i < 4; ++i) {
+        sizes[i] = M->sizes[n[i]];
+        strides[i] = M->strides[n[i]];
+    }
+    if (strides_contiguous(sizes, strides)) {
+        return wrap_matrix_4d(retain_storage(M->storage), sizes[0], sizes[1], sizes[2], sizes[3], false);
+    }
+
+    // elements[i][j][k] can not address a row whose values are not adjacent
+    Matrix4d* R = alloc_header(retain_storage(M->storage), sizeof(Matrix4d));
+    if (R == NULL) {
+        return NULL;
+    }
+    memcpy(R->sizes, sizes, sizeof(sizes));
+    memcpy(R->strides, strides, sizeof(strides));
+    R->storage = M->storage;
+    R->data = M->data;
+    R->elements = NULL;
+
+    return R;
+}
+
+typedef struct StridedCopy StridedCopy;
+struct StridedCopy {
+    real* dst;
+    const real* src;
+    int sizes[4];
+    int strides[4];
+};
+
+// copies whole items of the first axis; within one item the strided source
+// is first reduced to as few axes as possible
+static void strided_copy_tasks(void* arg, int begin, int end) {
+    const StridedCopy* c = arg;
+    const int* sizes = c->sizes;
+    const int* strides = c->strides;
+    const size_t inner = (size_t)sizes[1] * sizes[2] * sizes[3];
+
+    int n = 0, sz[3], st[3];
+    for (int a = 1; a < 4; ++a) {
+        if (sizes[a] == 1) {
+            continue;
+        }
+        if (n > 0 && st[n - 1] == sizes[a] * strides[a]) {
+            sz[n - 1] *= sizes[a];
+            st[n - 1] = strides[a];
+        } else {
+            sz[n] = sizes[a];
+            st[n] = strides[a];
+            ++n;
+        }
+    }
 
-                    R->elements[idx[0]][idx[1]][idx[2]][idx[3]] = M->elements[i][j][k][l]; 
+    for (int b = begin; b < end; ++b) {
+        real* dst = c->dst + b * inner;
+        const real* src = c->src + (size_t)b * strides[0];
+
+        if (n == 0) {
+            dst[0] = src[0];
+        } else if (n == 1 && st[0] == 1) {
+            memcpy(dst, src, sizeof(real) * inner);
+        } else if (n == 2 && st[0] == 1 && st[1] == sz[0]) {
+            // NHWC <-> NCHW and friends: a plain 2d transpose per item
+            transpose_block(dst, src, sz[1], sz[0]);
+        } else {
+            for (int j = 0; j < sizes[1]; ++j) {
+                for (int k = 0; k < sizes[2]; ++k) {
+                    const real* s = src + (size_t)j * strides[1] + (size_t)k * strides[2];
+                    for (int l = 0; l < sizes[3]; ++l) {
+                        *dst++ = s[(size_t)l * strides[3]];
+                    }
                 }
             }
         }
     }
+}
+
+// below this many values a copy is not worth waking the thread pool for
+#define STRIDED_COPY_PARALLEL_MIN (1 << 16)
+
+static void strided_copy(real* dst, const real* src, const int* sizes, const int* strides) {
+    StridedCopy c = {dst, src, {sizes[0], sizes[1], sizes[2], sizes[3]}, {strides[0], strides[1], strides[2], strides[3]}};
+    if ((size_t)sizes[0] * sizes[1] * sizes[2] * sizes[3] >= STRIDED_COPY_PARALLEL_MIN) {
+        parallel_for(sizes[0], strided_copy_tasks, &c);
+    } else {
+        strided_copy_tasks(&c, 0, sizes[0]);
+    }
+}
+
+Matrix4d* matrix_4d_contiguous(const Matrix4d* M) {
+    if (matrix_4d_is_contiguous(M)) {
+        return wrap_matrix_4d(retain_storage(M->storage), M->sizes[0], M->sizes[1], M->sizes[2], M->sizes[3], false);
+    }
+
+    Matrix4d* R = create_matrix_4d(M->sizes[0], M->sizes[1], M->sizes[2], M->sizes[3]);
+    strided_copy(R->data, M->data, M->sizes, M->strides);
 
     return R;
 }
 
-Matrix4d* vector_reshape_to_4d(const Vector* v, int s1, int s2, int s3, int s4) {
-    int sizes[] = {s1, s2, s3, s4};
-    if (s4 < 0) {
-        sizes[3] = v->size / (s1 * s2 * s3);
+int matrix_4d_transpose_into(Matrix4d* R, const Matrix4d* M, int n1, int n2, int n3, int n4) {
+    if (check_matrix_4d_size(R, M->sizes[n1], M->sizes[n2], M->sizes[n3], M->sizes[n4]) != 0) {
+        return -1;
     }
 
-    Matrix4d* R = create_matrix_4d(sizes[0], sizes[1], sizes[2], sizes[3]);
-    int p1 = 0, p2 = 0, p3 = 0, p4 = 0;
-    for (int i = 0; i < v->size; ++i) {
-        R->elements[p1][p2][p3][p4] = v->elements[i];
-        ++p4;
-        if (p4 == sizes[3]) {
-            p4 = 0;
-            ++p3;
+    const int strides[4] = {M->strides[n1], M->strides[n2], M->strides[n3], M->strides[n4]};
+    strided_copy(R->data, M->data, R->sizes, strides);
+
+    return 0;
+}
+
+Matrix4d* matrix_4d_transpose(const Matrix4d* M, int n1, int n2, int n3, int n4) {
+    Matrix4d* P = matrix_4d_permute(M, n1, n2, n3, n4);
+    if (P == NULL) {
+        return NULL;
+    }
+    Matrix4d* R = matrix_4d_contiguous(P);
+    free_matrix_4d(P);
+
+    return R;
+}
+
+// fills in a negative size and checks the element count of a view
+static int view_sizes(int* sizes, int n, int count) {
+    int known = 1, unknown = -1;
+    for (int i = 0; i < n; ++i) {
+        if (sizes[i] < 0) {
+            unknown = i;
+        } else {
+            known *= sizes[i];
         }
+    }
+    if (unknown >= 0 && known > 0) {
+        sizes[unknown] = count / known;
+        known *= sizes[unknown];
+    }
 
-        if (p3 == sizes[2]) {
-            p3 = 0;
-            ++p2;
+    if (known != count) {
+        fprintf(stderr, "Invalid size. %d elements can not be viewed as", count);
+        for (int i = 0; i < n; ++i) {
+            fprintf(stderr, " %d", sizes[i]);
         }
+        fprintf(stderr, "\n");
+        return -1;
+    }
+
+    return 0;
+}
 
-        if (p2 == sizes[1]) {
-            p2 = 0;
-            ++p1;
-        } 
+int vector_reshape_to_4d_into(Matrix4d* R, const Vector* v) {
+    if (check_count(matrix_4d_size(R), v->size) != 0) {
+        return -1;
     }
 
-    return R;
+    memcpy(R->data, v->elements, sizeof(real) * v->size);
+
+    return 0;
+}
+
+Matrix4d* vector_reshape_to_4d(const Vector* v, int s1, int s2, int s3, int s4) {
+    int sizes[] = {s1, s2, s3, s4};
+    if (view_sizes(sizes, 4, v->size) != 0) {
+        return NULL;
+    }
+
+    return wrap_matrix_4d(retain_storage(v->storage), sizes[0], sizes[1], sizes[2], sizes[3], false);
+}
+
+int matrix_reshape_into(Matrix* R, const Matrix* M) {
+    if (check_count(matrix_size(R), matrix_size(M)) != 0) {
+        return -1;
+    }
+
+    if (R->data != M->data) {
+        memcpy(R->data, M->data, sizeof(real) * matrix_size(M));
+    }
+
+    return 0;
 }
 
 Matrix* matrix_reshape(const Matrix* M, int rows, int cols) {
-    int r = rows;
-    int c = cols;
-    if (rows < 0) {
-        r = (M->rows * M->cols) / cols;
-    } else if (cols < 0) {
-        c = (M->rows * M->cols) / rows;
+    int sizes[] = {rows, cols};
+    if (view_sizes(sizes, 2, matrix_size(M)) != 0) {
+        return NULL;
     }
 
-    int r_pos = 0, c_pos = 0;
-    Matrix* R = create_matrix(r, c);
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            R->elements[r_pos][c_pos++] = M->elements[i][j];
-            if (c_pos == c) {
-                c_pos = 0;
-                ++r_pos;
-            }
-        }
+    return wrap_matrix(retain_storage(M->storage), sizes[0], sizes[1]);
+}
+
+int matrix_reshape_to_2d_into(Matrix* R, const Matrix4d* M) {
+    if (check_count(matrix_size(R), matrix_4d_size(M)) != 0) {
+        return -1;
     }
 
-    return R;
+    strided_copy(R->data, M->data, M->sizes, M->strides);
+
+    return 0;
 }
 
 Matrix* matrix_reshape_to_2d(const Matrix4d* M, int rows, int cols) {
-    int r = rows;
-    int c = cols;
-    if (rows < 0) {
-        r = M->sizes[0] * M->sizes[1] * M->sizes[2] * M->sizes[3] / cols;
-    } else if (cols < 0) {
-        c = M->sizes[0] * M->sizes[1] * M->sizes[2] * M->sizes[3] / rows;
+    int sizes[] = {rows, cols};
+    if (view_sizes(sizes, 2, matrix_4d_size(M)) != 0) {
+        return NULL;
     }
 
-    Matrix* R = create_matrix(r, c);
-    int r_pos = 0, c_pos = 0;
-    for (int i = 0; i < M->sizes[0]; ++i) {
-        for (int j = 0; j < M->sizes[1]; ++j) {
-            for (int k = 0; k < M->sizes[2]; ++k) {
-                for (int l = 0; l < M->sizes[3]; ++l) {
-                    R->elements[r_pos][c_pos++] = M->elements[i][j][k][l];
-                    if (c_pos == c) {
-                        c_pos = 0;
-                        ++r_pos;
-                    }
-                }
-            }
-        }
-    }
+    // a permuted view is materialised first
+    Matrix4d* C = matrix_4d_contiguous(M);
+    Matrix* R = wrap_matrix(retain_storage(C->storage), sizes[0], sizes[1]);
+    free_matrix_4d(C);
 
     return R;
 }
 
+int matrix_reshape_to_4d_into(Matrix4d* R, const Matrix* M) {
+    if (check_count(matrix_4d_size(R), matrix_size(M)) != 0) {
+        return -1;
+    }
+
+    memcpy(R->data, M->data, sizeof(real) * matrix_size(M));
+
+    return 0;
+}
+
 Matrix4d* matrix_reshape_to_4d(const Matrix* M, int s1, int s2, int s3, int s4) {
     int sizes[] = {s1, s2, s3, s4};
-    if (s4 < 0) {
-        sizes[3] = M->rows * M->cols / (s1 * s2 * s3);
+    if (view_sizes(sizes, 4, matrix_size(M)) != 0) {
+        return NULL;
     }
 
-    Matrix4d* R = create_matrix_4d(sizes[0], sizes[1], sizes[2], sizes[3]);
-    int p1 = 0, p2 = 0, p3 = 0, p4 = 0;
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            R->elements[p1][p2][p3][p4] = M->elements[i][j];
-            ++p4;
-            if (p4 == sizes[3]) {
-                p4 = 0;
-                ++p3;
-            }
-
-            if (p3 == sizes[2]) {
-                p3 = 0;
-                ++p2;
-            }
+    return wrap_matrix_4d(retain_storage(M->storage), sizes[0], sizes[1], sizes[2], sizes[3], false);
+}
 
-            if (p2 == sizes[1]) {
-                p2 = 0;
-                ++p1;
-            } 
-        }
+int matrix_4d_flatten_into(Vector* v, const Matrix4d* M) {
+    if (check_vector_size(v, matrix_4d_size(M)) != 0) {
+        return -1;
     }
 
-    return R;
+    strided_copy(v->elements, M->data, M->sizes, M->strides);
+
+    return 0;
 }
 
 Vector* matrix_4d_flatten(const Matrix4d* M) {
-    Vector* v = create_vector(M->sizes[0] * M->sizes[1] * M->sizes[2] * M->sizes[3]);
-
-    int pos = 0;
-    for (int i = 0; i < M->sizes[0]; ++i) {
-        for (int j = 0; j < M->sizes[1]; ++j) {
-            for (int k = 0; k < M->sizes[2]; ++k) {
-                for (int l = 0; l < M->sizes[3]; ++l) {
-                    v->elements[pos++] = M->elements[i][j][k][l];
-                }
-            }
-        }
-    }
+    Matrix4d* C = matrix_4d_contiguous(M);
+    Vector* v = wrap_vector(retain_storage(C->storage), matrix_4d_size(M));
+    free_matrix_4d(C);
 
     return v;
 }
 
 double matrix_sum(const Matrix* M) {
     double sum = 0.0;
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            sum += M->elements[i][j];
-        }
+    const int n = matrix_size(M);
+    for (int i = 0; i < n; ++i) {
+        sum += M->data[i];
     }
 
     return sum;
 }
 
-Vector* vector_div_vector(const Vector* v, const Vector* u) {
+int vector_div_vector_into(Vector* r, const Vector* v, const Vector* u) {
     if (v->size != u->size) {
         fprintf(stderr, "Invalid size. %d and %d\n", v->size, u->size);
-        return NULL;
+        return -1;
     }
+    if (check_vector_size(r, v->size) != 0) {
+        return -1;
+    }
+
+    simd_kernels()->div(r->elements, v->elements, u->elements, v->size);
+
+    return 0;
+}
 
+Vector* vector_div_vector(const Vector* v, const Vector* u) {
     Vector* r = create_vector(v->size);
-    for (int i = 0; i < v->size; ++i) {
-        r->elements[i] = v->elements[i] / u->elements[i];
+    if (vector_div_vector_into(r, v, u) != 0) {
+        free_vector(r);
+        return NULL;
     }
 
     return r;
 }
 
-Matrix* matrix_add_vector(const Matrix* M, const Vector* v) {
+// N[i][j] = M[i][j] op v[j] for one of the simd kernels
+static int broadcast_rows_into(Matrix* N, const Matrix* M, const Vector* v,
+                               void (*op)(real*, const real*, const real*, int)) {
     if (M->cols != v->size) {
         fprintf(stderr, "Invalid size. (%d, %d) and %d\n", M->rows, M->cols, v->size);
-        return NULL;
+        return -1;
+    }
+    if (check_matrix_size(N, M->rows, M->cols) != 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < M->rows; ++i) {
+        op(N->elements[i], M->elements[i], v->elements, M->cols);
     }
 
+    return 0;
+}
+
+int matrix_add_vector_into(Matrix* N, const Matrix* M, const Vector* v) {
+    return broadcast_rows_into(N, M, v, simd_kernels()->add);
+}
+
+Matrix* matrix_add_vector(const Matrix* M, const Vector* v) {
     Matrix* N = create_matrix(M->rows, M->cols);
-    for (int i = 0; i < M->cols; ++i) {
-        for (int j = 0; j < M->rows; ++j) {
-            N->elements[j][i] = M->elements[j][i] + v->elements[i];
-        }
+    if (matrix_add_vector_into(N, M, v) != 0) {
+        free_matrix(N);
+        return NULL;
     }
 
     return N;
 }
 
-Matrix* matrix_add_matrix(const Matrix* M, const Matrix* N) {
+int matrix_add_matrix_into(Matrix* R, const Matrix* M, const Matrix* N) {
     if (M->rows != N->rows || M->cols != N->cols) {
         fprintf(stderr, "Invalid size. (%d, %d) and (%d, %d)\n", M->rows, M->cols, N->rows, N->cols);
-        return NULL;
+        return -1;
+    }
+    if (check_matrix_size(R, M->rows, M->cols) != 0) {
+        return -1;
     }
 
+    simd_kernels()->add(R->data, M->data, N->data, matrix_size(R));
+
+    return 0;
+}
+
+Matrix* matrix_add_matrix(const Matrix* M, const Matrix* N) {
     Matrix* R = create_matrix(M->rows, M->cols);
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            R->elements[i][j] = M->elements[i][j] + N->elements[i][j];
-        }
+    if (matrix_add_matrix_into(R, M, N) != 0) {
+        free_matrix(R);
+        return NULL;
     }
 
     return R;
 }
 
+int matrix_sub_vector_into(Matrix* N, const Matrix* M, const Vector* v) {
+    return broadcast_rows_into(N, M, v, simd_kernels()->sub);
+}
+
 Matrix* matrix_sub_vector(const Matrix* M, const Vector* v) {
-    if (M->cols != v->size) {
-        fprintf(stderr, "Invalid size. (%d, %d) and %d\n", M->rows, M->cols, v->size);
+    Matrix* N = create_matrix(M->rows, M->cols);
+    if (matrix_sub_vector_into(N, M, v) != 0) {
+        free_matrix(N);
         return NULL;
     }
 
+    return N;
+}
+
+int matrix_div_vector_into(Matrix* N, const Matrix* M, const Vector* v) {
+    return broadcast_rows_into(N, M, v, simd_kernels()->div);
+}
+
+Matrix* matrix_div_vector(const Matrix* M, const Vector* v) {
     Matrix* N = create_matrix(M->rows, M->cols);
-    for (int i = 0; i < M->cols; ++i) {
-        for (int j = 0; j < M->rows; ++j) {
-            N->elements[j][i] = M->elements[j][i] - v->elements[i];
-        }
+    if (matrix_div_vector_into(N, M, v) != 0) {
+        free_matrix(N);
+        return NULL;
     }
 
     return N;
 }
 
-Matrix* matrix_div_vector(const Matrix* M, const Vector* v) {
-    if (M->cols != v->size) {
-        fprintf(stderr, "Invalid size. (%d, %d) and %d\n", M->rows, M->cols, v->size);
-        return NULL;
+int vector_add_scalar_into(Vector* r, const Vector* V, double val) {
+    if (check_vector_size(r, V->size) != 0) {
+        return -1;
     }
 
-    Matrix* N = create_matrix(M->rows, M->cols);
-    for (int i = 0; i < M->cols; ++i) {
-        for (int j = 0; j < M->rows; ++j) {
-            N->elements[j][i] = M->elements[j][i] / v->elements[i];
-        }
+    for (int i = 0; i < V->size; ++i) {
+        r->elements[i] = V->elements[i] + val;
     }
 
-    return N;
+    return 0;
 }
 
 Vector* vector_add_scalar(const Vector* V, double val) {
     Vector* r = create_vector(V->size);
-    for (int i = 0; i < V->size; ++i) {
-        r->elements[i] = V->elements[i] + val;
-    }
+    vector_add_scalar_into(r, V, val);
 
     return r;
 }
 
+int pow_matrix_into(Matrix* N, const Matrix* M, double k) {
+    if (check_matrix_size(N, M->rows, M->cols) != 0) {
+        return -1;
+    }
+
+    simd_pow(simd_kernels(), N->data, M->data, k, matrix_size(M));
+
+    return 0;
+}
+
 Matrix* pow_matrix(Matrix* M, double k) {
     Matrix* N = create_matrix(M->rows, M->cols);
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; ++j) {
-            N->elements[i][j] = pow(M->elements[i][j], k);
-        }
-    }
+    pow_matrix_into(N, M, k);
 
     return N;
 }
 
+int sqrt_vector_into(Vector* r, const Vector* V) {
+    if (check_vector_size(r, V->size) != 0) {
+        return -1;
+    }
+
+    simd_kernels()->sqrt(r->elements, V->elements, V->size);
+
+    return 0;
+}
+
 Vector* sqrt_vector(const Vector* V) {
     Vector* r = create_vector(V->size);
-    for (int i = 0; i < V->size; ++i) {
-        r->elements[i] = sqrt(V->elements[i]);
-    }
+    sqrt_vector_into(r, V);
+
     return r;
 }
 
-Matrix* im2col(const Matrix4d* M, int filter_h, int filter_w, int stride, int pad) {
+int im2col_into(Matrix* R, const Matrix4d* M, int filter_h, int filter_w, int stride, int pad) {
     const int N = M->sizes[0];
     const int C = M->sizes[1]; 
     const int H = M->sizes[2];
@@ -728,117 +1252,215 @@ Matrix* im2col(const Matrix4d* M, int filter_h, int filter_w, int stride, int pa
     const int out_h = (H + 2 * pad - filter_h) / stride + 1; 
     const int out_w = (W + 2 * pad - filter_w) / stride + 1; 
 
-    Matrix4d* A = matrix_4d_pad(M, pad);  
-
-    Matrix* R = create_matrix(N * out_h * out_w, filter_h * filter_w * C);
+    if (check_matrix_size(R, N * out_h * out_w, filter_h * filter_w * C) != 0) {
+        return -1;
+    }
 
-    int rpos = 0, cpos = 0; 
+    // taps that fall into the padding are written as zeros instead of being
+    // read from a padded copy of M; going through the strides also takes
+    // permuted views as they are
+    const int* st = M->strides;
+    real* dst = R->data;
     for (int i = 0; i < N; ++i) {
-        for (int k = 0; k < out_h * stride; k += stride) {
-            for (int l = 0; l < out_w * stride; l += stride) {
+        for (int k = 0; k < out_h; ++k) {
+            const int h0 = k * stride - pad;
+            for (int l = 0; l < out_w; ++l) {
+                const int w0 = l * stride - pad;
+                // filter columns [n_lo, n_hi) lie inside the image
+                int n_lo = (w0 < 0) ? -w0 : 0;
+                int n_hi = (W - w0 < filter_w) ? W - w0 : filter_w;
+                if (n_lo > filter_w) {
+                    n_lo = filter_w;
+                }
+                if (n_hi < n_lo) {
+                    n_hi = n_lo;
+                }
+
+                if (st[3] == 1 && n_lo == 0 && n_hi == filter_w && h0 >= 0 && h0 + filter_h <= H) {
+                    // the whole window is inside the image
+                    for (int j = 0; j < C; ++j) {
+                        const real* src = M->data + (size_t)i * st[0] + (size_t)j * st[1] + (size_t)h0 * st[2] + w0;
+                        for (int m = 0; m < filter_h; ++m, src += st[2]) {
+                            for (int n = 0; n < filter_w; ++n) {
+                                *dst++ = src[n];
+                            }
+                        }
+                    }
+                    continue;
+                }
+
                 for (int j = 0; j < C; ++j) {
-                    for (int m = k; m < k + filter_w; ++m) {
-                        for (int n = l; n < l + filter_h; ++n) {
-                            R->elements[rpos][cpos] = A->elements[i][j][m][n]; 
-                            ++cpos;
-                            if (cpos == R->cols) {
-                                cpos = 0;
-                                ++rpos;
+                    const real* plane = M->data + (size_t)i * st[0] + (size_t)j * st[1];
+                    for (int m = 0; m < filter_h; ++m) {
+                        const int h = h0 + m;
+                        if (h < 0 || h >= H) {
+                            for (int n = 0; n < filter_w; ++n) {
+                                dst[n] = 0;
+                            }
+                            dst += filter_w;
+                            continue;
+                        }
+
+                        // filter rows are only a few values long, too short for memcpy
+                        const real* src = plane + (size_t)h * st[2];
+                        for (int n = 0; n < n_lo; ++n) {
+                            dst[n] = 0;
+                        }
+                        if (st[3] == 1) {
+                            for (int n = n_lo; n < n_hi; ++n) {
+                                dst[n] = src[w0 + n];
+                            }
+                        } else {
+                            for (int n = n_lo; n < n_hi; ++n) {
+                                dst[n] = src[(size_t)(w0 + n) * st[3]];
                             }
                         }
+                        for (int n = n_hi; n < filter_w; ++n) {
+                            dst[n] = 0;
+                        }
+                        dst += filter_w;
                     }
                 }
             }
         }
     }
 
-    free_matrix_4d(A);
-
-    return R;
+    return 0;
 }
 
-Matrix4d* col2im(const Matrix* M, int* sizes, int filter_h, int filter_w, int stride, int pad) {
-    const int N = sizes[0];
-    const int C = sizes[1]; 
-    const int H = sizes[2];
-    const int W = sizes[3];
+Matrix* im2col(const Matrix4d* M, int filter_h, int filter_w, int stride, int pad) {
+    const int out_h = (M->sizes[2] + 2 * pad - filter_h) / stride + 1; 
+    const int out_w = (M->sizes[3] + 2 * pad - filter_w) / stride + 1; 
 
-    const int out_h = (H + 2 * pad - filter_h) / stride + 1; 
-    const int out_w = (W + 2 * pad - filter_w) / stride + 1; 
-    Matrix4d* B = create_matrix_4d(N, C, H + 2 * pad + stride - 1, W + 2 * pad + stride - 1);
+    Matrix* R = create_matrix(M->sizes[0] * out_h * out_w, filter_h * filter_w * M->sizes[1]);
+    im2col_into(R, M, filter_h, filter_w, stride, pad);
 
-    int n = 0, c = 0, h = 0, w = 0;
-    for (int i = 0; i < M->rows; ++i) {
-        for (int j = 0; j < M->cols; j += (filter_h * filter_w)) {
-            double* buf = (double*)malloc(sizeof(double) * (filter_h * filter_w));
-            for (int k = j; k < j + (filter_h * filter_w); ++k) {
-                buf[k-j] = M->elements[i][k];
-            }
+    return R;
+}
 
-            int idx = 0;
-            for (int k = h; k < h + filter_h; ++k) {
-                for (int l = w; l < w + filter_w; ++l) {
-                    B->elements[n][c][k][l] += buf[idx++];
+typedef struct Col2im Col2im;
+struct Col2im {
+    real* dst;
+    const real* src;
+    int C, H, W;
+    int out_h, out_w;
+    int filter_h, filter_w;
+    int stride, pad;
+};
+
+// images [begin, end); each one only receives the rows of M built from it,
+// so the images can be summed up independently
+static void col2im_tasks(void* arg, int begin, int end) {
+    const Col2im* t = arg;
+    const size_t plane = (size_t)t->H * t->W;
+    const size_t row = (size_t)t->C * t->filter_h * t->filter_w;
+
+    for (int i = begin; i < end; ++i) {
+        real* img = t->dst + i * t->C * plane;
+        const real* src = t->src + (size_t)i * t->out_h * t->out_w * row;
+        memset(img, 0, sizeof(real) * t->C * plane);
+
+        for (int k = 0; k < t->out_h; ++k) {
+            const int h0 = k * t->stride - t->pad;
+            for (int l = 0; l < t->out_w; ++l) {
+                const int w0 = l * t->stride - t->pad;
+                // filter columns [n_lo, n_hi) lie inside the image, the rest
+                // of each window was padding and is dropped
+                int n_lo = (w0 < 0) ? -w0 : 0;
+                int n_hi = (t->W - w0 < t->filter_w) ? t->W - w0 : t->filter_w;
+                if (n_lo > t->filter_w) {
+                    n_lo = t->filter_w;
+                }
+                if (n_hi < n_lo) {
+                    n_hi = n_lo;
                 }
-            }
 
-            ++c;
-            if (c == C) {
-                c = 0;
-                w += stride;
+                for (int j = 0; j < t->C; ++j) {
+                    real* dst = img + j * plane;
+                    for (int m = 0; m < t->filter_h; ++m, src += t->filter_w) {
+                        const int h = h0 + m;
+                        if (h < 0 || h >= t->H) {
+                            continue;
+                        }
+                        real* d = dst + (size_t)h * t->W;
+                        for (int n = n_lo; n < n_hi; ++n) {
+                            d[w0 + n] += src[n];
+                        }
+                    }
+                }
             }
+        }
+    }
+}
 
-            if (w >= (out_w * stride)) {
-                w = 0;
-                h += stride;
-            }
+// below this many values of M the images are summed up on the calling thread
+#define COL2IM_PARALLEL_MIN (1 << 16)
 
-            if (h >= (out_h * stride)) {
-                h = 0;
-                ++n;
-            }
+int col2im_into(Matrix4d* R, const Matrix* M, int filter_h, int filter_w, int stride, int pad) {
+    const int N = R->sizes[0];
+    const int C = R->sizes[1]; 
+    const int H = R->sizes[2];
+    const int W = R->sizes[3];
 
-            free(buf);
-        }
+    const int out_h = (H + 2 * pad - filter_h) / stride + 1; 
+    const int out_w = (W + 2 * pad - filter_w) / stride + 1; 
+    if (M->rows != N * out_h * out_w || M->cols != C * filter_h * filter_w) {
+        fprintf(stderr, "Invalid size. (%d, %d) for image (%d, %d, %d, %d)\n", M->rows, M->cols, N, C, H, W);
+        return -1;
     }
-    
-    Matrix4d* R = create_matrix_4d(N, C, H, W);
-    for (int i = 0; i < B->sizes[0]; ++i) {
-        for (int j = 0; j < B->sizes[1]; ++j) {
-            for (int k = 0; k < B->sizes[2]; ++k) {
-                for (int l = 0; l < B->sizes[3]; ++l) {
-                    if ((k < pad) || ((R->sizes[2] + pad) <= k) || (l < pad) || ((R->sizes[3] + pad) <= l)) {
-                        continue;
-                    } 
-
-                    R->elements[i][j][k - pad][l - pad] = B->elements[i][j][k][l];
-                }
-            }
-        }
+    if (!matrix_4d_is_contiguous(R)) {
+        fprintf(stderr, "Invalid layout. col2im needs a contiguous image.\n");
+        return -1;
+    }
+
+    Col2im t = {R->data, M->data, C, H, W, out_h, out_w, filter_h, filter_w, stride, pad};
+    if ((size_t)M->rows * M->cols >= COL2IM_PARALLEL_MIN) {
+        parallel_for(N, col2im_tasks, &t);
+    } else {
+        col2im_tasks(&t, 0, N);
+    }
+
+    return 0;
+}
+
+Matrix4d* col2im(const Matrix* M, int* sizes, int filter_h, int filter_w, int stride, int pad) {
+    Matrix4d* R = create_matrix_4d(sizes[0], sizes[1], sizes[2], sizes[3]);
+    if (col2im_into(R, M, filter_h, filter_w, stride, pad) != 0) {
+        free_matrix_4d(R);
+        return NULL;
     }
 
-    free_matrix_4d(B);
-    
     return R;
 }
 
-Matrix4d* matrix_4d_pad(const Matrix4d* M, int pad) {
-    Matrix4d* R = create_matrix_4d(M->sizes[0], M->sizes[1], M->sizes[2] + 2 * pad, M->sizes[3] + 2 * pad);
+int matrix_4d_pad_into(Matrix4d* R, const Matrix4d* M, int pad) {
+    if (check_matrix_4d_size(R, M->sizes[0], M->sizes[1], M->sizes[2] + 2 * pad, M->sizes[3] + 2 * pad) != 0) {
+        return -1;
+    }
 
+    // both go through their strides, so either may be a permuted view
     for (int i = 0; i < R->sizes[0]; ++i) {
         for (int j = 0; j < R->sizes[1]; ++j) {
             for (int k = 0; k < R->sizes[2]; ++k) {
+                const bool inside = (pad <= k) && (k < M->sizes[2] + pad);
                 for (int l = 0; l < R->sizes[3]; ++l) {
-                    if ((k < pad) || ((M->sizes[2] + pad) <= k) || (l < pad) || ((M->sizes[3] + pad) <= l)) {
-                        R->elements[i][j][k][l] = 0;  
+                    if (inside && (pad <= l) && (l < M->sizes[3] + pad)) {
+                        *matrix_4d_at(R, i, j, k, l) = *matrix_4d_at(M, i, j, k - pad, l - pad);
                     } else {
-                        R->elements[i][j][k][l] = M->elements[i][j][k - pad][l - pad];
+                        *matrix_4d_at(R, i, j, k, l) = 0;
                     }
                 }
             }
         }
     }
 
+    return 0;
+}
+
+Matrix4d* matrix_4d_pad(const Matrix4d* M, int pad) {
+    Matrix4d* R = create_matrix_4d(M->sizes[0], M->sizes[1], M->sizes[2] + 2 * pad, M->sizes[3] + 2 * pad);
+    matrix_4d_pad_into(R, M, pad);
+
     return R;
 }
 
@@ -846,12 +1468,17 @@ Matrix4d* matrix_4d_pad(const Matrix4d* M, int pad) {
 // create batch
 //
 
+// images are loaded as double whatever the element type is
+static void copy_pixels(real* dst, const double* src, int n) {
+    for (int i = 0; i < n; ++i) {
+        dst[i] = src[i];
+    }
+}
+
 Matrix* create_image_batch(double** images, const int* batch_index, int size) {
     Matrix* M = create_matrix(size, NUM_OF_PIXELS);
     for (int i = 0; i < size; ++i) {
-        for (int j = 0; j < NUM_OF_PIXELS; ++j) {
-            M->elements[i][j] = images[batch_index[i]][j];
-        }
+        copy_pixels(M->elements[i], images[batch_index[i]], NUM_OF_PIXELS);
     }
 
     return M;
@@ -861,9 +1488,7 @@ Matrix4d* create_image_batch_4d(double**** images, const int* batch_index, int s
     Matrix4d* M = create_matrix_4d(size, 1, NUM_OF_ROWS, NUM_OF_COLS);
     for (int i = 0; i < size; ++i) {
         for (int j = 0; j < NUM_OF_ROWS; ++j) {
-            for (int k = 0; k < NUM_OF_COLS; ++k) {
-                M->elements[i][0][j][k] = images[batch_index[i]][0][j][k];
-            }
+            copy_pixels(M->elements[i][0][j], images[batch_index[i]][0][j], NUM_OF_COLS);
         }
     }
 
@@ -912,7 +1537,7 @@ void print_matrix_4d(const Matrix4d* M) {
             for (int k = 0; k < M->sizes[2]; ++k) {
                 printf("        [");
                 for (int l = 0; l < M->sizes[3]; ++l) {
-                    printf("%lf ", M->elements[i][j][k][l]);
+                    printf("%lf ", *matrix_4d_at(M, i, j, k, l));
                 }
                 printf("]\n");
             }
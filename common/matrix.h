@@ -2,24 +2,77 @@
 #define MATRIX_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <float.h>
+
+//
+// All tensors keep their values in one contiguous, row-major buffer (data)
+// aligned to MATRIX_ALIGNMENT bytes. `elements` is a pointer table into that
+// buffer so that elements[i][j] style access keeps working.
+//
+// The buffer belongs to a reference counted Storage. Reshapes do not copy:
+// they return a new tensor over the same storage (a view). free_* drops the
+// tensor's reference and the values go away with the last one, so a view and
+// its parent can be freed in any order, on any thread. Writes through a
+// view are seen by every tensor sharing the storage.
+//
+// matrix_4d_permute gives a view with reordered sizes and strides. When its
+// rows are no longer adjacent in memory it can only be passed to
+// matrix_4d_contiguous, the reshapes, matrix_4d_flatten, matrix_4d_pad and
+// the transposes, which all go through its strides.
+//
+// A Matrix4d view starts without an `elements` table (NULL), so that taking
+// one costs O(1) rather than a pointer per row. matrix_4d_elements builds
+// the table of a contiguous view on first use; tensors from create_* and
+// reuse_* have one from the start. Building it writes the view, so one view
+// must not be passed to matrix_4d_elements from two threads at once.
+//
+
+#define MATRIX_ALIGNMENT 64
+
+//
+// Element type of every tensor. Building with -DUSE_FLOAT (make FLOAT=1)
+// switches the whole library to single precision, which halves memory
+// traffic and doubles the number of lanes per SIMD register.
+//
+
+#ifdef USE_FLOAT
+typedef float real;
+#define REAL_MAX FLT_MAX
+#else
+typedef double real;
+#define REAL_MAX DBL_MAX
+#endif
+
+typedef struct Storage Storage;
+struct Storage {
+    int refs;
+    int size;
+};
 
 typedef struct Vector Vector;
 struct Vector {
     int size;
-    double* elements;
+    real* elements;
+    Storage* storage;
 };
 
 typedef struct Matrix Matrix;
 struct Matrix {
     int rows;
     int cols;
-    double** elements;
+    real* data;
+    real** elements;
+    Storage* storage;
 };
 
 typedef struct Matrix4d Matrix4d;
 struct Matrix4d {
     int sizes[4];
-    double **** elements;
+    int strides[4];
+    real* data;
+    real**** elements;
+    Storage* storage;
 };
 
 //
@@ -34,6 +87,18 @@ Matrix* create_matrix_from_file(const char* file_path, int rows, int cols);
 Matrix4d* create_matrix_4d(int s1, int s2, int s3, int s4);
 Matrix4d* create_matrix_4d_from_file(const char* file_path, int s1, int s2, int s3, int s4);
 
+//
+// reuse_* return the given buffer if it already has the requested shape
+// (contents are left as they are), otherwise free it and create a new one.
+// NULL is accepted, so a cache can be filled with M = reuse_matrix(M, r, c).
+// A reused view still shares its storage. New buffers always come from the
+// heap, even inside an arena scope.
+//
+
+Vector* reuse_vector(Vector* v, int size);
+Matrix* reuse_matrix(Matrix* M, int rows, int cols);
+Matrix4d* reuse_matrix_4d(Matrix4d* M, int s1, int s2, int s3, int s4);
+
 //
 // init
 //
@@ -56,19 +121,46 @@ void free_vector(Vector* v);
 void free_matrix(Matrix* M);
 void free_matrix_4d(Matrix4d* M);
 
+// M->elements, built first if M is a view without one; NULL for a view
+// whose rows are not adjacent. Not thread-safe for a view without a table.
+real**** matrix_4d_elements(Matrix4d* M);
+
+//
+// shape
+//
+
+int matrix_size(const Matrix* M);
+int matrix_4d_size(const Matrix4d* M);
+
 //
 // Operator
 //
+// The plain forms allocate their result. Each _into form writes the same
+// result into a caller supplied dst of the right shape instead and returns 0,
+// or -1 if a shape does not match. Elementwise and broadcast _into forms may
+// be passed one of their inputs as dst to work in place; products,
+// transposes, reshapes into another tensor, im2col, col2im and padding may
+// not alias.
+//
 
 Vector* add_vector(const Vector* a, const Vector* b);
 Vector* dot_vector_matrix(const Vector* v, const Matrix* M);
 Matrix* add_matrix(const Matrix* M, const Matrix* N);
 Matrix* dot_matrix(const Matrix* M, const Matrix* N);
+Matrix* dot_matrix_trans(const Matrix* M, bool trans_m, const Matrix* N, bool trans_n);
 Matrix* product_vector_matrix(const Vector* V, const Matrix* M);
 Matrix* product_matrix(const Matrix* M, const Matrix* N);
 Vector* product_vector(const Vector* V, const Vector* U);
 Matrix* transpose(const Matrix* M);
+
+// matrix_4d_transpose is matrix_4d_contiguous(matrix_4d_permute(...)), so a
+// permutation that keeps the values in order returns a view
+Matrix4d* matrix_4d_permute(const Matrix4d* M, int n1, int n2, int n3, int n4);
+Matrix4d* matrix_4d_contiguous(const Matrix4d* M);
+bool matrix_4d_is_contiguous(const Matrix4d* M);
 Matrix4d* matrix_4d_transpose(const Matrix4d* M, int n1, int n2, int n3, int n4);
+
+// views; a negative size is inferred from the others
 Matrix4d* vector_reshape_to_4d(const Vector* v, int s1, int s2, int s3, int s4);
 Matrix* matrix_reshape(const Matrix* M, int rows, int cols);
 Matrix* matrix_reshape_to_2d(const Matrix4d* M, int rows, int cols);
@@ -96,6 +188,41 @@ Matrix* im2col(const Matrix4d* M, int filter_h, int filter_w, int stride, int pa
 Matrix4d* col2im(const Matrix* M, int* sizes, int filter_h, int filter_w, int stride, int pad);
 Matrix4d* matrix_4d_pad(const Matrix4d* M, int pad);
 
+int add_vector_into(Vector* r, const Vector* a, const Vector* b);
+int dot_vector_matrix_into(Vector* r, const Vector* v, const Matrix* M);
+int dot_matrix_into(Matrix* A, const Matrix* M, const Matrix* N);
+int dot_matrix_trans_into(Matrix* A, const Matrix* M, bool trans_m, const Matrix* N, bool trans_n);
+int product_vector_matrix_into(Matrix* A, const Vector* V, const Matrix* M);
+int product_matrix_into(Matrix* A, const Matrix* M, const Matrix* N);
+int product_vector_into(Vector* R, const Vector* V, const Vector* U);
+int transpose_into(Matrix* N, const Matrix* M);
+int matrix_4d_transpose_into(Matrix4d* R, const Matrix4d* M, int n1, int n2, int n3, int n4);
+
+// copies, unlike the plain reshapes
+int vector_reshape_to_4d_into(Matrix4d* R, const Vector* v);
+int matrix_reshape_into(Matrix* R, const Matrix* M);
+int matrix_reshape_to_2d_into(Matrix* R, const Matrix4d* M);
+int matrix_reshape_to_4d_into(Matrix4d* R, const Matrix* M);
+int matrix_4d_flatten_into(Vector* v, const Matrix4d* M);
+
+int matrix_col_mean_into(Vector* V, const Matrix* M);
+int matrix_col_sum_into(Vector* v, const Matrix* M);
+int matrix_row_max_into(Vector* v, const Matrix* M);
+int vector_div_vector_into(Vector* r, const Vector* V, const Vector* U);
+int matrix_add_vector_into(Matrix* N, const Matrix* M, const Vector* V);
+int matrix_add_matrix_into(Matrix* R, const Matrix* M, const Matrix* N);
+int matrix_sub_vector_into(Matrix* N, const Matrix* M, const Vector* V);
+int matrix_div_vector_into(Matrix* N, const Matrix* M, const Vector* V);
+int vector_add_scalar_into(Vector* r, const Vector* V, double v);
+int pow_matrix_into(Matrix* N, const Matrix* M, double k);
+int sqrt_vector_into(Vector* r, const Vector* V);
+int scalar_matrix_into(Matrix* R, const Matrix* M, double k);
+
+// col2im_into takes the image sizes from R
+int im2col_into(Matrix* R, const Matrix4d* M, int filter_h, int filter_w, int stride, int pad);
+int col2im_into(Matrix4d* R, const Matrix* M, int filter_h, int filter_w, int stride, int pad);
+int matrix_4d_pad_into(Matrix4d* R, const Matrix4d* M, int pad);
+
 //
 // create batch
 //
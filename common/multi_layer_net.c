@@ -1,5 +1,6 @@
 #include "multi_layer_net.h"
 #include "function.h"
+#include "evaluate.h"
 #include "mnist.h"
 
 #include <stdio.h>
@@ -18,9 +19,9 @@ MultiLayerNet* create_multi_layer_net(
 ) {
     MultiLayerNet* net = malloc(sizeof(MultiLayerNet));
 
-    net->W = malloc(sizeof(Matrix*) * hidden_layer_num + 1);
-    net->b = malloc(sizeof(Vector*) * hidden_layer_num + 1);
-    net->A = malloc(sizeof(Affine*) * hidden_layer_num + 1);
+    net->W = malloc(sizeof(Matrix*) * (hidden_layer_num + 1));
+    net->b = malloc(sizeof(Vector*) * (hidden_layer_num + 1));
+    net->A = malloc(sizeof(Affine*) * (hidden_layer_num + 1));
     net->R = malloc(sizeof(Relu*) * hidden_layer_num);
 
     net->W[0] = create_matrix(input_size, hidden_size);
@@ -41,7 +42,14 @@ MultiLayerNet* create_multi_layer_net(
         }
     }
 
-    net->S = create_softmax_with_loss();
+    net->seq = create_sequential();
+    for (int i = 0; i < hidden_layer_num + 1; ++i) {
+        sequential_add(net->seq, &AFFINE_OPS, net->A[i]);
+        if (i != hidden_layer_num) {
+            sequential_add(net->seq, &RELU_OPS, net->R[i]);
+        }
+    }
+    net->S = net->seq->S;
     net->input_size = input_size;
     net->hidden_size = hidden_size;
     net->hidden_layer_num = hidden_layer_num;
@@ -81,15 +89,7 @@ MultiLayerNet* create_multi_layer_net(
 }
 
 void free_multi_layer_net(MultiLayerNet* net) {
-    for (int i = 0; i < net->hidden_layer_num + 1; ++i) {
-        free_affine(net->A[i]);
-
-        if (i != net->hidden_layer_num) {
-            free_relu(net->R[i]);
-        }
-    }
-
-    free_softmax_with_loss(net->S);
+    free_sequential(net->seq);
     free(net->W);
     free(net->b);
     free(net->A);
@@ -98,31 +98,8 @@ void free_multi_layer_net(MultiLayerNet* net) {
     free(net);
 }
 
-static Matrix* predict(const MultiLayerNet* net, const Matrix* X) {
-    Matrix* X_tmp = NULL;
-    for (int i = 0; i < net->hidden_layer_num + 1; ++i) {
-        Matrix* X1 = NULL;
-        if (i == 0) {
-            X1 = affine_forward(net->A[i], X);
-        } else {
-            X1 = affine_forward(net->A[i], X_tmp);
-            free_matrix(X_tmp);
-        }
-
-        if (i != net->hidden_layer_num) {
-            X_tmp = relu_forward(net->R[i], X1);
-            free_matrix(X1);
-        } else {
-            return X1;
-        }
-    }
-
-    return NULL;
-}
-
 double multi_layer_net_loss(MultiLayerNet* net, const Matrix* X, const Vector* t) {
-    Matrix* Y = predict(net, X);
-    const double v = softmax_with_loss_forward(net->S, Y, t); 
+    const double v = sequential_loss(net->seq, tensor_2d((Matrix*)X), t);
 
     double weight_decay = 0;
     for (int i = 0; i < net->hidden_layer_num + 1; ++i) {
@@ -133,47 +110,40 @@ double multi_layer_net_loss(MultiLayerNet* net, const Matrix* X, const Vector* t
         free_matrix(tmp);
     }
 
-    free_matrix(Y);
     return v + weight_decay;
 }
 
-void multi_layer_net_gradient(MultiLayerNet* net, const Matrix* X, const Vector* t) {
-    multi_layer_net_loss(net, X, t);
-
-    Matrix* X1 = softmax_with_loss_backward(net->S);
-    Matrix* X2 = affine_backward(net->A[net->hidden_layer_num], X1);  
-    free_matrix(X1);
+int multi_layer_net_gradient(MultiLayerNet* net, const Matrix* X, const Vector* t) {
+    return sequential_gradient(net->seq, tensor_2d((Matrix*)X), t);
+}
 
-    for (int i = net->hidden_layer_num - 1; i >= 0; --i) {
-        Matrix* X3 = relu_backward(net->R[i], X2);  
-        free_matrix(X2);
+typedef struct Batch Batch;
+struct Batch {
+    const MultiLayerNet* net;
+    double** images;
+};
 
-        X2 = affine_backward(net->A[i], X3);  
-        free_matrix(X3);
+static Matrix* score(const void* arg, int begin, int end) {
+    const Batch* b = arg;
+    Matrix* X = create_matrix(end - begin, NUM_OF_PIXELS);
+    for (int i = 0; i < X->rows; ++i) {
+        for (int j = 0; j < NUM_OF_PIXELS; ++j) {
+           X->elements[i][j] = b->images[begin + i][j];
+        } 
     }
 
-    free_matrix(X2);
+    Matrix* Y = sequential_predict(b->net->seq, tensor_2d(X), false).m;
+    free_matrix(X);
+
+    return Y;
 }
 
 double multi_layer_net_accuracy(const MultiLayerNet* net, double** images, uint8_t* labels, int size) {
-    Matrix* X = create_matrix(size, NUM_OF_PIXELS);
-    for (int i = 0; i < size; ++i) {
-        for (int j = 0; j < NUM_OF_PIXELS; ++j) {
-           X->elements[i][j] = images[i][j];
-        } 
+    const Batch b = {net, images};
+    const int cnt = eval_count_correct(score, &b, labels, size, true);
+    if (cnt < 0) {
+        return -1;
     }
 
-    Matrix* Y = predict(net, X);
-    int cnt = 0;
-    for (int i = 0; i < Y->rows; ++i) {
-        const int max_index = argmax(Y->elements[i], Y->cols);
-        if (max_index == labels[i]) {
-            ++cnt;
-        }
-    }
-
-    free_matrix(X);
-    free_matrix(Y);
-
     return (double) cnt / size;
 }
@@ -3,6 +3,7 @@
 
 #include "matrix.h"
 #include "layer.h"
+#include "sequential.h"
 
 typedef struct MultiLayerNet MultiLayerNet;
 struct MultiLayerNet {
@@ -11,6 +12,7 @@ struct MultiLayerNet {
     Affine**         A;
     Relu**           R;
     SoftmaxWithLoss* S;
+    Sequential*      seq;   // owns A, R and S, in the order they run
     int input_size;
     int hidden_size;
     int hidden_layer_num;
@@ -35,7 +37,7 @@ MultiLayerNet* create_multi_layer_net(
 );
 
 void free_multi_layer_net(MultiLayerNet* net);
-void multi_layer_net_gradient(MultiLayerNet* net, const Matrix* X, const Vector* t);
+int multi_layer_net_gradient(MultiLayerNet* net, const Matrix* X, const Vector* t);
 double multi_layer_net_loss(MultiLayerNet* net, const Matrix* X, const Vector* t);
 double multi_layer_net_accuracy(const MultiLayerNet* net, double** images, uint8_t* labels, int size);
 
@@ -1,5 +1,6 @@
 #include "multi_layer_net_extend.h"
 #include "function.h"
+#include "evaluate.h"
 #include "mnist.h"
 
 #include <stdlib.h>
@@ -18,9 +19,9 @@ MultiLayerNetExtend* create_multi_layer_net_extend(
 ) {
     MultiLayerNetExtend* net = malloc(sizeof(MultiLayerNetExtend));
 
-    net->W = malloc(sizeof(Matrix*) * hidden_layer_num + 1);
-    net->b = malloc(sizeof(Vector*) * hidden_layer_num + 1);
-    net->A = malloc(sizeof(Affine*) * hidden_layer_num + 1);
+    net->W = malloc(sizeof(Matrix*) * (hidden_layer_num + 1));
+    net->b = malloc(sizeof(Vector*) * (hidden_layer_num + 1));
+    net->A = malloc(sizeof(Affine*) * (hidden_layer_num + 1));
 
     net->gamma = malloc(sizeof(Vector*)             * hidden_layer_num);
     net->beta  = malloc(sizeof(Vector*)             * hidden_layer_num);
@@ -68,7 +69,20 @@ MultiLayerNetExtend* create_multi_layer_net_extend(
         }
     }
 
-    net->S = create_softmax_with_loss();
+    net->seq = create_sequential();
+    for (int i = 0; i < hidden_layer_num + 1; ++i) {
+        sequential_add(net->seq, &AFFINE_OPS, net->A[i]);
+        if (i == hidden_layer_num) {
+            break;
+        }
+
+        sequential_add(net->seq, &BATCH_NORMALIZATION_OPS, net->B[i]);
+        sequential_add(net->seq, &RELU_OPS, net->R[i]);
+        if (use_dropout) {
+            sequential_add(net->seq, &DROPOUT_OPS, net->D[i]);
+        }
+    }
+    net->S = net->seq->S;
     net->input_size = input_size;
     net->hidden_size = hidden_size;
     net->hidden_layer_num = hidden_layer_num;
@@ -107,91 +121,83 @@ MultiLayerNetExtend* create_multi_layer_net_extend(
     return net;
 }
 
-static Matrix* predict(const MultiLayerNetExtend* net, const Matrix* X) {
-    Matrix* X_tmp = NULL;
-    for (int i = 0; i < net->hidden_layer_num + 1; ++i) {
-        Matrix* X1 = NULL;
-        if (i == 0) {
-            X1 = affine_forward(net->A[i], X);
-        } else {
-            X1 = affine_forward(net->A[i], X_tmp);
-            free_matrix(X_tmp);
-        }
-
-        if (i != net->hidden_layer_num) {
-            Matrix* X2 = batch_normalization_forward(net->B[i], X1); 
-            X_tmp = relu_forward(net->R[i], X2);
-
-            if (net->use_dropout) {
-                Matrix* X3 = X_tmp;
-                X_tmp = dropout_forward(net->D[i], X3, true);
-                free_matrix(X3);
-            }
-
-            free_matrix(X1);
-            free_matrix(X2);
-        } else {
-            return X1;
-        }
+void free_multi_layer_net_extend(MultiLayerNetExtend* net) {
+    free_sequential(net->seq);
+    free(net->W);
+    free(net->b);
+    free(net->A);
+    free(net->gamma);
+    free(net->beta);
+    free(net->B);
+    free(net->R);
+    if (net->use_dropout) {
+        free(net->D);
     }
 
-    return NULL;
+    free(net);
 }
 
 double multi_layer_net_extend_loss(MultiLayerNetExtend* net, const Matrix* X, const Vector* t) {
-    Matrix* Y = predict(net, X);
-    const double v = softmax_with_loss_forward(net->S, Y, t); 
-
-    free(Y);
-    return v;
+    return sequential_loss(net->seq, tensor_2d((Matrix*)X), t);
 }
 
-void multi_layer_net_extend_gradient(MultiLayerNetExtend* net, const Matrix* X, const Vector* t) {
-    multi_layer_net_extend_loss(net, X, t);
-
-    Matrix* X1 = softmax_with_loss_backward(net->S);
-    Matrix* X2 = affine_backward(net->A[net->hidden_layer_num], X1);  
-    free_matrix(X1);
+int multi_layer_net_extend_gradient(MultiLayerNetExtend* net, const Matrix* X, const Vector* t) {
+    return sequential_gradient(net->seq, tensor_2d((Matrix*)X), t);
+}
 
-    for (int i = net->hidden_layer_num - 1; i >= 0; --i) {
-        if (net->use_dropout) {
-            Matrix* X_tmp = X2;
-            X2 = dropout_backward(net->D[i], X_tmp);
-            free_matrix(X_tmp); 
-        }
+typedef struct Batch Batch;
+struct Batch {
+    const MultiLayerNetExtend* net;
+    double** images;
+};
 
+static Matrix* score(const void* arg, int begin, int end) {
+    const Batch* b = arg;
+    Matrix* X = create_matrix(end - begin, NUM_OF_PIXELS);
+    for (int i = 0; i < X->rows; ++i) {
+        for (int j = 0; j < NUM_OF_PIXELS; ++j) {
+           X->elements[i][j] = b->images[begin + i][j];
+        } 
+    }
 
-        Matrix* X3 = relu_backward(net->R[i], X2);  
-        free_matrix(X2);
+    Matrix* Y = sequential_predict(b->net->seq, tensor_2d(X), false).m;
+    free_matrix(X);
 
-        Matrix* X4 = batch_normalization_backward(net->B[i], X3);
-        free_matrix(X3);
+    return Y;
+}
 
-        X2 = affine_backward(net->A[i], X4);  
-        free_matrix(X4);
+double multi_layer_net_extend_accuracy(const MultiLayerNetExtend* net, double** images, uint8_t* labels, int size) {
+    // running statistics and no dropout draws: the same scores for any
+    // chunking, and the layers are only read
+    const Batch b = {net, images};
+    const int cnt = eval_count_correct(score, &b, labels, size, true);
+    if (cnt < 0) {
+        return -1;
     }
 
-    free_matrix(X2);
+    return (double)cnt / size;
 }
 
-double multi_layer_net_extend_accuracy(const MultiLayerNetExtend* net, double** images, uint8_t* labels, int size) {
-    Matrix* X = create_matrix(size, NUM_OF_PIXELS);
-    for (int i = 0; i < size; ++i) {
-        for (int j = 0; j < NUM_OF_PIXELS; ++j) {
-           X->elements[i][j] = images[i][j];
-        } 
-    }
+MultiLayerNet* multi_layer_net_extend_freeze(const MultiLayerNetExtend* net) {
+    const int L = net->hidden_layer_num;
+
+    // no weight type: every weight is copied in below
+    MultiLayerNet* frozen = create_multi_layer_net(net->input_size, L, net->hidden_size, net->W[L]->cols, 0, -1, 0, 0);
+    for (int i = 0; i < L + 1; ++i) {
+        copy_matrix(frozen->W[i], net->W[i]);
+        copy_vector(frozen->b[i], net->b[i]);
+        if (i == L) {
+            break;
+        }
 
-    Matrix* Y = predict(net, X);
-    int cnt = 0;
-    for (int i = 0; i < Y->rows; ++i) {
-        const int max_index = argmax(Y->elements[i], Y->cols);
-        if (max_index == labels[i]) {
-            ++cnt;
+        batch_normalization_fold_into(net->B[i], frozen->W[i], frozen->b[i]);
+        // dropout at inference scales by 1 - ratio, which commutes with ReLU
+        if (net->use_dropout) {
+            const double keep = 1.0 - net->D[i]->dropout_ratio;
+            scalar_matrix(frozen->W[i], keep);
+            scalar_vector(frozen->b[i], keep);
         }
     }
 
-    free_matrix(X);
-    free_matrix(Y);
-    return (double)cnt / size;
+    return frozen;
 }
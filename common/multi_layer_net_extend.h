@@ -16,6 +16,7 @@ struct MultiLayerNetExtend {
     Relu**               R;
     Dropout**            D;
     SoftmaxWithLoss*     S;
+    Sequential*          seq;   // owns every layer and S, in the order they run
     int input_size;
     int hidden_size;
     int hidden_layer_num;
@@ -34,8 +35,17 @@ MultiLayerNetExtend* create_multi_layer_net_extend(
     double dropout_ratio
 );
 
-void multi_layer_net_extend_gradient(MultiLayerNetExtend* net, const Matrix* X, const Vector* t);
+void free_multi_layer_net_extend(MultiLayerNetExtend* net);
+int multi_layer_net_extend_gradient(MultiLayerNetExtend* net, const Matrix* X, const Vector* t);
 double multi_layer_net_extend_loss(MultiLayerNetExtend* net, const Matrix* X, const Vector* t);
 double multi_layer_net_extend_accuracy(const MultiLayerNetExtend* net, double** images, uint8_t* labels, int size);
 
+//
+// The net as it predicts outside training, as a MultiLayerNet: each
+// BatchNormalization, with its running statistics, and each Dropout scaling
+// are folded into the weights of the Affine before them. Its accuracy is
+// that of the net with two layers fewer per hidden layer to run.
+//
+MultiLayerNet* multi_layer_net_extend_freeze(const MultiLayerNetExtend* net);
+
 #endif
@@ -6,7 +6,7 @@
 // SGD
 //
 
-void SGD_update(double* x, double dx, double lr) {
+void SGD_update(real* x, real dx, double lr) {
     *x -= lr * dx;
 }
 
@@ -40,7 +40,7 @@ void SGD_update_matrix_4d(Matrix4d* A, const Matrix4d* dA, double lr) {
 // Momentum
 //
 
-void Momentum_update(double* x, double dx, double lr, double momentum, double* v) {
+void Momentum_update(real* x, real dx, double lr, double momentum, real* v) {
     *v = momentum * (*v) - lr * dx;
     *x += *v;
 }
@@ -63,7 +63,7 @@ void Momentum_update_matrix(Matrix* A, const Matrix* dA, double lr, double momen
 // AdaGrad
 //
 
-void AdaGrad_update(double* x, double dx, double lr, double* h) {
+void AdaGrad_update(real* x, real dx, double lr, real* h) {
     *h += dx * dx;
     *x -= lr * dx / (sqrt(*h) + 1e-7);
 }
@@ -86,7 +86,7 @@ void AdaGrad_update_matrix(Matrix* A, const Matrix* dA, double lr, Matrix* h) {
 // Adam
 //
 
-void Adam_update(double* x, double dx, double lr, double beta1, double beta2, double* m, double* v, int iter) {
+void Adam_update(real* x, real dx, double lr, double beta1, double beta2, real* m, real* v, int iter) {
     const double lr_t = lr * sqrt(1.0 - pow(beta2, iter + 1)) / (1.0 - pow(beta1, iter + 1)); 
 
     *m += (1 - beta1) * (dx - *m);
@@ -0,0 +1,160 @@
+#include "pool_max.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct PoolTask PoolTask;
+struct PoolTask {
+    int H, W;
+    int OH, OW;
+    int pool_h, pool_w;
+    int stride, pad;
+    const real* src;
+    real* dst;
+    uint8_t* arg_max;
+    const uint8_t* arg_max_in;
+};
+
+static bool set_shape(PoolTask* t, const Matrix4d* X, const Matrix4d* Y, int pool_h, int pool_w, int stride, int pad) {
+    t->H  = X->sizes[2];
+    t->W  = X->sizes[3];
+    t->OH = 1 + (t->H + 2 * pad - pool_h) / stride;
+    t->OW = 1 + (t->W + 2 * pad - pool_w) / stride;
+    t->pool_h = pool_h;
+    t->pool_w = pool_w;
+    t->stride = stride;
+    t->pad    = pad;
+
+    if (pool_h * pool_w > POOL_MAX_WINDOW || Y->sizes[0] != X->sizes[0] || Y->sizes[1] != X->sizes[1]
+            || Y->sizes[2] != t->OH || Y->sizes[3] != t->OW) {
+        fprintf(stderr, "Invalid size. X=(%d, %d, %d, %d), out=(%d, %d, %d, %d), pool=(%d, %d)\n",
+            X->sizes[0], X->sizes[1], X->sizes[2], X->sizes[3],
+            Y->sizes[0], Y->sizes[1], Y->sizes[2], Y->sizes[3], pool_h, pool_w);
+        return false;
+    }
+    if (!matrix_4d_is_contiguous(X) || !matrix_4d_is_contiguous(Y)) {
+        fprintf(stderr, "Invalid layout. Max pooling needs contiguous tensors.\n");
+        return false;
+    }
+
+    return true;
+}
+
+//
+// forward
+//
+
+// max of the taps [kh_lo, kh_hi) x [kw_lo, kw_hi) of the window at (h0, w0)
+static inline void window_max(const real* x, int W, int h0, int w0, int pool_w,
+        int kh_lo, int kh_hi, int kw_lo, int kw_hi, real* y, uint8_t* am) {
+    // a window that lies wholly in the padding pools to 0
+    if (kh_lo >= kh_hi || kw_lo >= kw_hi) {
+        *y = 0;
+        if (am != NULL) {
+            *am = 0;
+        }
+        return;
+    }
+
+    const int base = h0 * W + w0;
+    real max = x[base + kh_lo * W + kw_lo];
+    int idx = kh_lo * pool_w + kw_lo;
+    for (int kh = kh_lo; kh < kh_hi; ++kh) {
+        for (int kw = kw_lo; kw < kw_hi; ++kw) {
+            // selects rather than branches: which tap wins is close to random
+            const real v = x[base + kh * W + kw];
+            const bool gt = (max < v);
+            idx = gt ? kh * pool_w + kw : idx;
+            max = gt ? v : max;
+        }
+    }
+    *y = max;
+    if (am != NULL) {
+        *am = (uint8_t)idx;
+    }
+}
+
+// channel planes [begin, end) of all images
+static void forward_range(void* arg, int begin, int end) {
+    const PoolTask* t = arg;
+    // locals, since the uint8_t stores to arg_max may alias anything in *t
+    const int H = t->H, W = t->W, OH = t->OH, OW = t->OW;
+    const int pool_h = t->pool_h, pool_w = t->pool_w;
+    const int stride = t->stride, pad = t->pad;
+
+    for (int p = begin; p < end; ++p) {
+        const real* x = t->src + (size_t)p * H * W;
+        real* y = t->dst + (size_t)p * OH * OW;
+        uint8_t* am = (t->arg_max != NULL) ? t->arg_max + (size_t)p * OH * OW : NULL;
+
+        for (int oh = 0; oh < OH; ++oh) {
+            const int h0 = oh * stride - pad;
+            const int kh_lo = (h0 < 0) ? -h0 : 0;
+            const int kh_hi = (H - h0 < pool_h) ? H - h0 : pool_h;
+            for (int ow = 0; ow < OW; ++ow) {
+                const int w0 = ow * stride - pad;
+                const int kw_lo = (w0 < 0) ? -w0 : 0;
+                const int kw_hi = (W - w0 < pool_w) ? W - w0 : pool_w;
+                const int o = oh * OW + ow;
+                window_max(x, W, h0, w0, pool_w, kh_lo, kh_hi, kw_lo, kw_hi, &y[o], (am != NULL) ? &am[o] : NULL);
+            }
+        }
+    }
+}
+
+int pool_max_forward(Matrix4d* out, uint8_t* arg_max, const Matrix4d* X, int pool_h, int pool_w, int stride, int pad) {
+    PoolTask t = {0};
+    if (!set_shape(&t, X, out, pool_h, pool_w, stride, pad)) {
+        return -1;
+    }
+    t.src     = X->data;
+    t.dst     = out->data;
+    t.arg_max = arg_max;
+
+    parallel_for(X->sizes[0] * X->sizes[1], forward_range, &t);
+
+    return 0;
+}
+
+//
+// backward
+//
+
+// channel planes [begin, end) of all images; overlapping windows may pick
+// the same tap, so the gradient is added rather than stored
+static void backward_range(void* arg, int begin, int end) {
+    const PoolTask* t = arg;
+
+    for (int p = begin; p < end; ++p) {
+        const real* dy = t->src + (size_t)p * t->OH * t->OW;
+        const uint8_t* am = t->arg_max_in + (size_t)p * t->OH * t->OW;
+        real* dx = t->dst + (size_t)p * t->H * t->W;
+        memset(dx, 0, sizeof(real) * t->H * t->W);
+
+        for (int oh = 0; oh < t->OH; ++oh) {
+            for (int ow = 0; ow < t->OW; ++ow) {
+                const int idx = am[oh * t->OW + ow];
+                const int h = oh * t->stride - t->pad + idx / t->pool_w;
+                const int w = ow * t->stride - t->pad + idx % t->pool_w;
+                if (h >= 0 && h < t->H && w >= 0 && w < t->W) {
+                    dx[h * t->W + w] += dy[oh * t->OW + ow];
+                }
+            }
+        }
+    }
+}
+
+int pool_max_backward(Matrix4d* dx, const Matrix4d* dout, const uint8_t* arg_max, int pool_h, int pool_w, int stride, int pad) {
+    PoolTask t = {0};
+    if (!set_shape(&t, dx, dout, pool_h, pool_w, stride, pad)) {
+        return -1;
+    }
+    t.src        = dout->data;
+    t.dst        = dx->data;
+    t.arg_max_in = arg_max;
+
+    parallel_for(dx->sizes[0] * dx->sizes[1], backward_range, &t);
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef POOL_MAX_H
+#define POOL_MAX_H
+
+#include <stdint.h>
+
+#include "matrix.h"
+
+//
+// Max pooling on NCHW tensors, scanning each window in place.
+//
+// X / dx are (N, C, H, W) and out / dout are (N, C, OH, OW) with
+// OH = 1 + (H + 2 * pad - pool_h) / stride, likewise OW. Taps in the
+// padding never win. arg_max holds one byte per output, the position
+// kh * pool_w + kw of the maximum inside its window, so windows may have at
+// most 256 taps. Ties go to the first tap in row-major order. arg_max may
+// be NULL when no backward pass follows.
+//
+// Both return 0, or -1 if a shape does not match.
+//
+
+#define POOL_MAX_WINDOW 256
+
+int pool_max_forward(Matrix4d* out, uint8_t* arg_max, const Matrix4d* X, int pool_h, int pool_w, int stride, int pad);
+
+// dx gets each dout value added at the tap arg_max picked for it
+int pool_max_backward(Matrix4d* dx, const Matrix4d* dout, const uint8_t* arg_max, int pool_h, int pool_w, int stride, int pad);
+
+#endif
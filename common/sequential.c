@@ -0,0 +1,435 @@
+#include "sequential.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+//
+// Tensor
+//
+
+Tensor tensor_2d(Matrix* M) {
+    Tensor T = {TENSOR_2D, {.m = M}};
+    return T;
+}
+
+Tensor tensor_4d(Matrix4d* M) {
+    Tensor T = {TENSOR_4D, {.m4d = M}};
+    return T;
+}
+
+bool tensor_is_null(Tensor T) {
+    return (T.kind == TENSOR_2D) ? T.m == NULL : T.m4d == NULL;
+}
+
+void free_tensor(Tensor T) {
+    if (T.kind == TENSOR_2D) {
+        free_matrix(T.m);
+    } else {
+        free_matrix_4d(T.m4d);
+    }
+}
+
+static Tensor null_tensor(TensorKind kind) {
+    return (kind == TENSOR_2D) ? tensor_2d(NULL) : tensor_4d(NULL);
+}
+
+static bool check_kind(const LayerOps* ops, Tensor X, TensorKind kind) {
+    if (X.kind != kind) {
+        fprintf(stderr, "Invalid tensor. %s takes %s tensors.\n", ops->name, (kind == TENSOR_2D) ? "2d" : "4d");
+        return false;
+    }
+
+    return true;
+}
+
+static Param param(real* value, real* grad, int size) {
+    Param p = {value, grad, size};
+    return p;
+}
+
+//
+// Affine
+//
+
+static Tensor affine_op_forward(void* layer, Tensor X, bool train_flg) {
+    return (X.kind == TENSOR_4D) ? tensor_2d(affine_4d_forward(layer, X.m4d)) : tensor_2d(affine_forward(layer, X.m));
+}
+
+static Tensor affine_op_backward(void* layer, Tensor D, TensorKind x_kind) {
+    if (!check_kind(&AFFINE_OPS, D, TENSOR_2D)) {
+        return null_tensor(x_kind);
+    }
+
+    return (x_kind == TENSOR_4D) ? tensor_4d(affine_4d_backward(layer, D.m)) : tensor_2d(affine_backward(layer, D.m));
+}
+
+static int affine_op_params(void* layer, Param* params) {
+    const Affine* A = layer;
+    if (params != NULL) {
+        params[0] = param(A->W->data, (A->dW != NULL) ? A->dW->data : NULL, A->W->rows * A->W->cols);
+        params[1] = param(A->b->elements, (A->db != NULL) ? A->db->elements : NULL, A->b->size);
+    }
+
+    return 2;
+}
+
+static void affine_op_free(void* layer) {
+    free_affine(layer);
+}
+
+const LayerOps AFFINE_OPS = {
+    "Affine", affine_op_forward, affine_op_backward, affine_op_params, affine_op_free, NULL
+};
+
+//
+// Relu
+//
+
+static Tensor relu_op_forward(void* layer, Tensor X, bool train_flg) {
+    if (!check_kind(&RELU_OPS, X, TENSOR_2D)) {
+        return null_tensor(TENSOR_2D);
+    }
+
+    return tensor_2d(relu_forward(layer, X.m));
+}
+
+static Tensor relu_op_backward(void* layer, Tensor D, TensorKind x_kind) {
+    if (!check_kind(&RELU_OPS, D, TENSOR_2D)) {
+        return null_tensor(TENSOR_2D);
+    }
+
+    return tensor_2d(relu_backward(layer, D.m));
+}
+
+static int no_params(void* layer, Param* params) {
+    return 0;
+}
+
+static void relu_op_free(void* layer) {
+    free_relu(layer);
+}
+
+const LayerOps RELU_OPS = {
+    "Relu", relu_op_forward, relu_op_backward, no_params, relu_op_free, NULL
+};
+
+static Tensor relu_4d_op_forward(void* layer, Tensor X, bool train_flg) {
+    if (!check_kind(&RELU_4D_OPS, X, TENSOR_4D)) {
+        return null_tensor(TENSOR_4D);
+    }
+
+    return tensor_4d(relu_4d_forward(layer, X.m4d));
+}
+
+static Tensor relu_4d_op_backward(void* layer, Tensor D, TensorKind x_kind) {
+    if (!check_kind(&RELU_4D_OPS, D, TENSOR_4D)) {
+        return null_tensor(TENSOR_4D);
+    }
+
+    return tensor_4d(relu_4d_backward(layer, D.m4d));
+}
+
+static void relu_4d_op_free(void* layer) {
+    free_relu_4d(layer);
+}
+
+const LayerOps RELU_4D_OPS = {
+    "Relu4d", relu_4d_op_forward, relu_4d_op_backward, no_params, relu_4d_op_free, NULL
+};
+
+static bool is_relu(const LayerOps* ops) {
+    return ops == &RELU_OPS || ops == &RELU_4D_OPS;
+}
+
+//
+// BatchNormalization
+//
+
+static Tensor batch_normalization_op_forward(void* layer, Tensor X, bool train_flg) {
+    if (!check_kind(&BATCH_NORMALIZATION_OPS, X, TENSOR_2D)) {
+        return null_tensor(TENSOR_2D);
+    }
+
+    return tensor_2d(batch_normalization_forward(layer, X.m, train_flg));
+}
+
+static Tensor batch_normalization_op_backward(void* layer, Tensor D, TensorKind x_kind) {
+    if (!check_kind(&BATCH_NORMALIZATION_OPS, D, TENSOR_2D)) {
+        return null_tensor(TENSOR_2D);
+    }
+
+    return tensor_2d(batch_normalization_backward(layer, D.m));
+}
+
+static int batch_normalization_op_params(void* layer, Param* params) {
+    const BatchNormalization* B = layer;
+    if (params != NULL) {
+        params[0] = param(B->g->elements, (B->dg != NULL) ? B->dg->elements : NULL, B->g->size);
+        params[1] = param(B->b->elements, (B->db != NULL) ? B->db->elements : NULL, B->b->size);
+    }
+
+    return 2;
+}
+
+static void batch_normalization_op_free(void* layer) {
+    free_batch_normalization(layer);
+}
+
+const LayerOps BATCH_NORMALIZATION_OPS = {
+    "BatchNormalization", batch_normalization_op_forward, batch_normalization_op_backward,
+    batch_normalization_op_params, batch_normalization_op_free, NULL
+};
+
+//
+// Dropout
+//
+
+static Tensor dropout_op_forward(void* layer, Tensor X, bool train_flg) {
+    if (!check_kind(&DROPOUT_OPS, X, TENSOR_2D)) {
+        return null_tensor(TENSOR_2D);
+    }
+
+    return tensor_2d(dropout_forward(layer, X.m, train_flg));
+}
+
+static Tensor dropout_op_backward(void* layer, Tensor D, TensorKind x_kind) {
+    if (!check_kind(&DROPOUT_OPS, D, TENSOR_2D)) {
+        return null_tensor(TENSOR_2D);
+    }
+
+    return tensor_2d(dropout_backward(layer, D.m));
+}
+
+static void dropout_op_free(void* layer) {
+    free_dropout(layer);
+}
+
+const LayerOps DROPOUT_OPS = {
+    "Dropout", dropout_op_forward, dropout_op_backward, no_params, dropout_op_free, NULL
+};
+
+//
+// Convolution
+//
+
+static Tensor convolution_op_forward(void* layer, Tensor X, bool train_flg) {
+    if (!check_kind(&CONVOLUTION_OPS, X, TENSOR_4D)) {
+        return null_tensor(TENSOR_4D);
+    }
+
+    return tensor_4d(convolution_forward(layer, X.m4d));
+}
+
+static Tensor convolution_op_backward(void* layer, Tensor D, TensorKind x_kind) {
+    if (!check_kind(&CONVOLUTION_OPS, D, TENSOR_4D)) {
+        return null_tensor(TENSOR_4D);
+    }
+
+    return tensor_4d(convolution_backward(layer, D.m4d));
+}
+
+static int convolution_op_params(void* layer, Param* params) {
+    const Convolution* C = layer;
+    if (params != NULL) {
+        params[0] = param(C->W->data, (C->dW != NULL) ? C->dW->data : NULL, matrix_4d_size(C->W));
+        params[1] = param(C->b->elements, (C->db != NULL) ? C->db->elements : NULL, C->b->size);
+    }
+
+    return 2;
+}
+
+static void convolution_op_free(void* layer) {
+    free_convolution(layer);
+}
+
+// bias and ReLU fused into the kernel epilogue, with no ReLU mask to build
+static Tensor convolution_op_forward_relu(const void* layer, Tensor X) {
+    if (!check_kind(&CONVOLUTION_OPS, X, TENSOR_4D)) {
+        return null_tensor(TENSOR_4D);
+    }
+
+    return tensor_4d(convolution_relu_forward(layer, X.m4d));
+}
+
+const LayerOps CONVOLUTION_OPS = {
+    "Convolution", convolution_op_forward, convolution_op_backward, convolution_op_params,
+    convolution_op_free, convolution_op_forward_relu
+};
+
+//
+// Pooling
+//
+
+static Tensor pooling_op_forward(void* layer, Tensor X, bool train_flg) {
+    if (!check_kind(&POOLING_OPS, X, TENSOR_4D)) {
+        return null_tensor(TENSOR_4D);
+    }
+
+    return tensor_4d(pooling_forward(layer, X.m4d));
+}
+
+static Tensor pooling_op_backward(void* layer, Tensor D, TensorKind x_kind) {
+    if (!check_kind(&POOLING_OPS, D, TENSOR_4D)) {
+        return null_tensor(TENSOR_4D);
+    }
+
+    return tensor_4d(pooling_backward(layer, D.m4d));
+}
+
+static void pooling_op_free(void* layer) {
+    free_pooling(layer);
+}
+
+const LayerOps POOLING_OPS = {
+    "Pooling", pooling_op_forward, pooling_op_backward, no_params, pooling_op_free, NULL
+};
+
+//
+// Sequential
+//
+
+Sequential* create_sequential() {
+    Sequential* net = malloc(sizeof(Sequential));
+    net->size = 0;
+    net->capacity = 0;
+    net->layers = NULL;
+    net->S = create_softmax_with_loss();
+
+    return net;
+}
+
+void free_sequential(Sequential* net) {
+    for (int i = 0; i < net->size; ++i) {
+        net->layers[i].ops->free(net->layers[i].layer);
+    }
+    free_softmax_with_loss(net->S);
+    free(net->layers);
+
+    free(net);
+}
+
+int sequential_add(Sequential* net, const LayerOps* ops, void* layer) {
+    if (layer == NULL) {
+        // the layer's factory has already said why
+        fprintf(stderr, "Invalid layer. %s is NULL.\n", ops->name);
+        return -1;
+    }
+    if (net->size == net->capacity) {
+        const int capacity = (net->capacity == 0) ? 8 : net->capacity * 2;
+        SequentialLayer* layers = realloc(net->layers, sizeof(SequentialLayer) * capacity);
+        if (layers == NULL) {
+            fprintf(stderr, "Failed to grow Sequential to %d layers.\n", capacity);
+            return -1;
+        }
+        net->layers = layers;
+        net->capacity = capacity;
+    }
+
+    SequentialLayer* L = &net->layers[net->size++];
+    L->ops = ops;
+    L->layer = layer;
+    L->x_kind = TENSOR_2D;
+
+    return 0;
+}
+
+// every temporary is freed as soon as the next layer has read it; X is
+// never freed. With layers set, the kind of each layer's input is kept
+// there for backward.
+static Tensor forward(const Sequential* net, Tensor X, bool train_flg, SequentialLayer* layers) {
+    Tensor T = X;
+    bool owned = false;
+    for (int i = 0; i < net->size; ++i) {
+        const SequentialLayer* L = &net->layers[i];
+        if (layers != NULL) {
+            layers[i].x_kind = T.kind;
+        }
+
+        Tensor Y;
+        if (!train_flg && L->ops->forward_relu != NULL && i + 1 < net->size && is_relu(net->layers[i + 1].ops)) {
+            Y = L->ops->forward_relu(L->layer, T);
+            ++i;
+        } else {
+            Y = L->ops->forward(L->layer, T, train_flg);
+        }
+
+        if (owned) {
+            free_tensor(T);
+        }
+        T = Y;
+        owned = true;
+        if (tensor_is_null(T)) {
+            break;
+        }
+    }
+
+    return T;
+}
+
+Tensor sequential_predict(const Sequential* net, Tensor X, bool train_flg) {
+    return forward(net, X, train_flg, NULL);
+}
+
+// training forward and loss; -1 when a layer failed or the scores are not 2d
+static int forward_loss(Sequential* net, Tensor X, const Vector* t, double* loss) {
+    Tensor Y = forward(net, X, true, net->layers);
+    if (tensor_is_null(Y)) {
+        return -1;
+    }
+    if (Y.kind != TENSOR_2D) {
+        fprintf(stderr, "Invalid tensor. The scores of a Sequential must be 2d.\n");
+        free_tensor(Y);
+        return -1;
+    }
+
+    *loss = softmax_with_loss_forward(net->S, Y.m, t);
+    free_tensor(Y);
+
+    return 0;
+}
+
+double sequential_loss(Sequential* net, Tensor X, const Vector* t) {
+    double v = 0;
+    forward_loss(net, X, t, &v);
+
+    return v;
+}
+
+int sequential_gradient(Sequential* net, Tensor X, const Vector* t) {
+    if (!layer_grad_enabled()) {
+        fprintf(stderr, "Invalid state. Gradient tracking is off for this thread.\n");
+        return -1;
+    }
+
+    // a failed forward leaves the last batch's gradient in S, which must
+    // not be sent back through the layers
+    double loss;
+    if (forward_loss(net, X, t, &loss) != 0) {
+        return -1;
+    }
+
+    Tensor D = tensor_2d(softmax_with_loss_backward(net->S));
+    for (int i = net->size - 1; i >= 0 && !tensor_is_null(D); --i) {
+        const SequentialLayer* L = &net->layers[i];
+        Tensor dX = L->ops->backward(L->layer, D, L->x_kind);
+        free_tensor(D);
+        D = dX;
+    }
+    if (tensor_is_null(D)) {
+        return -1;
+    }
+
+    free_tensor(D);
+
+    return 0;
+}
+
+int sequential_params(const Sequential* net, Param* params) {
+    int n = 0;
+    for (int i = 0; i < net->size; ++i) {
+        const SequentialLayer* L = &net->layers[i];
+        n += L->ops->params(L->layer, (params != NULL) ? params + n : NULL);
+    }
+
+    return n;
+}
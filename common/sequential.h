@@ -0,0 +1,108 @@
+#ifndef SEQUENTIAL_H
+#define SEQUENTIAL_H
+
+#include <stdbool.h>
+
+#include "matrix.h"
+#include "layer.h"
+
+//
+// A net as a list of layers run one after another and a softmax with loss
+// on top. Every layer kind is driven through the same LayerOps table, so
+// anything done between two layers (freeing temporaries, fusing a layer
+// with the next one) is written once here instead of in every net.
+//
+// Layers pass tensors of either rank on; an Affine takes both, as in
+// affine_4d_forward.
+//
+
+typedef enum {
+    TENSOR_2D,
+    TENSOR_4D,
+} TensorKind;
+
+typedef struct Tensor Tensor;
+struct Tensor {
+    TensorKind kind;
+    union {
+        Matrix*   m;
+        Matrix4d* m4d;
+    };
+};
+
+Tensor tensor_2d(Matrix* M);
+Tensor tensor_4d(Matrix4d* M);
+bool tensor_is_null(Tensor T);
+void free_tensor(Tensor T);
+
+// a learnable array of size elements and its gradient, which is NULL
+// until the first backward
+typedef struct Param Param;
+struct Param {
+    real* value;
+    real* grad;
+    int   size;
+};
+
+typedef struct LayerOps LayerOps;
+struct LayerOps {
+    const char* name;
+
+    Tensor (*forward)(void* layer, Tensor X, bool train_flg);
+
+    // x_kind is the kind of the X of the forward this undoes
+    Tensor (*backward)(void* layer, Tensor D, TensorKind x_kind);
+
+    // writes the layer's parameters to params unless it is NULL; returns
+    // how many there are
+    int (*params)(void* layer, Param* params);
+
+    void (*free)(void* layer);
+
+    // inference only: relu(forward(X)) in one pass, or NULL. Run in place of
+    // this layer and a ReLU following it when train_flg is unset.
+    Tensor (*forward_relu)(const void* layer, Tensor X);
+};
+
+extern const LayerOps AFFINE_OPS;
+extern const LayerOps RELU_OPS;
+extern const LayerOps RELU_4D_OPS;
+extern const LayerOps BATCH_NORMALIZATION_OPS;
+extern const LayerOps DROPOUT_OPS;
+extern const LayerOps CONVOLUTION_OPS;
+extern const LayerOps POOLING_OPS;
+
+typedef struct SequentialLayer SequentialLayer;
+struct SequentialLayer {
+    const LayerOps* ops;
+    void*           layer;
+    TensorKind      x_kind;     // of the input of the last training forward
+};
+
+typedef struct Sequential Sequential;
+struct Sequential {
+    int size;
+    int capacity;
+    SequentialLayer* layers;
+    SoftmaxWithLoss* S;
+};
+
+Sequential* create_sequential();
+// frees every layer added to net as well
+void free_sequential(Sequential* net);
+// appends layer, which net owns from then on
+int sequential_add(Sequential* net, const LayerOps* ops, void* layer);
+
+// the scores for X, which stays the caller's. With train_flg unset, and
+// gradient tracking off, the layers are only read.
+Tensor sequential_predict(const Sequential* net, Tensor X, bool train_flg);
+double sequential_loss(Sequential* net, Tensor X, const Vector* t);
+// loss and backward through every layer, leaving each layer's gradients.
+// Returns 0, or -1 when a layer failed or gradient tracking is off, in
+// which case the gradients must not be applied.
+int sequential_gradient(Sequential* net, Tensor X, const Vector* t);
+
+// the parameters of every layer in order, as LayerOps.params
+int sequential_params(const Sequential* net, Param* params);
+
+#endif
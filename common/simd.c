@@ -0,0 +1,292 @@
+#include "simd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+#ifdef USE_FLOAT
+#define SQRT sqrtf
+#define POW  powf
+#else
+#define SQRT sqrt
+#define POW  pow
+#endif
+
+//
+// Every flavour is generated from the same loop bodies below. A flavour
+// provides its vector type, width in `real` lanes and load/store/arithmetic
+// ops; the tail that does not fill a whole vector falls back to plain C, so
+// each level produces bit-identical results to the scalar one.
+//
+
+#define DEFINE_BINARY_KERNEL(name, attr, VEC, W, LOAD, STORE, VOP, OP)          \
+    attr static void name(real* dst, const real* a, const real* b, int n) {       \
+        int i = 0;                                                                \
+        for (; i + W <= n; i += W) {                                              \
+            VEC x = LOAD(a + i);                                                  \
+            VEC y = LOAD(b + i);                                                  \
+            STORE(dst + i, VOP(x, y));                                            \
+        }                                                                         \
+        for (; i < n; ++i) {                                                      \
+            dst[i] = a[i] OP b[i];                                                \
+        }                                                                         \
+    }
+
+#define DEFINE_SCALE_KERNEL(name, attr, VEC, W, LOAD, STORE, SET1, VMUL)         \
+    attr static void name(real* dst, const real* a, real k, int n) {              \
+        const VEC vk = SET1(k);                                                   \
+        int i = 0;                                                                \
+        for (; i + W <= n; i += W) {                                              \
+            STORE(dst + i, VMUL(LOAD(a + i), vk));                                \
+        }                                                                         \
+        for (; i < n; ++i) {                                                      \
+            dst[i] = a[i] * k;                                                    \
+        }                                                                         \
+    }
+
+#define DEFINE_SQRT_KERNEL(name, attr, W, LOAD, STORE, VSQRT)                    \
+    attr static void name(real* dst, const real* a, int n) {                      \
+        int i = 0;                                                                \
+        for (; i + W <= n; i += W) {                                              \
+            STORE(dst + i, VSQRT(LOAD(a + i)));                                   \
+        }                                                                         \
+        for (; i < n; ++i) {                                                      \
+            dst[i] = SQRT(a[i]);                                                  \
+        }                                                                         \
+    }
+
+//
+// Bitmasks. A flavour's KEEP(x, &m) returns x with the lanes that are <= 0
+// zeroed and sets the low W bits of m to the lanes it kept; SELECT(x, b)
+// zeroes the lanes whose bit in b is clear. W divides 64, so the W bits of
+// a vector never straddle two words.
+//
+
+#define DEFINE_MASK_KERNELS(sfx, attr, VEC, W, LOAD, STORE, KEEP, SELECT)        \
+    attr static void relu_mask_##sfx(real* dst, uint64_t* bits, const real* a, int n) { \
+        memset(bits, 0, sizeof(uint64_t) * SIMD_MASK_WORDS(n));                   \
+        for (int i = 0; i + W <= n; i += W) {                                     \
+            uint64_t m;                                                           \
+            STORE(dst + i, KEEP(LOAD(a + i), &m));                                \
+            bits[i >> 6] |= m << (i & 63);                                        \
+        }                                                                         \
+        for (int i = n - n % W; i < n; ++i) {                                     \
+            const bool keep = !(a[i] <= 0);                                       \
+            bits[i >> 6] |= (uint64_t)keep << (i & 63);                           \
+            dst[i] = keep ? a[i] : 0;                                             \
+        }                                                                         \
+    }                                                                             \
+    attr static void select_mask_##sfx(real* dst, const real* a, const uint64_t* bits, int n) { \
+        int i = 0;                                                                \
+        for (; i + W <= n; i += W) {                                              \
+            STORE(dst + i, SELECT(LOAD(a + i), bits[i >> 6] >> (i & 63)));        \
+        }                                                                         \
+        for (; i < n; ++i) {                                                      \
+            dst[i] = ((bits[i >> 6] >> (i & 63)) & 1) ? a[i] : 0;                 \
+        }                                                                         \
+    }
+
+#define DEFINE_KERNELS(sfx, attr, VEC, W, LOAD, STORE, SET1, VADD, VSUB, VMUL, VDIV, VSQRT) \
+    DEFINE_BINARY_KERNEL(add_##sfx, attr, VEC, W, LOAD, STORE, VADD, +)           \
+    DEFINE_BINARY_KERNEL(sub_##sfx, attr, VEC, W, LOAD, STORE, VSUB, -)           \
+    DEFINE_BINARY_KERNEL(mul_##sfx, attr, VEC, W, LOAD, STORE, VMUL, *)           \
+    DEFINE_BINARY_KERNEL(div_##sfx, attr, VEC, W, LOAD, STORE, VDIV, /)           \
+    DEFINE_SCALE_KERNEL(scale_##sfx, attr, VEC, W, LOAD, STORE, SET1, VMUL)       \
+    DEFINE_SQRT_KERNEL(sqrt_##sfx, attr, W, LOAD, STORE, VSQRT)
+
+//
+// scalar
+//
+
+#define S_LOAD(p)      (*(p))
+#define S_STORE(p, x)  (*(p) = (x))
+#define S_SET1(x)      (x)
+#define S_ADD(x, y)    ((x) + (y))
+#define S_SUB(x, y)    ((x) - (y))
+#define S_MUL(x, y)    ((x) * (y))
+#define S_DIV(x, y)    ((x) / (y))
+#define S_SQRT(x)      SQRT(x)
+
+DEFINE_KERNELS(scalar, , real, 1, S_LOAD, S_STORE, S_SET1, S_ADD, S_SUB, S_MUL, S_DIV, S_SQRT)
+
+static inline real keep_scalar(real x, uint64_t* m) {
+    *m = !(x <= 0);
+    return *m ? x : 0;
+}
+
+static inline real select_scalar(real x, uint64_t b) {
+    return (b & 1) ? x : 0;
+}
+
+DEFINE_MASK_KERNELS(scalar, , real, 1, S_LOAD, S_STORE, keep_scalar, select_scalar)
+
+#ifdef SIMD_X86
+
+#define AVX2_ATTR   __attribute__((target("avx2")))
+#define AVX512_ATTR __attribute__((target("avx512f")))
+
+#ifdef USE_FLOAT
+
+DEFINE_KERNELS(avx2, AVX2_ATTR, __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps,
+               _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_div_ps, _mm256_sqrt_ps)
+
+DEFINE_KERNELS(avx512, AVX512_ATTR, __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_set1_ps,
+               _mm512_add_ps, _mm512_sub_ps, _mm512_mul_ps, _mm512_div_ps, _mm512_sqrt_ps)
+
+// NLE_UQ is !(x <= 0), so NaN is kept as in the scalar loop
+AVX2_ATTR static inline __m256 keep_avx2(__m256 x, uint64_t* m) {
+    const __m256 c = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_NLE_UQ);
+    *m = (uint64_t)_mm256_movemask_ps(c);
+    return _mm256_and_ps(x, c);
+}
+
+// spread the low 8 bits of b over the lanes, one bit per lane
+AVX2_ATTR static inline __m256 select_avx2(__m256 x, uint64_t b) {
+    const __m256i lane = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i c = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)(b & 0xff)), lane), lane);
+    return _mm256_and_ps(x, _mm256_castsi256_ps(c));
+}
+
+AVX512_ATTR static inline __m512 keep_avx512(__m512 x, uint64_t* m) {
+    const __mmask16 k = _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_NLE_UQ);
+    *m = k;
+    return _mm512_maskz_mov_ps(k, x);
+}
+
+AVX512_ATTR static inline __m512 select_avx512(__m512 x, uint64_t b) {
+    return _mm512_maskz_mov_ps((__mmask16)b, x);
+}
+
+DEFINE_MASK_KERNELS(avx2, AVX2_ATTR, __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, keep_avx2, select_avx2)
+DEFINE_MASK_KERNELS(avx512, AVX512_ATTR, __m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, keep_avx512, select_avx512)
+
+#else
+
+DEFINE_KERNELS(avx2, AVX2_ATTR, __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd,
+               _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd, _mm256_sqrt_pd)
+
+DEFINE_KERNELS(avx512, AVX512_ATTR, __m512d, 8, _mm512_loadu_pd, _mm512_storeu_pd, _mm512_set1_pd,
+               _mm512_add_pd, _mm512_sub_pd, _mm512_mul_pd, _mm512_div_pd, _mm512_sqrt_pd)
+
+// NLE_UQ is !(x <= 0), so NaN is kept as in the scalar loop
+AVX2_ATTR static inline __m256d keep_avx2(__m256d x, uint64_t* m) {
+    const __m256d c = _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_NLE_UQ);
+    *m = (uint64_t)_mm256_movemask_pd(c);
+    return _mm256_and_pd(x, c);
+}
+
+// spread the low 4 bits of b over the lanes, one bit per lane
+AVX2_ATTR static inline __m256d select_avx2(__m256d x, uint64_t b) {
+    const __m256i lane = _mm256_setr_epi64x(1, 2, 4, 8);
+    const __m256i c = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x((long long)(b & 0xf)), lane), lane);
+    return _mm256_and_pd(x, _mm256_castsi256_pd(c));
+}
+
+AVX512_ATTR static inline __m512d keep_avx512(__m512d x, uint64_t* m) {
+    const __mmask8 k = _mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_NLE_UQ);
+    *m = k;
+    return _mm512_maskz_mov_pd(k, x);
+}
+
+AVX512_ATTR static inline __m512d select_avx512(__m512d x, uint64_t b) {
+    return _mm512_maskz_mov_pd((__mmask8)b, x);
+}
+
+DEFINE_MASK_KERNELS(avx2, AVX2_ATTR, __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, keep_avx2, select_avx2)
+DEFINE_MASK_KERNELS(avx512, AVX512_ATTR, __m512d, 8, _mm512_loadu_pd, _mm512_storeu_pd, keep_avx512, select_avx512)
+
+#endif
+
+#endif
+
+//
+// dispatch
+//
+
+#define KERNELS(lv, nm, sfx) \
+    {lv, nm, add_##sfx, sub_##sfx, mul_##sfx, div_##sfx, scale_##sfx, sqrt_##sfx, relu_mask_##sfx, select_mask_##sfx}
+
+static const SimdKernels KERNEL_TABLE[SIMD_LEVEL_NUM] = {
+    KERNELS(SIMD_SCALAR, "scalar", scalar),
+#ifdef SIMD_X86
+    KERNELS(SIMD_AVX2,   "avx2",   avx2),
+    KERNELS(SIMD_AVX512, "avx512", avx512),
+#endif
+};
+
+static const SimdKernels* selected = &KERNEL_TABLE[SIMD_SCALAR];
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+
+static int cpu_supports(SimdLevel level) {
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    switch (level) {
+    case SIMD_SCALAR: return 1;
+    case SIMD_AVX2:   return __builtin_cpu_supports("avx2");
+    case SIMD_AVX512: return __builtin_cpu_supports("avx512f");
+    default:          return 0;
+    }
+#else
+    return level == SIMD_SCALAR;
+#endif
+}
+
+static void select_kernels() {
+    SimdLevel cap = SIMD_LEVEL_NUM - 1;
+    const char* env = getenv(SIMD_ENV);
+    if (env != NULL) {
+        int found = 0;
+        for (int l = 0; l < SIMD_LEVEL_NUM; ++l) {
+            if (KERNEL_TABLE[l].name != NULL && strcmp(env, KERNEL_TABLE[l].name) == 0) {
+                cap = l;
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown %s value \"%s\", ignored.\n", SIMD_ENV, env);
+        }
+    }
+
+    for (int l = cap; l >= 0; --l) {
+        if (KERNEL_TABLE[l].name != NULL && cpu_supports(l)) {
+            selected = &KERNEL_TABLE[l];
+            return;
+        }
+    }
+}
+
+const SimdKernels* simd_kernels() {
+    pthread_once(&select_once, select_kernels);
+    return selected;
+}
+
+const SimdKernels* simd_kernels_level(SimdLevel level) {
+    if (level < 0 || level >= SIMD_LEVEL_NUM || KERNEL_TABLE[level].name == NULL || !cpu_supports(level)) {
+        return NULL;
+    }
+
+    return &KERNEL_TABLE[level];
+}
+
+void simd_pow(const SimdKernels* K, real* dst, const real* a, double k, int n) {
+    if (k == 2.0) {
+        K->mul(dst, a, a, n);
+    } else if (k == 0.5) {
+        K->sqrt(dst, a, n);
+    } else if (k == 1.0) {
+        if (dst != a) {
+            memcpy(dst, a, sizeof(real) * n);
+        }
+    } else {
+        for (int i = 0; i < n; ++i) {
+            dst[i] = POW(a[i], k);
+        }
+    }
+}
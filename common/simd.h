@@ -0,0 +1,62 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+//
+// Elementwise kernels on contiguous arrays of `real`, in one flavour per
+// instruction set. The widest set the CPU supports is picked on first use;
+// DL_SIMD can lower it ("scalar", "avx2" or "avx512") for comparisons.
+// dst may alias either source.
+//
+
+#include "matrix.h"
+
+#define SIMD_ENV "DL_SIMD"
+
+// 64-bit words of a bitmask over n elements; bit i is bit i % 64 of word i / 64
+#define SIMD_MASK_WORDS(n) (((n) + 63) / 64)
+
+typedef enum {
+    SIMD_SCALAR = 0,
+    SIMD_AVX2,
+    SIMD_AVX512,
+    SIMD_LEVEL_NUM
+} SimdLevel;
+
+typedef struct SimdKernels SimdKernels;
+struct SimdKernels {
+    SimdLevel level;
+    const char* name;
+
+    // dst[i] = a[i] op b[i]
+    void (*add)(real* dst, const real* a, const real* b, int n);
+    void (*sub)(real* dst, const real* a, const real* b, int n);
+    void (*mul)(real* dst, const real* a, const real* b, int n);
+    void (*div)(real* dst, const real* a, const real* b, int n);
+
+    // dst[i] = a[i] * k
+    void (*scale)(real* dst, const real* a, real k, int n);
+
+    // dst[i] = sqrt(a[i])
+    void (*sqrt)(real* dst, const real* a, int n);
+
+    // bit i of bits = !(a[i] <= 0) and dst[i] = a[i] where it is set, 0
+    // where not: ReLU and its mask in one pass
+    void (*relu_mask)(real* dst, uint64_t* bits, const real* a, int n);
+
+    // dst[i] = a[i] where bit i of bits is set, 0 where not
+    void (*select_mask)(real* dst, const real* a, const uint64_t* bits, int n);
+};
+
+// kernels for the widest supported level (capped by DL_SIMD)
+const SimdKernels* simd_kernels();
+
+// kernels for a given level, or NULL if this CPU cannot run them
+const SimdKernels* simd_kernels_level(SimdLevel level);
+
+//
+// dst[i] = pow(a[i], k). k == 2 and k == 0.5 go through mul and sqrt, which
+// only differ from pow() on -0 and -inf for k == 0.5.
+//
+void simd_pow(const SimdKernels* K, real* dst, const real* a, double k, int n);
+
+#endif
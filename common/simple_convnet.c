@@ -2,6 +2,7 @@
 
 #include "mnist.h"
 #include "function.h"
+#include "evaluate.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,7 +40,15 @@ SimpleConvNet* create_simple_convnet(
     net->A[0] = create_affine(W1, b1);
     net->R    = create_relu();
     net->A[1] = create_affine(W2, b2);
-    net->S    = create_softmax_with_loss();
+
+    net->seq = create_sequential();
+    sequential_add(net->seq, &CONVOLUTION_OPS, net->C);
+    sequential_add(net->seq, &RELU_4D_OPS, net->R4d);
+    sequential_add(net->seq, &POOLING_OPS, net->P);
+    sequential_add(net->seq, &AFFINE_OPS, net->A[0]);
+    sequential_add(net->seq, &RELU_OPS, net->R);
+    sequential_add(net->seq, &AFFINE_OPS, net->A[1]);
+    net->S = net->seq->S;
 
     // init weight
     init_matrix_4d_random(net->C->W); 
@@ -55,16 +64,7 @@ SimpleConvNet* create_simple_convnet(
 }
 
 void free_simple_convnet(SimpleConvNet* net) {
-    free_convolution(net->C);
-    free_pooling(net->P);
-
-    free_relu_4d(net->R4d);
-    free_relu(net->R);
-
-    free_affine(net->A[0]);
-    free_affine(net->A[1]);
-
-    free_softmax_with_loss(net->S);
+    free_sequential(net->seq);
 
     free(net); 
 }
@@ -81,75 +81,47 @@ int simple_convnet_load_params(SimpleConvNet* net) {
     return 0; 
 }
 
-static Matrix* predict(const SimpleConvNet* net, Matrix4d* X) {
-    Matrix4d* T  = convolution_forward(net->C, X);
-    Matrix4d* T2 = relu_4d_forward(net->R4d, T);
-    Matrix4d* T3 = pooling_forward(net->P, T2);
-    Matrix*   T4 = affine_4d_forward(net->A[0], T3);
-    Matrix*   T5 = relu_forward(net->R, T4);
-    Matrix*   Y  = affine_forward(net->A[1], T5);
-
-    free_matrix_4d(T);
-    // free_matrix_4d(T2);
-    free_matrix_4d(T3);
-    free_matrix(T4);
-    free_matrix(T5);
-
-    return Y;
-}
-
 double simple_convnet_loss(SimpleConvNet* net, Matrix4d* X, const Vector* t) {
-    Matrix* Y = predict(net, X);
-    const double v = softmax_with_loss_forward(net->S, Y, t); 
-
-    free_matrix(Y);
-    return v;
+    return sequential_loss(net->seq, tensor_4d(X), t);
 }
 
-void simple_convnet_gradient(SimpleConvNet* net, Matrix4d* X, const Vector* t) {
-    simple_convnet_loss(net, X, t);
-
-    Matrix* T  = softmax_with_loss_backward(net->S);
-    Matrix* T2 = affine_backward(net->A[1], T);  
-    Matrix* T3 = relu_backward(net->R, T2);  
-    Matrix4d* T4 = affine_4d_backward(net->A[0], T3);  
-    Matrix4d* T5 = pooling_backward(net->P, T4);  
-    Matrix4d* T6 = relu_4d_backward(net->R4d, T5);  
-    Matrix4d* T7 = convolution_backward(net->C, T6);  
-
-    free_matrix(T);
-    free_matrix(T2);
-    free_matrix(T3);
-
-    free_matrix_4d(T4);
-    free_matrix_4d(T5);
-    free_matrix_4d(T6);
-    free_matrix_4d(T7);
+int simple_convnet_gradient(SimpleConvNet* net, Matrix4d* X, const Vector* t) {
+    return sequential_gradient(net->seq, tensor_4d(X), t);
 }
 
-double simple_convnet_accuracy(const SimpleConvNet* net, double**** images, uint8_t* labels, int size, int num_channels) {
-    Matrix4d* X = create_matrix_4d(size, num_channels, NUM_OF_ROWS, NUM_OF_COLS);
-    for (int i = 0; i < size; ++i) {
-        for (int j = 0; j < num_channels; ++j) {
+typedef struct Batch Batch;
+struct Batch {
+    const SimpleConvNet* net;
+    double**** images;
+    int num_channels;
+};
+
+static Matrix* score(const void* arg, int begin, int end) {
+    const Batch* b = arg;
+    Matrix4d* X = create_matrix_4d(end - begin, b->num_channels, NUM_OF_ROWS, NUM_OF_COLS);
+    for (int i = 0; i < X->sizes[0]; ++i) {
+        for (int j = 0; j < b->num_channels; ++j) {
             for (int k = 0; k < NUM_OF_ROWS; ++k) {
                 for (int l = 0; l < NUM_OF_COLS; ++l) {
-                    X->elements[i][j][k][l] = images[i][j][k][l];
+                    X->elements[i][j][k][l] = b->images[begin + i][j][k][l];
                 }
             }
         } 
     }
 
-    Matrix* Y = predict(net, X);
-    int cnt = 0;
-    for (int i = 0; i < Y->rows; ++i) {
-        const int max_index = argmax(Y->elements[i], Y->cols);
-        if (max_index == labels[i]) {
-            ++cnt;
-        }
-    }
-
+    // inference runs the convolution and its ReLU as one fused layer
+    Matrix* Y = sequential_predict(b->net->seq, tensor_4d(X), false).m;
     free_matrix_4d(X);
-    free_matrix(Y);
+
+    return Y;
+}
+
+double simple_convnet_accuracy(const SimpleConvNet* net, double**** images, uint8_t* labels, int size, int num_channels) {
+    const Batch b = {net, images, num_channels};
+    const int cnt = eval_count_correct(score, &b, labels, size, true);
+    if (cnt < 0) {
+        return -1;
+    }
 
     return (double) cnt / size;
 }
@@ -3,6 +3,7 @@
 
 #include "matrix.h"
 #include "layer.h"
+#include "sequential.h"
 
 typedef struct SimpleConvNet SimpleConvNet;
 struct SimpleConvNet {
@@ -12,6 +13,7 @@ struct SimpleConvNet {
     Relu*        R;
     Affine*      A[2];
     SoftmaxWithLoss* S;
+    Sequential*  seq;   // owns every layer and S, in the order they run
 };
 
 SimpleConvNet* create_simple_convnet(
@@ -30,7 +32,7 @@ SimpleConvNet* create_simple_convnet(
 void free_simple_convnet(SimpleConvNet* net);
 int simple_convnet_load_params(SimpleConvNet* net);
 double simple_convnet_loss(SimpleConvNet* net, Matrix4d* X, const Vector* t);
-void simple_convnet_gradient(SimpleConvNet* net, Matrix4d* X, const Vector* t);
+int simple_convnet_gradient(SimpleConvNet* net, Matrix4d* X, const Vector* t);
 double simple_convnet_accuracy(const SimpleConvNet* net, double**** images, uint8_t* labels, int size, int num_channels);
 
 #endif
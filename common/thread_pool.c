@@ -0,0 +1,140 @@
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define MAX_THREADS 256
+
+typedef struct ThreadPool ThreadPool;
+struct ThreadPool {
+    int num_threads;
+    pthread_mutex_t busy;
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation;
+    int pending;
+
+    ParallelFn fn;
+    void* arg;
+    int n;
+};
+
+static ThreadPool pool = {
+    .num_threads = 1,
+    .busy  = PTHREAD_MUTEX_INITIALIZER,
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done  = PTHREAD_COND_INITIALIZER,
+};
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+
+// set on pool workers, and on the caller while it runs its own range
+static __thread bool in_pool = false;
+
+static void run_range(int id) {
+    const int begin = (int)((long)pool.n * id / pool.num_threads);
+    const int end   = (int)((long)pool.n * (id + 1) / pool.num_threads);
+    if (begin < end) {
+        pool.fn(pool.arg, begin, end);
+    }
+}
+
+static void* worker_main(void* p) {
+    const int id = (int)(intptr_t)p;
+    in_pool = true;
+
+    unsigned long seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool.mutex);
+        while (pool.generation == seen) {
+            pthread_cond_wait(&pool.start, &pool.mutex);
+        }
+        seen = pool.generation;
+        pthread_mutex_unlock(&pool.mutex);
+
+        run_range(id);
+
+        pthread_mutex_lock(&pool.mutex);
+        if (--pool.pending == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+        pthread_mutex_unlock(&pool.mutex);
+    }
+
+    return NULL;
+}
+
+static int default_num_threads() {
+    const char* env = getenv(THREAD_POOL_ENV);
+    if (env != NULL && atoi(env) > 0) {
+        return atoi(env);
+    }
+
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cpus > 0) ? (int)cpus : 1;
+}
+
+static void init_pool() {
+    int n = default_num_threads();
+    if (n > MAX_THREADS) {
+        n = MAX_THREADS;
+    }
+
+    // thread 0 is whoever calls parallel_for
+    int started = 1;
+    for (int i = 1; i < n; ++i) {
+        pthread_t th;
+        if (pthread_create(&th, NULL, worker_main, (void*)(intptr_t)i) != 0) {
+            fprintf(stderr, "Failed to create worker thread %d.\n", i);
+            break;
+        }
+        pthread_detach(th);
+        ++started;
+    }
+
+    pool.num_threads = started;
+}
+
+int thread_pool_num_threads() {
+    pthread_once(&pool_once, init_pool);
+    return pool.num_threads;
+}
+
+void parallel_for(int n, ParallelFn fn, void* arg) {
+    if (n <= 0) {
+        return;
+    }
+
+    pthread_once(&pool_once, init_pool);
+    if (pool.num_threads == 1 || n == 1 || in_pool || pthread_mutex_trylock(&pool.busy) != 0) {
+        fn(arg, 0, n);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.mutex);
+    pool.fn = fn;
+    pool.arg = arg;
+    pool.n = n;
+    pool.pending = pool.num_threads - 1;
+    ++pool.generation;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.mutex);
+
+    in_pool = true;
+    run_range(0);
+    in_pool = false;
+
+    pthread_mutex_lock(&pool.mutex);
+    while (pool.pending > 0) {
+        pthread_cond_wait(&pool.done, &pool.mutex);
+    }
+    pthread_mutex_unlock(&pool.mutex);
+
+    pthread_mutex_unlock(&pool.busy);
+}
@@ -0,0 +1,24 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+//
+// A process-wide pool of worker threads, created on first use and kept
+// alive until exit. Its size is read from the DL_NUM_THREADS environment
+// variable, or the number of online CPUs when that is not set.
+//
+
+#define THREAD_POOL_ENV "DL_NUM_THREADS"
+
+typedef void (*ParallelFn)(void* arg, int begin, int end);
+
+int thread_pool_num_threads();
+
+//
+// Calls fn(arg, begin, end) over [0, n) split into one contiguous range per
+// thread. The split depends only on n and the pool size, so a given pool
+// size always hands the same ranges to fn. Calls made from inside fn (or
+// while another thread owns the pool) run inline on the calling thread.
+//
+void parallel_for(int n, ParallelFn fn, void* arg);
+
+#endif
@@ -3,6 +3,7 @@
 #include "optimizer.h"
 #include "mnist.h"
 #include "matrix.h"
+#include "arena.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -82,12 +83,16 @@ static void trainer_train_step(Trainer* trainer) {
     Matrix* x_batch  = create_image_batch(trainer->train_images, batch_index, trainer->mini_batch_size);
     Vector* t_batch  = create_label_batch(trainer->train_labels, batch_index, trainer->mini_batch_size);
 
-    multi_layer_net_gradient(trainer->net, x_batch, t_batch);
-
-    for (int i = 0; i < trainer->net->hidden_layer_num + 1; ++i) {
-        SGD_update_vector(trainer->net->b[i], trainer->net->A[i]->db, trainer->learning_rate);
-        SGD_update_matrix(trainer->net->W[i], trainer->net->A[i]->dW, trainer->learning_rate);
+    // the temporaries of gradient and update all go back at arena_end
+    arena_begin();
+    // a failed step is skipped; its gradients are not this batch's
+    if (multi_layer_net_gradient(trainer->net, x_batch, t_batch) == 0) {
+        for (int i = 0; i < trainer->net->hidden_layer_num + 1; ++i) {
+            SGD_update_vector(trainer->net->b[i], trainer->net->A[i]->db, trainer->learning_rate);
+            SGD_update_matrix(trainer->net->W[i], trainer->net->A[i]->dW, trainer->learning_rate);
+        }
     }
+    arena_end();
 
     if (trainer->current_iter % trainer->iter_per_epoch == 0) {
         const double train_acc = multi_layer_net_accuracy(trainer->net, trainer->train_images, trainer->train_labels, trainer->train_size);
@@ -174,17 +179,19 @@ static void trainer_extend_train_step(TrainerExtend* trainer) {
     Matrix* x_batch  = create_image_batch(trainer->train_images, batch_index, trainer->mini_batch_size);
     Vector* t_batch  = create_label_batch(trainer->train_labels, batch_index, trainer->mini_batch_size);
 
-    multi_layer_net_extend_gradient(trainer->net, x_batch, t_batch);
-
-    for (int i = 0; i < trainer->net->hidden_layer_num + 1; ++i) {
-        SGD_update_vector(trainer->net->b[i], trainer->net->A[i]->db, trainer->learning_rate);
-        SGD_update_matrix(trainer->net->W[i], trainer->net->A[i]->dW, trainer->learning_rate);
+    arena_begin();
+    if (multi_layer_net_extend_gradient(trainer->net, x_batch, t_batch) == 0) {
+        for (int i = 0; i < trainer->net->hidden_layer_num + 1; ++i) {
+            SGD_update_vector(trainer->net->b[i], trainer->net->A[i]->db, trainer->learning_rate);
+            SGD_update_matrix(trainer->net->W[i], trainer->net->A[i]->dW, trainer->learning_rate);
 
-        if (i != trainer->net->hidden_layer_num) {
-            SGD_update_vector(trainer->net->gamma[i], trainer->net->B[i]->dg, trainer->learning_rate);
-            SGD_update_vector(trainer->net->beta[i],  trainer->net->B[i]->db, trainer->learning_rate);
+            if (i != trainer->net->hidden_layer_num) {
+                SGD_update_vector(trainer->net->gamma[i], trainer->net->B[i]->dg, trainer->learning_rate);
+                SGD_update_vector(trainer->net->beta[i],  trainer->net->B[i]->db, trainer->learning_rate);
+            }
         }
     }
+    arena_end();
 
 
     if (trainer->current_iter % trainer->iter_per_epoch == 0) {
@@ -274,13 +281,7 @@ void free_simple_convnet_trainer(SimpleConvNetTrainer* trainer) {
     free(trainer);
 }
 
-static void simple_convnet_trainer_train_step(SimpleConvNetTrainer* trainer, int iter_num) {
-    int* batch_index = choice(trainer->train_size, trainer->mini_batch_size);
-    Matrix4d* x_batch = create_image_batch_4d(trainer->train_images, batch_index, trainer->mini_batch_size);
-    Vector* t_batch = create_label_batch(trainer->train_labels, batch_index, trainer->mini_batch_size);
-
-    simple_convnet_gradient(trainer->net, x_batch, t_batch);
-
+static void simple_convnet_trainer_update(SimpleConvNetTrainer* trainer, int iter_num) {
     switch (trainer->optimizer_type) {
     case SGD: {
         SGD_update_vector(trainer->net->C->b, trainer->net->C->db, trainer->learning_rate);
@@ -314,6 +315,18 @@ static void simple_convnet_trainer_train_step(SimpleConvNetTrainer* trainer, int
         break;
     }
     }
+}
+
+static void simple_convnet_trainer_train_step(SimpleConvNetTrainer* trainer, int iter_num) {
+    int* batch_index = choice(trainer->train_size, trainer->mini_batch_size);
+    Matrix4d* x_batch = create_image_batch_4d(trainer->train_images, batch_index, trainer->mini_batch_size);
+    Vector* t_batch = create_label_batch(trainer->train_labels, batch_index, trainer->mini_batch_size);
+
+    arena_begin();
+    if (simple_convnet_gradient(trainer->net, x_batch, t_batch) == 0) {
+        simple_convnet_trainer_update(trainer, iter_num);
+    }
+    arena_end();
 
     if (trainer->verbose) {
         const double loss = simple_convnet_loss(trainer->net, x_batch, t_batch);
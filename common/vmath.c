@@ -0,0 +1,135 @@
+#include "vmath.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+//
+// The functions are written once, in vmath_impl.h, on GCC vector types,
+// and that file is included once per level with the width of the level's
+// registers (16 bytes for the baseline SSE2/plain C, 32 for AVX2, 64 for
+// AVX-512). Elements past the end of the array are run through the same
+// code in a zero-padded vector, so every element goes down the same path.
+//
+// int <-> real conversions go through the 1.5 * 2^mantissa trick instead
+// of a conversion instruction, as AVX-512F has none for 64-bit integers.
+//
+
+#ifdef USE_FLOAT
+
+// integers as wide as real
+typedef int32_t  vmath_int;
+typedef uint32_t vmath_uint;
+
+#define MANT_BITS  23
+#define EXP_MASK   0xff
+#define EXP_BIAS   127
+#define MANT_MASK  0x007fffff
+#define ONE_BITS   0x3f800000
+#define SIGN_BITS  ((int32_t)0x80000000)
+#define REAL_MIN   FLT_MIN
+
+// 1.5 * 2^23: adding it rounds to an integer and leaves that integer in
+// the low mantissa bits
+#define SHIFT      0x1.8p23f
+
+#define LOG2E      1.44269502f
+#define LN2_HI     6.9313812256e-01f
+#define LN2_LO     9.0580006145e-06f
+#define SQRT2      1.41421356f
+
+// beyond EXP_HI exp overflows; below EXP_LO it would go subnormal
+#define EXP_HI     88.7228394f
+#define EXP_LO     -86.5f
+
+// tanh rounds to 1 beyond this
+#define TANH_ONE   10.0f
+
+#else
+
+typedef int64_t  vmath_int;
+typedef uint64_t vmath_uint;
+
+#define MANT_BITS  52
+#define EXP_MASK   0x7ff
+#define EXP_BIAS   1023
+#define MANT_MASK  0x000fffffffffffffLL
+#define ONE_BITS   0x3ff0000000000000LL
+#define SIGN_BITS  ((int64_t)0x8000000000000000ULL)
+#define REAL_MIN   DBL_MIN
+
+// 1.5 * 2^52: adding it rounds to an integer and leaves that integer in
+// the low mantissa bits
+#define SHIFT      0x1.8p52
+
+#define LOG2E      1.44269504088896338700e+00
+#define LN2_HI     6.93147180369123816490e-01
+#define LN2_LO     1.90821492927058770002e-10
+#define SQRT2      1.41421356237309504880
+
+#define EXP_HI     709.782712893383973
+#define EXP_LO     -708.0
+
+#define TANH_ONE   22.0
+
+#endif
+
+// m ? a : b lane by lane, m being the all-ones or all-zeros result of a
+// vector comparison
+#define SELECT(m, a, b) ((vr)(((m) & (vi)(a)) | (~(m) & (vi)(b))))
+
+#define SPLAT(x) ((vr){0} + (x))
+
+// 2^(n + bias - EXP_BIAS) from the k of exp_reduce; the shift drops the
+// SHIFT bits above the exponent field
+#define EXP_SCALE(k, bias) ((vr)(((vu)(k) + (bias)) << MANT_BITS))
+
+#define VMATH_INLINE static inline __attribute__((always_inline))
+
+#define VMATH_SFX   scalar
+#define VMATH_ATTR
+#define VMATH_BYTES 16
+#include "vmath_impl.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VMATH_X86
+
+#define VMATH_SFX   avx2
+#define VMATH_ATTR  __attribute__((target("avx2")))
+#define VMATH_BYTES 32
+#include "vmath_impl.h"
+
+#define VMATH_SFX   avx512
+#define VMATH_ATTR  __attribute__((target("avx512f")))
+#define VMATH_BYTES 64
+#include "vmath_impl.h"
+
+#endif
+
+//
+// dispatch
+//
+
+#define KERNELS(lv, nm, sfx) \
+    {lv, nm, exp_##sfx, log_##sfx, sigmoid_##sfx, tanh_##sfx}
+
+static const VmathKernels KERNEL_TABLE[SIMD_LEVEL_NUM] = {
+    KERNELS(SIMD_SCALAR, "scalar", scalar),
+#ifdef VMATH_X86
+    KERNELS(SIMD_AVX2,   "avx2",   avx2),
+    KERNELS(SIMD_AVX512, "avx512", avx512),
+#endif
+};
+
+const VmathKernels* vmath_kernels() {
+    return &KERNEL_TABLE[simd_kernels()->level];
+}
+
+const VmathKernels* vmath_kernels_level(SimdLevel level) {
+    if (simd_kernels_level(level) == NULL || KERNEL_TABLE[level].name == NULL) {
+        return NULL;
+    }
+
+    return &KERNEL_TABLE[level];
+}
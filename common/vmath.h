@@ -0,0 +1,47 @@
+#ifndef VMATH_H
+#define VMATH_H
+
+//
+// Elementwise exp, log, sigmoid and tanh on contiguous arrays of `real`,
+// evaluated as polynomials on whole vectors instead of one libm call per
+// element. One flavour per SIMD level, picked as in simd.h (DL_SIMD
+// applies). dst may alias a.
+//
+// Error against the correctly rounded result, measured over the ranges in
+// test_vmath.cpp:
+//
+//            double     float
+//   exp      2 ulp      2 ulp
+//   log      2 ulp      2 ulp
+//   sigmoid  3 ulp      3 ulp
+//   tanh     3 ulp      3 ulp
+//
+// Special values follow libm (NaN in, NaN out; exp(inf) = inf, log(0) =
+// -inf, log(x < 0) = NaN, ...) with one difference: exp of x below -708
+// (double) or -86.5 (float) is flushed to 0 rather than going subnormal,
+// and so is sigmoid of x below the negated bound.
+//
+
+#include "simd.h"
+
+typedef struct VmathKernels VmathKernels;
+struct VmathKernels {
+    SimdLevel level;
+    const char* name;
+
+    void (*exp)(real* dst, const real* a, int n);
+    void (*log)(real* dst, const real* a, int n);
+
+    // 1 / (1 + exp(-a[i]))
+    void (*sigmoid)(real* dst, const real* a, int n);
+
+    void (*tanh)(real* dst, const real* a, int n);
+};
+
+// kernels for the level simd_kernels() runs at
+const VmathKernels* vmath_kernels();
+
+// kernels for a given level, or NULL if this CPU cannot run them
+const VmathKernels* vmath_kernels_level(SimdLevel level);
+
+#endif
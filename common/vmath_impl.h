@@ -0,0 +1,204 @@
+//
+// Kernels of one level of vmath.c, which includes this file once per level
+// after setting VMATH_SFX (the name suffix), VMATH_ATTR (its target) and
+// VMATH_BYTES (its vector width). No include guard on purpose.
+//
+
+#define VMATH_CAT2(a, b) a##_##b
+#define VMATH_CAT(a, b)  VMATH_CAT2(a, b)
+#define VM(name)         VMATH_CAT(name, VMATH_SFX)
+#define VMATH_LANES      ((int)(VMATH_BYTES / sizeof(real)))
+
+#define vr          VM(vr)
+#define vi          VM(vi)
+#define vu          VM(vu)
+#define expm1_poly  VM(expm1_poly)
+#define exp_reduce  VM(exp_reduce)
+#define vexp        VM(vexp)
+#define vlog        VM(vlog)
+#define vsigmoid    VM(vsigmoid)
+#define vtanh       VM(vtanh)
+
+typedef real       vr __attribute__((vector_size(VMATH_BYTES)));
+typedef vmath_int  vi __attribute__((vector_size(VMATH_BYTES)));
+typedef vmath_uint vu __attribute__((vector_size(VMATH_BYTES)));
+
+//
+// exp
+//
+
+// e^r - 1 for |r| <= ln2 / 2: Taylor to r^13 (r^7 in float), whose
+// truncation stays below 0.1 ulp
+VMATH_INLINE void expm1_poly(vr* p, const vr* r) {
+    const vr x = *r;
+#ifdef USE_FLOAT
+    vr q = SPLAT(1.0f / 5040);
+    q = q * x + 1.0f / 720;
+    q = q * x + 1.0f / 120;
+    q = q * x + 1.0f / 24;
+    q = q * x + 1.0f / 6;
+    q = q * x + 1.0f / 2;
+#else
+    vr q = SPLAT(1.0 / 6227020800);
+    q = q * x + 1.0 / 479001600;
+    q = q * x + 1.0 / 39916800;
+    q = q * x + 1.0 / 3628800;
+    q = q * x + 1.0 / 362880;
+    q = q * x + 1.0 / 40320;
+    q = q * x + 1.0 / 5040;
+    q = q * x + 1.0 / 720;
+    q = q * x + 1.0 / 120;
+    q = q * x + 1.0 / 24;
+    q = q * x + 1.0 / 6;
+    q = q * x + 1.0 / 2;
+#endif
+    *p = x + (x * x) * q;
+}
+
+// x = n ln2 + r with n an integer and |r| <= ln2 / 2; k is n still added
+// to SHIFT, so its bits can be turned into 2^n
+VMATH_INLINE void exp_reduce(vr* k, vr* r, const vr* x) {
+    *k = *x * LOG2E + SHIFT;
+    const vr n = *k - SHIFT;
+    *r = (*x - n * LN2_HI) - n * LN2_LO;
+}
+
+// 2^n e^r. 2^(n - 1) is built and doubled afterwards, so n may reach the
+// top exponent + 1 that exp just below EXP_HI needs.
+VMATH_INLINE void vexp(vr* y, const vr* x) {
+    vr k, r, p;
+    exp_reduce(&k, &r, x);
+    expm1_poly(&p, &r);
+    const vr s = EXP_SCALE(k, EXP_BIAS - 1);
+    vr e = (s + s * p) * 2;
+
+    e = SELECT(*x > EXP_HI, SPLAT(INFINITY), e);
+    e = SELECT(*x < EXP_LO, SPLAT(0), e);
+    *y = e;
+}
+
+//
+// log
+//
+
+// x = 2^k m with m in [sqrt(2) / 2, sqrt(2)), then with f = m - 1 and
+// s = f / (2 + f), log(1 + f) = 2 atanh(s) = 2s + s R(s^2)
+VMATH_INLINE void vlog(vr* y, const vr* a) {
+    const vr x0 = *a;
+    const vi sub = x0 < REAL_MIN;
+#ifdef USE_FLOAT
+    const vr x = SELECT(sub, x0 * 0x1p23f, x0);
+#else
+    const vr x = SELECT(sub, x0 * 0x1p52, x0);
+#endif
+    const vi bits = (vi)x;
+    vi k = (vi)(((vu)bits >> MANT_BITS) & EXP_MASK) - EXP_BIAS + (sub & -MANT_BITS);
+    vr m = (vr)((bits & MANT_MASK) | ONE_BITS);
+    const vi big = m > SQRT2;
+    m = SELECT(big, m * 0.5f, m);
+    k = k - big;
+
+    const vr f = m - 1;
+    const vr s = f / (f + 2);
+    const vr z = s * s;
+    // 2 (z/3 + z^2/5 + ...), to z^4 (float) or z^9
+#ifdef USE_FLOAT
+    vr R = SPLAT(2.0f / 9);
+    R = R * z + 2.0f / 7;
+    R = R * z + 2.0f / 5;
+    R = R * z + 2.0f / 3;
+#else
+    vr R = SPLAT(2.0 / 19);
+    R = R * z + 2.0 / 17;
+    R = R * z + 2.0 / 15;
+    R = R * z + 2.0 / 13;
+    R = R * z + 2.0 / 11;
+    R = R * z + 2.0 / 9;
+    R = R * z + 2.0 / 7;
+    R = R * z + 2.0 / 5;
+    R = R * z + 2.0 / 3;
+#endif
+    R = R * z;
+
+    // f - s (f - R), rearranged as in fdlibm so the large terms cancel first
+    const vr hfsq = 0.5f * f * f;
+    const vr kd = (vr)((vi)SPLAT(SHIFT) + k) - SHIFT;
+    vr l = kd * LN2_HI + ((f - (hfsq - s * (hfsq + R))) + kd * LN2_LO);
+
+    l = SELECT(x0 == 0, SPLAT(-INFINITY), l);
+    l = SELECT(x0 == INFINITY, SPLAT(INFINITY), l);
+    l = SELECT(~(x0 >= 0), SPLAT(NAN), l);
+    *y = l;
+}
+
+//
+// sigmoid, tanh
+//
+
+VMATH_INLINE void vsigmoid(vr* y, const vr* x) {
+    const vr nx = -*x;
+    vr e;
+    vexp(&e, &nx);
+    *y = 1 / (1 + e);
+}
+
+// tanh |x| = em / (em + 2) with em = e^(2|x|) - 1 = 2^n p + (2^n - 1),
+// which keeps the relative accuracy of p near 0; the sign is put back last
+VMATH_INLINE void vtanh(vr* y, const vr* x) {
+    const vr a = (vr)((vi)*x & ~SIGN_BITS);
+    const vr a2 = SELECT(a > TANH_ONE, SPLAT(TANH_ONE), a) * 2;
+
+    vr k, r, p;
+    exp_reduce(&k, &r, &a2);
+    expm1_poly(&p, &r);
+    const vr s = EXP_SCALE(k, EXP_BIAS);
+    const vr em = s * p + (s - 1);
+    vr t = em / (em + 2);
+
+    t = SELECT(a > TANH_ONE, SPLAT(1), t);
+    *y = (vr)((vi)t | ((vi)*x & SIGN_BITS));
+}
+
+//
+// loops
+//
+
+#define DEFINE_VMATH_KERNEL(name, VOP)                                           \
+    VMATH_ATTR static void VM(name)(real* dst, const real* a, int n) {            \
+        int i = 0;                                                                \
+        for (; i + VMATH_LANES <= n; i += VMATH_LANES) {                          \
+            vr x;                                                                 \
+            memcpy(&x, a + i, sizeof(vr));                                        \
+            VOP(&x, &x);                                                          \
+            memcpy(dst + i, &x, sizeof(vr));                                      \
+        }                                                                         \
+        if (i < n) {                                                              \
+            vr x = {0};                                                           \
+            memcpy(&x, a + i, sizeof(real) * (n - i));                            \
+            VOP(&x, &x);                                                          \
+            memcpy(dst + i, &x, sizeof(real) * (n - i));                          \
+        }                                                                         \
+    }
+
+DEFINE_VMATH_KERNEL(exp, vexp)
+DEFINE_VMATH_KERNEL(log, vlog)
+DEFINE_VMATH_KERNEL(sigmoid, vsigmoid)
+DEFINE_VMATH_KERNEL(tanh, vtanh)
+
+#undef DEFINE_VMATH_KERNEL
+#undef vr
+#undef vi
+#undef vu
+#undef expm1_poly
+#undef exp_reduce
+#undef vexp
+#undef vlog
+#undef vsigmoid
+#undef vtanh
+#undef VMATH_LANES
+#undef VM
+#undef VMATH_CAT
+#undef VMATH_CAT2
+#undef VMATH_SFX
+#undef VMATH_ATTR
+#undef VMATH_BYTES
@@ -0,0 +1,112 @@
+#include "gtest/gtest.h"
+
+#include <thread>
+
+#include "utest_util.h"
+
+extern "C" {
+#include <arena.h>
+#include <matrix.h>
+}
+
+TEST(arena_alloc, success) {
+    void* h = arena_alloc(64, 64);
+    EXPECT_FALSE(arena_owns(h));
+    arena_free(h);
+
+    arena_begin();
+    void* a = arena_alloc(100, 64);
+    void* b = arena_alloc(100, 64);
+    EXPECT_TRUE(arena_owns(a));
+    EXPECT_TRUE(arena_owns(b));
+    EXPECT_EQ(0u, (uintptr_t)a % 64);
+    EXPECT_EQ(0u, (uintptr_t)b % 64);
+    EXPECT_NE(a, b);
+    arena_free(a);
+    arena_end();
+}
+
+TEST(arena_begin, nested) {
+    arena_begin();
+    void* a = arena_alloc(16, 16);
+    arena_begin();
+    arena_end();
+    // the inner end must not hand a's memory out again
+    void* b = arena_alloc(16, 16);
+    EXPECT_NE(a, b);
+    arena_end();
+
+    arena_begin();
+    EXPECT_EQ(a, arena_alloc(16, 16));
+    arena_end();
+}
+
+TEST(arena_suspend, success) {
+    arena_begin();
+    Matrix* M = create_matrix(3, 4);
+    EXPECT_TRUE(arena_owns(M));
+    free_matrix(M);
+
+    Matrix* cache = reuse_matrix(NULL, 3, 4);
+    EXPECT_FALSE(arena_owns(cache));
+    EXPECT_FALSE(arena_owns(cache->elements));
+
+    arena_suspend();
+    Matrix* N = create_matrix(2, 2);
+    arena_resume();
+    EXPECT_FALSE(arena_owns(N));
+    arena_end();
+
+    free_matrix(cache);
+    free_matrix(N);
+}
+
+TEST(arena_begin, view_elements_outlive_scope) {
+    // a long-lived view whose table is built inside a scope
+    Matrix4d* M = create_matrix_4d(3, 1, 4, 5);
+    Matrix4d* V = matrix_4d_permute(M, 1, 0, 2, 3);
+
+    arena_begin();
+    real**** e = matrix_4d_elements(V);
+    ASSERT_NE(nullptr, e);
+    EXPECT_FALSE(arena_owns(e));
+    arena_end();
+
+    EXPECT_EQ(M->data + 2 * 20 + 3 * 5 + 4, &V->elements[0][2][3][4]);
+
+    free_matrix_4d(V);
+    free_matrix_4d(M);
+}
+
+TEST(arena_free, other_thread) {
+    // the thread freeing a block has no chunks of the one that made it
+    arena_begin();
+    Matrix* A = create_matrix(3, 4);
+    arena_suspend();
+    Matrix* H = create_matrix(3, 4);
+    arena_resume();
+
+    std::thread t([A, H] {
+        EXPECT_FALSE(arena_owns(A));
+        free_matrix(A);
+        free_matrix(H);
+    });
+    t.join();
+    arena_end();
+}
+
+TEST(arena_stats, success) {
+    arena_reset_stats();
+    arena_free(arena_alloc(32, 16));
+    arena_begin();
+    arena_alloc(32, 16);
+    arena_alloc(32, 16);
+    arena_end();
+
+    const ArenaStats s = arena_stats();
+    EXPECT_EQ(1, s.heap_allocs);
+    EXPECT_EQ(2, s.arena_allocs);
+    EXPECT_LE(64u, s.peak_bytes);
+    EXPECT_LE(s.peak_bytes, s.capacity);
+    EXPECT_LE(1, s.chunks);
+}
@@ -0,0 +1,129 @@
+#include "gtest/gtest.h"
+
+#include "utest_util.h"
+
+#include <vector>
+
+extern "C" {
+#include <buffer_pool.h>
+#include <layer.h>
+}
+
+TEST(buffer_pool_alloc, success) {
+    buffer_pool_trim();
+    buffer_pool_reset_stats();
+
+    void* p = buffer_pool_alloc(1000, 64);
+    EXPECT_EQ(0u, (uintptr_t)p % 64);
+    buffer_pool_free(p);
+
+    // same size and alignment: the freed block comes back
+    EXPECT_EQ(p, buffer_pool_alloc(1000, 64));
+    void* q = buffer_pool_alloc(1000, 8);
+    EXPECT_NE(p, q);
+
+    BufferPoolStats s = buffer_pool_stats();
+    EXPECT_EQ(1, s.hits);
+    EXPECT_EQ(2, s.misses);
+    EXPECT_EQ(0, s.cached_blocks);
+
+    buffer_pool_free(p);
+    buffer_pool_free(q);
+    s = buffer_pool_stats();
+    EXPECT_EQ(2, s.cached_blocks);
+    EXPECT_EQ(2000u, s.cached_bytes);
+}
+
+TEST(buffer_pool_trim, success) {
+    buffer_pool_free(buffer_pool_alloc(24, 8));
+    EXPECT_LT(0, buffer_pool_stats().cached_blocks);
+
+    buffer_pool_trim();
+    const BufferPoolStats s = buffer_pool_stats();
+    EXPECT_EQ(0, s.cached_blocks);
+    EXPECT_EQ(0u, s.cached_bytes);
+}
+
+TEST(buffer_pool_stats, steady_state) {
+    Relu* R = create_relu();
+    Matrix* X = create_matrix(8, 5);
+    init_matrix_rand(X);
+
+    for (int i = 0; i < 3; ++i) {
+        if (i == 2) {
+            buffer_pool_reset_stats();
+        }
+        Matrix* Y = relu_forward(R, X);
+        Matrix* D = relu_backward(R, Y);
+        free_matrix(Y);
+        free_matrix(D);
+    }
+
+    // once the first iteration has filled the pool, nothing goes to malloc
+    const BufferPoolStats s = buffer_pool_stats();
+    EXPECT_EQ(0, s.misses);
+    EXPECT_LT(0, s.hits);
+
+    free_matrix(X);
+    free_relu(R);
+}
+
+TEST(buffer_pool_set_limit, evicts_least_recent) {
+    buffer_pool_trim();
+    buffer_pool_set_limit(3100);
+
+    void* p[4];
+    for (int i = 0; i < 4; ++i) {
+        p[i] = buffer_pool_alloc(1000 + 8 * i, 8);
+    }
+    for (int i = 0; i < 4; ++i) {
+        buffer_pool_free(p[i]);
+    }
+
+    // the cap is on every thread together; the size freed first went back
+    BufferPoolStats s = buffer_pool_stats();
+    EXPECT_EQ(3, s.cached_blocks);
+    EXPECT_GE(3100u, s.total_cached_bytes);
+    buffer_pool_reset_stats();
+    buffer_pool_free(buffer_pool_alloc(1000, 8));
+    buffer_pool_free(buffer_pool_alloc(1024, 8));
+    s = buffer_pool_stats();
+    EXPECT_EQ(1, s.misses);
+    EXPECT_EQ(1, s.hits);
+
+    buffer_pool_set_limit((size_t)256 << 20);
+    buffer_pool_trim();
+}
+
+TEST(buffer_pool_free, size_churn) {
+    buffer_pool_trim();
+
+    // more distinct sizes over time than the pool has classes
+    for (int round = 0; round < 4; ++round) {
+        // a long run on one size leaves the previous round's sizes idle
+        for (int i = 0; i < 5000; ++i) {
+            buffer_pool_free(buffer_pool_alloc(7, 8));
+        }
+
+        std::vector<void*> p;
+        for (int i = 0; i < 200; ++i) {
+            p.push_back(buffer_pool_alloc(8 * (round * 200 + i + 1), 8));
+        }
+        for (void* q : p) {
+            buffer_pool_free(q);
+        }
+    }
+
+    // only the last round's sizes and the busy one are still cached
+    BufferPoolStats s = buffer_pool_stats();
+    EXPECT_EQ(201, s.cached_blocks);
+
+    buffer_pool_reset_stats();
+    buffer_pool_free(buffer_pool_alloc(8 * (3 * 200 + 1), 8));
+    buffer_pool_free(buffer_pool_alloc(8, 8));
+    s = buffer_pool_stats();
+    EXPECT_EQ(1, s.hits);
+    EXPECT_EQ(1, s.misses);
+
+    buffer_pool_trim();
+}
@@ -0,0 +1,139 @@
+#include "gtest/gtest.h"
+
+#include "utest_util.h"
+
+extern "C" {
+#include <conv_direct.h>
+#include <layer.h>
+}
+
+struct ConvCase {
+    int N, C, H, W, FN, FH, FW, stride, pad;
+};
+
+// odd sizes, padding wider than the window offset and strides that skip
+// the last column, so every clipping branch runs
+static const ConvCase CASES[] = {
+    {2, 1, 7, 9, 5, 3, 3, 1, 1},
+    {3, 3, 8, 8, 4, 3, 3, 2, 1},
+    {2, 2, 6, 5, 6, 3, 2, 1, 2},
+    {1, 4, 5, 5, 9, 1, 1, 1, 0},
+    {2, 3, 9, 7, 3, 5, 5, 3, 2},
+};
+
+static Matrix4d* random_4d(int s1, int s2, int s3, int s4) {
+    Matrix4d* M = create_matrix_4d(s1, s2, s3, s4);
+    init_matrix_4d_random(M);
+    return M;
+}
+
+static void expect_4d_near(const Matrix4d* E, const Matrix4d* A) {
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_EQ(E->sizes[i], A->sizes[i]);
+    }
+    const int n = matrix_4d_size(E);
+    for (int i = 0; i < n; ++i) {
+        EXPECT_NEAR(E->data[i], A->data[i], REAL_NEAR_TOL * std::max(1.0, std::fabs((double)E->data[i])));
+    }
+}
+
+// runs the im2col path of a Convolution as the reference
+static Convolution* reference(const ConvCase& c, const Matrix4d* W, const Vector* b) {
+    Matrix4d* W2 = create_matrix_4d(c.FN, c.C, c.FH, c.FW);
+    Vector* b2 = create_vector(c.FN);
+    memcpy(W2->data, W->data, sizeof(real) * matrix_4d_size(W));
+    copy_vector(b2, b);
+    Convolution* Conv = create_convolution(W2, b2, c.stride, c.pad);
+    Conv->algo = CONV_ALGO_IM2COL;
+    return Conv;
+}
+
+TEST(conv_direct_forward, success) {
+    for (const ConvCase& c : CASES) {
+        Matrix4d* X = random_4d(c.N, c.C, c.H, c.W);
+        Matrix4d* W = random_4d(c.FN, c.C, c.FH, c.FW);
+        Vector* b = create_vector(c.FN);
+        for (int i = 0; i < c.FN; ++i) {
+            b->elements[i] = 0.1 * i;
+        }
+        Convolution* Ref = reference(c, W, b);
+        Matrix4d* E = convolution_forward(Ref, X);
+
+        Matrix4d* out = create_matrix_4d(E->sizes[0], E->sizes[1], E->sizes[2], E->sizes[3]);
+        EXPECT_EQ(0, conv_direct_forward(out, X, W, b, c.stride, c.pad, false));
+        expect_4d_near(E, out);
+
+        free_matrix_4d(X);
+        free_matrix_4d(W);
+        free_vector(b);
+        free_matrix_4d(E);
+        free_matrix_4d(out);
+        free_convolution(Ref);
+    }
+}
+
+TEST(conv_direct_forward, error) {
+    Matrix4d* X = create_matrix_4d(1, 2, 5, 5);
+    Matrix4d* W = create_matrix_4d(3, 2, 3, 3);
+    Matrix4d* out = create_matrix_4d(1, 3, 4, 4);
+
+    EXPECT_EQ(-1, conv_direct_forward(out, X, W, NULL, 1, 0, false));
+
+    free_matrix_4d(X);
+    free_matrix_4d(W);
+    free_matrix_4d(out);
+}
+
+TEST(conv_direct_backward_weights, success) {
+    for (const ConvCase& c : CASES) {
+        Matrix4d* X = random_4d(c.N, c.C, c.H, c.W);
+        Matrix4d* W = random_4d(c.FN, c.C, c.FH, c.FW);
+        Vector* b = create_vector(c.FN);
+        Convolution* Ref = reference(c, W, b);
+        Matrix4d* Y = convolution_forward(Ref, X);
+        Matrix4d* dout = random_4d(Y->sizes[0], Y->sizes[1], Y->sizes[2], Y->sizes[3]);
+        free_matrix_4d(convolution_backward(Ref, dout));
+
+        Matrix4d* dW = create_matrix_4d(c.FN, c.C, c.FH, c.FW);
+        Vector* db = create_vector(c.FN);
+        EXPECT_EQ(0, conv_direct_backward_weights(dW, db, dout, X, c.stride, c.pad));
+        expect_4d_near(Ref->dW, dW);
+        for (int i = 0; i < c.FN; ++i) {
+            EXPECT_NEAR(Ref->db->elements[i], db->elements[i], REAL_NEAR_TOL * std::max(1.0, std::fabs((double)db->elements[i])));
+        }
+
+        free_matrix_4d(X);
+        free_matrix_4d(W);
+        free_vector(b);
+        free_matrix_4d(Y);
+        free_matrix_4d(dout);
+        free_matrix_4d(dW);
+        free_vector(db);
+        free_convolution(Ref);
+    }
+}
+
+TEST(conv_direct_backward_data, success) {
+    for (const ConvCase& c : CASES) {
+        Matrix4d* X = random_4d(c.N, c.C, c.H, c.W);
+        Matrix4d* W = random_4d(c.FN, c.C, c.FH, c.FW);
+        Vector* b = create_vector(c.FN);
+        Convolution* Ref = reference(c, W, b);
+        Matrix4d* Y = convolution_forward(Ref, X);
+        Matrix4d* dout = random_4d(Y->sizes[0], Y->sizes[1], Y->sizes[2], Y->sizes[3]);
+        Matrix4d* E = convolution_backward(Ref, dout);
+
+        Matrix4d* dx = create_matrix_4d(c.N, c.C, c.H, c.W);
+        EXPECT_EQ(0, conv_direct_backward_data(dx, dout, W, c.stride, c.pad));
+        expect_4d_near(E, dx);
+
+        free_matrix_4d(X);
+        free_matrix_4d(W);
+        free_vector(b);
+        free_matrix_4d(Y);
+        free_matrix_4d(dout);
+        free_matrix_4d(E);
+        free_matrix_4d(dx);
+        free_convolution(Ref);
+    }
+}
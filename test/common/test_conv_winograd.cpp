@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+
+#include "utest_util.h"
+
+extern "C" {
+#include <conv_winograd.h>
+#include <conv_direct.h>
+}
+
+static Matrix4d* random_4d(int s1, int s2, int s3, int s4) {
+    Matrix4d* M = create_matrix_4d(s1, s2, s3, s4);
+    init_matrix_4d_random(M);
+    return M;
+}
+
+TEST(conv_winograd_supported, success) {
+    Matrix4d* W3 = create_matrix_4d(2, 2, 3, 3);
+    Matrix4d* W5 = create_matrix_4d(2, 2, 5, 5);
+
+    EXPECT_TRUE(conv_winograd_supported(W3, 1));
+    EXPECT_FALSE(conv_winograd_supported(W3, 2));
+    EXPECT_FALSE(conv_winograd_supported(W5, 1));
+
+    free_matrix_4d(W3);
+    free_matrix_4d(W5);
+}
+
+TEST(conv_winograd_transform_filter_into, success) {
+    // a filter that is 1 at the centre passes the middle of a tile through:
+    // G g G^T is then the outer product of (0, 1/2, -1/2, 0) with itself
+    Matrix4d* W = create_matrix_4d(1, 1, 3, 3);
+    W->elements[0][0][1][1] = 1;
+    Matrix* U = create_matrix(16, 1);
+
+    EXPECT_EQ(0, conv_winograd_transform_filter_into(U, W));
+    const double g[4] = {0, 0.5, -0.5, 0};
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            EXPECT_REAL_EQ(g[i] * g[j], U->elements[i * 4 + j][0]);
+        }
+    }
+
+    Matrix* V = create_matrix(16, 2);
+    EXPECT_EQ(-1, conv_winograd_transform_filter_into(V, W));
+
+    free_matrix_4d(W);
+    free_matrix(U);
+    free_matrix(V);
+}
+
+TEST(conv_winograd_forward, success) {
+    // odd outputs leave half tiles at the edges; pad 2 widens the output
+    const int shapes[][6] = {
+        // N, C, H, W, FN, pad
+        {2, 1, 6, 6, 3, 1},
+        {3, 5, 7, 9, 4, 1},
+        {1, 3, 5, 4, 6, 0},
+        {2, 4, 6, 7, 2, 2},
+    };
+    for (const auto& s : shapes) {
+        Matrix4d* X = random_4d(s[0], s[1], s[2], s[3]);
+        Matrix4d* W = random_4d(s[4], s[1], 3, 3);
+        Vector* b = create_vector(s[4]);
+        for (int i = 0; i < s[4]; ++i) {
+            b->elements[i] = 0.5 - i;
+        }
+        const int oh = s[2] + 2 * s[5] - 2;
+        const int ow = s[3] + 2 * s[5] - 2;
+
+        Matrix4d* E = create_matrix_4d(s[0], s[4], oh, ow);
+        conv_direct_forward(E, X, W, b, 1, s[5], false);
+
+        Matrix* U = create_matrix(16 * s[4], s[1]);
+        conv_winograd_transform_filter_into(U, W);
+        Matrix4d* out = create_matrix_4d(s[0], s[4], oh, ow);
+        EXPECT_EQ(0, conv_winograd_forward(out, X, U, b, s[5], false));
+
+        for (int i = 0; i < matrix_4d_size(E); ++i) {
+            EXPECT_NEAR(E->data[i], out->data[i], REAL_NEAR_TOL * std::max(1.0, std::fabs((double)E->data[i])));
+        }
+
+        free_matrix_4d(X);
+        free_matrix_4d(W);
+        free_vector(b);
+        free_matrix_4d(E);
+        free_matrix(U);
+        free_matrix_4d(out);
+    }
+}
+
+TEST(conv_winograd_forward, error) {
+    Matrix4d* X = create_matrix_4d(1, 2, 5, 5);
+    Matrix* U = create_matrix(16 * 3, 2);
+    Matrix4d* out = create_matrix_4d(1, 3, 5, 5);
+
+    EXPECT_EQ(-1, conv_winograd_forward(out, X, U, NULL, 0, false));
+
+    free_matrix_4d(X);
+    free_matrix(U);
+    free_matrix_4d(out);
+}
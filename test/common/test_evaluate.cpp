@@ -0,0 +1,134 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <vector>
+
+extern "C" {
+#include <evaluate.h>
+#include <layer.h>
+#include <mnist.h>
+#include <simple_convnet.h>
+#include <thread_pool.h>
+}
+
+static std::atomic<int> grad_calls;
+
+// input i scores highest at class i % 10
+static Matrix* score_range(const void* arg, int begin, int end) {
+    if (layer_grad_enabled()) {
+        ++grad_calls;
+    }
+
+    Matrix* Y = create_matrix(end - begin, 10);
+    for (int i = begin; i < end; ++i) {
+        for (int j = 0; j < 10; ++j) {
+            Y->elements[i - begin][j] = (j == i % 10) ? 1 : 0;
+        }
+    }
+
+    return Y;
+}
+
+TEST(eval_count_correct, success) {
+    // two full chunks and a partial one; every third label is wrong
+    const int size = 2 * EVAL_CHUNK + 5;
+    std::vector<uint8_t> labels(size);
+    int expected = 0;
+    int expected_half = 0;
+    for (int i = 0; i < size; ++i) {
+        labels[i] = (i % 3 == 0) ? (i + 1) % 10 : i % 10;
+        expected += (i % 3 != 0);
+        expected_half += (i % 3 != 0 && i < size / 2);
+    }
+
+    grad_calls = 0;
+    EXPECT_EQ(expected, eval_count_correct(score_range, NULL, labels.data(), size, false));
+    EXPECT_EQ(expected, eval_count_correct(score_range, NULL, labels.data(), size, true));
+    EXPECT_EQ(expected_half, eval_count_correct(score_range, NULL, labels.data(), size / 2, true));
+    EXPECT_EQ(0, eval_count_correct(score_range, NULL, labels.data(), 0, true));
+
+    // scoring runs without gradient tracking, which is on again afterwards
+    EXPECT_EQ(0, grad_calls);
+    EXPECT_TRUE(layer_grad_enabled());
+}
+
+// fails on the chunk that starts at EVAL_CHUNK
+static Matrix* score_failing(const void* arg, int begin, int end) {
+    return (begin == EVAL_CHUNK) ? NULL : score_range(arg, begin, end);
+}
+
+TEST(eval_count_correct, failed_chunk) {
+    const int size = 3 * EVAL_CHUNK;
+    std::vector<uint8_t> labels(size);
+    for (int i = 0; i < size; ++i) {
+        labels[i] = i % 10;
+    }
+
+    EXPECT_EQ(-1, eval_count_correct(score_failing, NULL, labels.data(), size, false));
+    EXPECT_EQ(-1, eval_count_correct(score_failing, NULL, labels.data(), size, true));
+    EXPECT_EQ(EVAL_CHUNK, eval_count_correct(score_failing, NULL, labels.data(), EVAL_CHUNK, true));
+    EXPECT_TRUE(layer_grad_enabled());
+}
+
+typedef struct ConvBatch ConvBatch;
+struct ConvBatch {
+    const SimpleConvNet* net;
+    double**** images;
+};
+
+// the same scoring as simple_convnet_accuracy, for a serial reference
+static Matrix* score_convnet(const void* arg, int begin, int end) {
+    const ConvBatch* b = (const ConvBatch*)arg;
+    Matrix4d* X = create_matrix_4d(end - begin, 1, NUM_OF_ROWS, NUM_OF_COLS);
+    for (int i = 0; i < X->sizes[0]; ++i) {
+        for (int k = 0; k < NUM_OF_ROWS; ++k) {
+            for (int l = 0; l < NUM_OF_COLS; ++l) {
+                X->elements[i][0][k][l] = b->images[begin + i][0][k][l];
+            }
+        }
+    }
+
+    Matrix* Y = sequential_predict(b->net->seq, tensor_4d(X), false).m;
+    free_matrix_4d(X);
+
+    return Y;
+}
+
+TEST(eval_count_correct, parallel_convnet) {
+    // every worker runs the same layers; each convolution algorithm must
+    // leave them as they were, im2col included
+    const int size = EVAL_CHUNK * (thread_pool_num_threads() > 2 ? thread_pool_num_threads() : 2);
+    std::vector<double***> images(size);
+    std::vector<uint8_t> labels(size);
+    for (int i = 0; i < size; ++i) {
+        images[i] = (double***)malloc(sizeof(double**));
+        images[i][0] = (double**)malloc(sizeof(double*) * NUM_OF_ROWS);
+        for (int k = 0; k < NUM_OF_ROWS; ++k) {
+            images[i][0][k] = (double*)malloc(sizeof(double) * NUM_OF_COLS);
+            for (int l = 0; l < NUM_OF_COLS; ++l) {
+                images[i][0][k][l] = (double)rand() / RAND_MAX;
+            }
+        }
+        labels[i] = i % 10;
+    }
+
+    SimpleConvNet* net = create_simple_convnet(1, 28, 28, 8, 5, 0, 1, 20, 10, 0.1);
+    const ConvBatch b = {net, images.data()};
+    const ConvAlgo algos[] = {CONV_ALGO_IM2COL, CONV_ALGO_DIRECT, CONV_ALGO_AUTO};
+    for (ConvAlgo algo : algos) {
+        net->C->algo = algo;
+        const int expected = eval_count_correct(score_convnet, &b, labels.data(), size, false);
+        for (int rep = 0; rep < 4; ++rep) {
+            EXPECT_DOUBLE_EQ((double)expected / size, simple_convnet_accuracy(net, images.data(), labels.data(), size, 1)) << algo;
+        }
+    }
+
+    free_simple_convnet(net);
+    for (int i = 0; i < size; ++i) {
+        for (int k = 0; k < NUM_OF_ROWS; ++k) {
+            free(images[i][0][k]);
+        }
+        free(images[i][0]);
+        free(images[i]);
+    }
+}
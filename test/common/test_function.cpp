@@ -15,9 +15,9 @@ TEST(vector_sigmoid, success) {
     Vector* u = vector_sigmoid(v);
     EXPECT_NE(nullptr, u);
 
-    EXPECT_DOUBLE_EQ(sigmoid(-1), u->elements[0]);
-    EXPECT_DOUBLE_EQ(sigmoid(1),  u->elements[1]);
-    EXPECT_DOUBLE_EQ(sigmoid(2),  u->elements[2]);
+    EXPECT_REAL_EQ(sigmoid(-1), u->elements[0]);
+    EXPECT_REAL_EQ(sigmoid(1),  u->elements[1]);
+    EXPECT_REAL_EQ(sigmoid(2),  u->elements[2]);
 
     free_vector(v);
     free_vector(u);
@@ -36,7 +36,7 @@ TEST(matrix_sigmoid, success) {
 
     for (int i = 0; i < N->rows; ++i) {
         for (int j = 0; j < N->cols; ++j) {
-            EXPECT_DOUBLE_EQ(sigmoid(M->elements[i][j]), N->elements[i][j]);
+            EXPECT_REAL_EQ(sigmoid(M->elements[i][j]), N->elements[i][j]);
         }
      }
     
@@ -101,8 +101,23 @@ TEST(matrix_softmax, success) {
     free_matrix(N);
 }
 
+TEST(matrix_softmax_into, success) {
+    Matrix* M = create_matrix_from_stdvec({{0.3, 2.9, 4.0}, {0.3, 2.9, 4.0}});
+    Matrix* E = matrix_softmax(M);
+    Matrix* N = create_matrix(2, 3);
+
+    EXPECT_EQ(0, matrix_softmax_into(N, M));
+    for (int i = 0; i < matrix_size(E); ++i) {
+        EXPECT_DOUBLE_EQ(E->data[i], N->data[i]);
+    }
+
+    free_matrix(M);
+    free_matrix(E);
+    free_matrix(N);
+}
+
 TEST(argmax, success) {
-    double v[] = {2, 1, 5, 3, -1};
+    real v[] = {2, 1, 5, 3, -1};
     EXPECT_EQ(2, argmax(v, 5));
 }
 
@@ -131,6 +146,17 @@ TEST(matrix_argmax_row, success) {
     free(arg_max);
 }
 
+TEST(matrix_argmax_row_into, success) {
+    Matrix* M = create_matrix_from_stdvec({{-3, -2, -1}, {7, 7, 5}});
+    int arg_max[2] = {-1, -1};
+    matrix_argmax_row_into(arg_max, M);
+
+    EXPECT_EQ(2, arg_max[0]);
+    EXPECT_EQ(0, arg_max[1]);
+
+    free_matrix(M);
+}
+
 
 
 
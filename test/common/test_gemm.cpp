@@ -0,0 +1,120 @@
+#include "gtest/gtest.h"
+
+#include "utest_util.h"
+
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include <gemm.h>
+}
+
+static void naive_gemm(int m, int n, int k, double alpha, const real* A, const real* B, double beta, real* C) {
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < n; ++j) {
+            double d = 0.0;
+            for (int p = 0; p < k; ++p) {
+                d += A[i * k + p] * B[p * n + j];
+            }
+            C[i * n + j] = alpha * d + beta * C[i * n + j];
+        }
+    }
+}
+
+static std::vector<real> random_values(int n) {
+    std::vector<real> v(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = (double)rand() / RAND_MAX - 0.5;
+    }
+    return v;
+}
+
+TEST(gemm, success) {
+    const int shapes[][3] = {{1, 1, 1}, {3, 5, 7}, {4, 8, 16}, {13, 17, 300}, {100, 10, 784}, {97, 2050, 3}};
+
+    for (const auto& s : shapes) {
+        const int m = s[0], n = s[1], k = s[2];
+        std::vector<real> A = random_values(m * k);
+        std::vector<real> B = random_values(k * n);
+        std::vector<real> C = random_values(m * n);
+        std::vector<real> E = C;
+
+        EXPECT_EQ(0, gemm(false, false, m, n, k, 1.5, A.data(), k, B.data(), n, 0.5, C.data(), n));
+        naive_gemm(m, n, k, 1.5, A.data(), B.data(), 0.5, E.data());
+
+        for (int i = 0; i < m * n; ++i) {
+            EXPECT_NEAR(E[i], C[i], REAL_SUM_TOL);
+        }
+    }
+}
+
+TEST(gemm, beta_zero_ignores_c) {
+    const real A[] = {1, 2, 3, 4};
+    const real B[] = {5, 6, 7, 8};
+    real C[] = {NAN, NAN, NAN, NAN};
+
+    gemm(false, false, 2, 2, 2, 1.0, A, 2, B, 2, 0.0, C, 2);
+
+    EXPECT_DOUBLE_EQ(19, C[0]);
+    EXPECT_DOUBLE_EQ(22, C[1]);
+    EXPECT_DOUBLE_EQ(43, C[2]);
+    EXPECT_DOUBLE_EQ(50, C[3]);
+}
+
+TEST(gemm, transposed) {
+    const int m = 13, n = 11, k = 270;
+    std::vector<real> A = random_values(m * k);
+    std::vector<real> B = random_values(k * n);
+    std::vector<real> E(m * n, 0.0);
+    naive_gemm(m, n, k, 1.0, A.data(), B.data(), 0.0, E.data());
+
+    // stored transposes of A and B
+    std::vector<real> At(k * m), Bt(n * k);
+    for (int i = 0; i < m; ++i) {
+        for (int p = 0; p < k; ++p) {
+            At[p * m + i] = A[i * k + p];
+        }
+    }
+    for (int p = 0; p < k; ++p) {
+        for (int j = 0; j < n; ++j) {
+            Bt[j * k + p] = B[p * n + j];
+        }
+    }
+
+    for (int ta = 0; ta < 2; ++ta) {
+        for (int tb = 0; tb < 2; ++tb) {
+            std::vector<real> C(m * n, 0.0);
+            gemm(ta, tb, m, n, k, 1.0, ta ? At.data() : A.data(), ta ? m : k, tb ? Bt.data() : B.data(), tb ? k : n, 0.0, C.data(), n);
+
+            for (int i = 0; i < m * n; ++i) {
+                EXPECT_NEAR(E[i], C[i], REAL_SUM_TOL);
+            }
+        }
+    }
+}
+
+TEST(gemm_fused, success) {
+    // k beyond one KC panel and n beyond one NC panel: the epilogue must run
+    // once, after the last panel, with the right column of the bias
+    const int shapes[][3] = {{3, 5, 7}, {13, 17, 300}, {97, 2050, 3}};
+
+    for (const auto& s : shapes) {
+        const int m = s[0], n = s[1], k = s[2];
+        std::vector<real> A = random_values(m * k);
+        std::vector<real> B = random_values(k * n);
+        std::vector<real> bias = random_values(n);
+        std::vector<real> C = random_values(m * n);
+        std::vector<real> E = C;
+
+        // the epilogue applies to the whole result, beta * C included
+        const GemmEpilogue ep = {bias.data(), true};
+        gemm_fused(false, false, m, n, k, 1.5, A.data(), k, B.data(), n, 0.5, C.data(), n, &ep);
+        naive_gemm(m, n, k, 1.5, A.data(), B.data(), 0.5, E.data());
+
+        for (int i = 0; i < m; ++i) {
+            for (int j = 0; j < n; ++j) {
+                EXPECT_NEAR(std::max(0.0, (double)(E[i * n + j] + bias[j])), C[i * n + j], REAL_SUM_TOL);
+            }
+        }
+    }
+}
@@ -6,6 +6,85 @@ extern "C" {
 #include <layer.h>
 }
 
+TEST(layer_set_grad_enabled, success) {
+    EXPECT_TRUE(layer_grad_enabled());
+    EXPECT_TRUE(layer_set_grad_enabled(false));
+    EXPECT_FALSE(layer_grad_enabled());
+    EXPECT_FALSE(layer_set_grad_enabled(true));
+    EXPECT_TRUE(layer_grad_enabled());
+}
+
+TEST(layer_set_grad_enabled, no_caches) {
+    // without gradients every layer computes the same values but keeps none
+    // of its backward state
+    Matrix4d* X = create_matrix_4d(2, 3, 8, 8);
+    init_matrix_4d_random(X);
+    Matrix4d* W = create_matrix_4d(4, 3, 3, 3);
+    init_matrix_4d_random(W);
+    Matrix* AW = create_matrix(64, 5);
+    init_matrix_random(AW);
+    Vector* t = create_vector_initval(2, 1);
+
+    Convolution* Conv = create_convolution(W, create_vector_initval(4, 0.1), 1, 1);
+    Relu4d* R4d = create_relu_4d();
+    Pooling* P = create_pooling(2, 2, 2, 0);
+    Affine* A = create_affine(AW, create_vector_initval(5, 0.2));
+    Relu* R = create_relu();
+    SoftmaxWithLoss* S = create_softmax_with_loss();
+
+    Matrix4d* Y[2][3];
+    Matrix* Z[2][2];
+    double loss[2];
+    for (int g = 0; g < 2; ++g) {
+        const bool prev = layer_set_grad_enabled(g == 1);
+        Y[g][0] = convolution_forward(Conv, X);
+        Y[g][1] = relu_4d_forward(R4d, Y[g][0]);
+        Y[g][2] = pooling_forward(P, Y[g][1]);
+        Z[g][0] = affine_4d_forward(A, Y[g][2]);
+        Z[g][1] = relu_forward(R, Z[g][0]);
+        loss[g] = softmax_with_loss_forward(S, Z[g][1], t);
+        layer_set_grad_enabled(prev);
+
+        if (g == 0) {
+            EXPECT_TRUE(Conv->x == NULL);
+            EXPECT_TRUE(Conv->col == NULL);
+            EXPECT_TRUE(R4d->mask == NULL);
+            EXPECT_TRUE(P->arg_max == NULL);
+            EXPECT_TRUE(A->X == NULL);
+            EXPECT_TRUE(R->mask == NULL);
+            EXPECT_TRUE(S->dX == NULL);
+        }
+    }
+
+    for (int k = 0; k < 3; ++k) {
+        for (int i = 0; i < matrix_4d_size(Y[1][k]); ++i) {
+            EXPECT_REAL_EQ(Y[1][k]->data[i], Y[0][k]->data[i]);
+        }
+    }
+    for (int k = 0; k < 2; ++k) {
+        for (int i = 0; i < matrix_size(Z[1][k]); ++i) {
+            EXPECT_REAL_EQ(Z[1][k]->data[i], Z[0][k]->data[i]);
+        }
+    }
+    EXPECT_DOUBLE_EQ(loss[1], loss[0]);
+
+    for (int g = 0; g < 2; ++g) {
+        for (int k = 0; k < 3; ++k) {
+            free_matrix_4d(Y[g][k]);
+        }
+        free_matrix(Z[g][0]);
+        free_matrix(Z[g][1]);
+    }
+    free_convolution(Conv);
+    free_relu_4d(R4d);
+    free_pooling(P);
+    free_affine(A);
+    free_relu(R);
+    free_softmax_with_loss(S);
+    free_matrix_4d(X);
+    free_vector(t);
+}
+
 TEST(affine_forward_backward, success) {
     Matrix* W = create_matrix_from_stdvec({{0.1, 0.2, 0.3}, {0.4, 0.5, 0.6}, {0.7, 0.8, 0.9}, {1.0, 1.1, 1.2}});
     Vector* b = create_vector_from_stdvec({1, 2, 3});
@@ -233,7 +312,7 @@ TEST(softmax_with_loss_forward_backward, success) {
     Vector* t = create_vector_from_stdvec({0, 1});
 
     const double loss = softmax_with_loss_forward(S, X, t);
-    EXPECT_DOUBLE_EQ(loss, 1.6347998581152146);
+    EXPECT_REAL_EQ(loss, 1.634800384251316);
 
     Matrix* M = softmax_with_loss_backward(S);
     EXPECT_MATRIX_NEAR({{-0.4223188, 0.2111594, 0.2111594}, {0.04501529, -0.37763576, 0.33262048}}, M);
@@ -251,12 +330,27 @@ TEST(batch_normalization_forward_backward, success) {
     BatchNormalization* B = create_batch_normalization(g, b, 0.9);
    
     Matrix* X = create_matrix_from_stdvec({{1, 3, 2, 4}, {8, 6, 7, 5}, {10, 9, 11, 12}});
-    Matrix* M = batch_normalization_forward(B, X);
+    Matrix* M = batch_normalization_forward(B, X, true);
     EXPECT_MATRIX_NEAR({{-1.38218943, -1.22474477, -1.2675004, -0.8429272}, {0.4319342, 0, 0.09053574, -0.56195146}, {0.95025524, 1.22474477, 1.17696466, 1.40487866}}, M);
 
     scalar_matrix(X, 10000000);
     Matrix* N = batch_normalization_backward(B, X);
+#ifndef USE_FLOAT
+    // dout of order 1e7 cancels down to order 1, which is below float resolution
     EXPECT_MATRIX_NEAR({{-0.92833612, -2.04124094, -0.93504121, -0.66546879}, {0.29010504, 0, 0.06678866, -0.44364586}, {0.63823109, 2.04124094, 0.86825255, 1.10911464}}, N);
+#endif
+
+    // with g = 1 and b = 0 the output is xn itself
+    for (int j = 0; j < 4; ++j) {
+        double db = 0;
+        double dg = 0;
+        for (int i = 0; i < 3; ++i) {
+            db += X->elements[i][j];
+            dg += X->elements[i][j] * M->elements[i][j];
+        }
+        EXPECT_NEAR(db, B->db->elements[j], REAL_NEAR_TOL * std::fabs(db));
+        EXPECT_NEAR(dg, B->dg->elements[j], REAL_NEAR_TOL * std::max(1e7, std::fabs(dg)));
+    }
 
     free_batch_normalization(B);
     free_matrix(X);
@@ -264,6 +358,68 @@ TEST(batch_normalization_forward_backward, success) {
     free_matrix(N);
 }
 
+TEST(batch_normalization_forward, eval) {
+    Vector* g = create_vector_initval(2, 2);
+    Vector* b = create_vector_initval(2, 1);
+    BatchNormalization* B = create_batch_normalization(g, b, 0.9);
+    B->running_mean->elements[0] = 1;
+    B->running_mean->elements[1] = -2;
+    B->running_var->elements[0]  = 4;
+    B->running_var->elements[1]  = 0.25;
+
+    // one row is enough: batch statistics would make it all zeros
+    Matrix* X = create_matrix_from_stdvec({{3, -1}});
+    Matrix* M = batch_normalization_forward(B, X, false);
+    EXPECT_MATRIX_NEAR({{2 * 2 / std::sqrt(4 + 10e-7) + 1, 2 * 1 / std::sqrt(0.25 + 10e-7) + 1}}, M);
+    EXPECT_REAL_EQ(1, B->running_mean->elements[0]);
+    EXPECT_REAL_EQ(4, B->running_var->elements[0]);
+    EXPECT_TRUE(B->xn == NULL);
+
+    free_batch_normalization(B);
+    free_matrix(X);
+    free_matrix(M);
+}
+
+TEST(batch_normalization_fold_into, success) {
+    Vector* g = create_vector(3);
+    Vector* b = create_vector(3);
+    BatchNormalization* B = create_batch_normalization(g, b, 0.9);
+    for (int j = 0; j < 3; ++j) {
+        g->elements[j] = 0.5 + j;
+        b->elements[j] = 1 - j;
+        B->running_mean->elements[j] = 0.3 * j - 0.2;
+        B->running_var->elements[j]  = 0.7 + j;
+    }
+
+    Matrix* W = create_matrix(4, 3);
+    init_matrix_random(W);
+    Vector* c = create_vector_initval(3, 0.1);
+    Affine* A = create_affine(W, c);
+    Matrix* X = create_matrix(5, 4);
+    init_matrix_random(X);
+
+    Matrix* T = affine_forward(A, X);
+    Matrix* E = batch_normalization_forward(B, T, false);
+    EXPECT_EQ(0, batch_normalization_fold_into(B, W, c));
+    Matrix* Y = affine_forward(A, X);
+    for (int i = 0; i < 5; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            EXPECT_NEAR(E->elements[i][j], Y->elements[i][j], REAL_NEAR_TOL * std::max(1.0, std::fabs((double)E->elements[i][j])));
+        }
+    }
+
+    Matrix* V = create_matrix(4, 2);
+    EXPECT_EQ(-1, batch_normalization_fold_into(B, V, c));
+
+    free_batch_normalization(B);
+    free_affine(A);
+    free_matrix(X);
+    free_matrix(T);
+    free_matrix(E);
+    free_matrix(Y);
+    free_matrix(V);
+}
+
 TEST(dropout_forward_backward, success) {
     Dropout* D = create_dropout(0.5);
     
@@ -471,6 +627,156 @@ TEST(convolution_forward_backward, success2) {
     free_convolution(Conv);
 }
 
+TEST(convolution_forward_backward, algos) {
+    Matrix4d* X = create_matrix_4d(3, 4, 7, 6);
+    init_matrix_4d_random(X);
+    Matrix4d* W = create_matrix_4d(5, 4, 3, 3);
+    init_matrix_4d_random(W);
+
+    Convolution* Conv[3];
+    Matrix4d* Y[3];
+    Matrix4d* dX[3];
+    const ConvAlgo algos[3] = {CONV_ALGO_IM2COL, CONV_ALGO_DIRECT, CONV_ALGO_WINOGRAD};
+    for (int a = 0; a < 3; ++a) {
+        Matrix4d* Wa = create_matrix_4d(5, 4, 3, 3);
+        memcpy(Wa->data, W->data, sizeof(real) * matrix_4d_size(W));
+        Conv[a] = create_convolution(Wa, create_vector_initval(5, 0.25), 1, 1);
+        Conv[a]->algo = algos[a];
+        Y[a] = convolution_forward(Conv[a], X);
+        dX[a] = convolution_backward(Conv[a], Y[a]);
+        EXPECT_EQ(algos[a], Conv[a]->used);
+    }
+
+    for (int a = 1; a < 3; ++a) {
+        for (int i = 0; i < matrix_4d_size(Y[0]); ++i) {
+            EXPECT_NEAR(Y[0]->data[i], Y[a]->data[i], REAL_NEAR_TOL * std::max(1.0, std::fabs((double)Y[0]->data[i])));
+        }
+        for (int i = 0; i < matrix_4d_size(dX[0]); ++i) {
+            EXPECT_NEAR(dX[0]->data[i], dX[a]->data[i], REAL_SUM_TOL * std::max(1.0, std::fabs((double)dX[0]->data[i])));
+        }
+        for (int i = 0; i < matrix_4d_size(W); ++i) {
+            EXPECT_NEAR(Conv[0]->dW->data[i], Conv[a]->dW->data[i], REAL_SUM_TOL * std::max(1.0, std::fabs((double)Conv[0]->dW->data[i])));
+        }
+        for (int i = 0; i < 5; ++i) {
+            EXPECT_NEAR(Conv[0]->db->elements[i], Conv[a]->db->elements[i], REAL_SUM_TOL * std::max(1.0, std::fabs((double)Conv[0]->db->elements[i])));
+        }
+    }
+
+    for (int a = 0; a < 3; ++a) {
+        free_matrix_4d(Y[a]);
+        free_matrix_4d(dX[a]);
+        free_convolution(Conv[a]);
+    }
+    free_matrix_4d(X);
+    free_matrix_4d(W);
+}
+
+TEST(convolution_relu_forward, success) {
+    Matrix4d* X = create_matrix_4d(3, 4, 7, 6);
+    init_matrix_4d_random(X);
+
+    const ConvAlgo algos[3] = {CONV_ALGO_IM2COL, CONV_ALGO_DIRECT, CONV_ALGO_WINOGRAD};
+    for (int a = 0; a < 3; ++a) {
+        Matrix4d* W = create_matrix_4d(5, 4, 3, 3);
+        init_matrix_4d_random(W);
+        Convolution* Conv = create_convolution(W, create_vector_initval(5, 0.25), 1, 1);
+        Conv->algo = algos[a];
+
+        Matrix4d* E = convolution_forward(Conv, X);
+        Matrix4d* Y = convolution_relu_forward(Conv, X);
+        EXPECT_EQ(algos[a], Conv->used);
+        for (int i = 0; i < 4; ++i) {
+            ASSERT_EQ(E->sizes[i], Y->sizes[i]);
+        }
+        for (int i = 0; i < matrix_4d_size(E); ++i) {
+            EXPECT_REAL_EQ(std::max(0.0, (double)E->data[i]), Y->data[i]);
+        }
+
+        free_matrix_4d(E);
+        free_matrix_4d(Y);
+        free_convolution(Conv);
+    }
+    free_matrix_4d(X);
+}
+
+TEST(convolution_select_algo, success) {
+    // one input channel: the col matrix would only be a copy of X
+    Convolution* C1 = create_convolution(create_matrix_4d(16, 1, 3, 3), create_vector(16), 1, 1);
+    Matrix4d* X1 = create_matrix_4d(4, 1, 28, 28);
+    EXPECT_EQ(CONV_ALGO_DIRECT, convolution_select_algo(C1, X1));
+
+    Convolution* C2 = create_convolution(create_matrix_4d(64, 32, 3, 3), create_vector(64), 1, 1);
+    Matrix4d* X2 = create_matrix_4d(4, 32, 8, 8);
+    EXPECT_EQ(CONV_ALGO_WINOGRAD, convolution_select_algo(C2, X2));
+
+    // Winograd only takes 3x3 filters with stride 1
+    Convolution* C3 = create_convolution(create_matrix_4d(64, 32, 3, 3), create_vector(64), 2, 1);
+    EXPECT_EQ(CONV_ALGO_IM2COL, convolution_select_algo(C3, X2));
+    C3->algo = CONV_ALGO_WINOGRAD;
+    EXPECT_EQ(CONV_ALGO_DIRECT, convolution_select_algo(C3, X2));
+
+    C2->algo = CONV_ALGO_DIRECT;
+    EXPECT_EQ(CONV_ALGO_DIRECT, convolution_select_algo(C2, X2));
+    C1->algo = CONV_ALGO_IM2COL;
+    EXPECT_EQ(CONV_ALGO_IM2COL, convolution_select_algo(C1, X1));
+
+    free_convolution(C1);
+    free_convolution(C2);
+    free_convolution(C3);
+    free_matrix_4d(X1);
+    free_matrix_4d(X2);
+}
+
+TEST(convolution_invalidate_cache, success) {
+    Matrix4d* W = create_matrix_4d(4, 3, 3, 3);
+    init_matrix_4d_random(W);
+    Convolution* Conv = create_convolution(W, create_vector(4), 1, 1);
+    Conv->algo = CONV_ALGO_WINOGRAD;
+    Matrix4d* X = create_matrix_4d(2, 3, 5, 5);
+    init_matrix_4d_random(X);
+
+    Matrix4d* Y1 = convolution_forward(Conv, X);
+    ASSERT_TRUE(Conv->U != NULL);
+
+    // without the call the stale transform of W would still be used
+    scalar_matrix_4d(W, 2.0);
+    convolution_invalidate_cache(Conv);
+    EXPECT_TRUE(Conv->U == NULL);
+    Matrix4d* Y2 = convolution_forward(Conv, X);
+    for (int i = 0; i < matrix_4d_size(Y1); ++i) {
+        EXPECT_NEAR(2.0 * Y1->data[i], Y2->data[i], REAL_NEAR_TOL * std::max(1.0, std::fabs((double)Y2->data[i])));
+    }
+
+    // backward is followed by an update of W, so it drops the transform too
+    free_matrix_4d(convolution_backward(Conv, Y2));
+    EXPECT_TRUE(Conv->U == NULL);
+
+    free_matrix_4d(X);
+    free_matrix_4d(Y1);
+    free_matrix_4d(Y2);
+    free_convolution(Conv);
+}
+
+TEST(create_pooling, window_too_large) {
+    // arg_max can tell at most POOL_MAX_WINDOW taps apart
+    EXPECT_EQ(nullptr, create_pooling(17, 16, 1, 0));
+    EXPECT_EQ(nullptr, create_pooling(2, 2, 0, 0));
+
+    Pooling* P = create_pooling(16, 16, 16, 0);
+    ASSERT_NE(nullptr, P);
+
+    // a kernel failure comes back as NULL, not as a zero output
+    Matrix4d* X = create_matrix_4d(1, 1, 32, 32);
+    P->pool_h = 17;
+    EXPECT_EQ(nullptr, pooling_forward(P, X));
+    const bool grad = layer_set_grad_enabled(false);
+    EXPECT_EQ(nullptr, pooling_forward(P, X));
+    layer_set_grad_enabled(grad);
+
+    free_matrix_4d(X);
+    free_pooling(P);
+}
+
 TEST(pooling_forward_backward, success) {
     Pooling* P = create_pooling(2, 2, 2, 0);
 
@@ -545,6 +851,8 @@ TEST(pooling_forward_backward, success) {
     };
     EXPECT_MATRIX4D_EQ(ans2, B);
 
+    free_matrix_4d(X);
     free_matrix_4d(F);
     free_matrix_4d(B);
+    free_pooling(P);
 }
@@ -90,6 +90,67 @@ TEST(create_matrix_4d, success) {
     free_matrix_4d(M);
 }
 
+TEST(create_matrix, contiguous) {
+    Matrix* M = create_matrix(3, 5);
+
+    EXPECT_EQ(0u, (uintptr_t)M->data % MATRIX_ALIGNMENT);
+    for (int i = 0; i < M->rows; ++i) {
+        EXPECT_EQ(M->data + i * M->cols, M->elements[i]);
+    }
+
+    free_matrix(M);
+}
+
+TEST(create_matrix_4d, contiguous) {
+    Matrix4d* M = create_matrix_4d(2, 3, 4, 5);
+
+    EXPECT_EQ(0u, (uintptr_t)M->data % MATRIX_ALIGNMENT);
+    EXPECT_EQ(60, M->strides[0]);
+    EXPECT_EQ(20, M->strides[1]);
+    EXPECT_EQ(5,  M->strides[2]);
+    EXPECT_EQ(1,  M->strides[3]);
+
+    for (int i = 0; i < M->sizes[0]; ++i) {
+        for (int j = 0; j < M->sizes[1]; ++j) {
+            for (int k = 0; k < M->sizes[2]; ++k) {
+                EXPECT_EQ(M->data + i * 60 + j * 20 + k * 5, M->elements[i][j][k]);
+            }
+        }
+    }
+
+    free_matrix_4d(M);
+}
+
+TEST(reuse_matrix, success) {
+    Matrix* M = create_matrix(3, 4);
+    M->elements[1][2] = 5;
+
+    Matrix* N = reuse_matrix(M, 3, 4);
+    EXPECT_EQ(M, N);
+    EXPECT_DOUBLE_EQ(5, N->elements[1][2]);
+
+    N = reuse_matrix(N, 4, 3);
+    EXPECT_EQ(4, N->rows);
+    EXPECT_EQ(3, N->cols);
+
+    Matrix* P = reuse_matrix(NULL, 2, 2);
+    EXPECT_EQ(2, P->rows);
+
+    free_matrix(N);
+    free_matrix(P);
+}
+
+TEST(matrix_size, success) {
+    Matrix* M = create_matrix(3, 5);
+    Matrix4d* N = create_matrix_4d(2, 3, 4, 5);
+
+    EXPECT_EQ(15,  matrix_size(M));
+    EXPECT_EQ(120, matrix_4d_size(N));
+
+    free_matrix(M);
+    free_matrix_4d(N);
+}
+
 TEST(init_vector_from_file, success) {
     Vector* v = create_vector(5);
     EXPECT_EQ(0, init_vector_from_file(v, "./data/v.csv"));
@@ -330,6 +391,65 @@ TEST(dot_matrix, error) {
     free_matrix(N);
 }
 
+TEST(dot_matrix_into, success) {
+    Matrix* M = create_matrix_from_stdvec({{1, 2, 3}, {4, 5, 6}});
+    Matrix* N = create_matrix_from_stdvec({{1, 2, 3, 4}, {5, 6, 7, 8}, {9, 10, 11, 12}});
+    Matrix* P = create_matrix_from_stdvec({{1, 1, 1, 1}, {1, 1, 1, 1}});
+
+    EXPECT_EQ(0, dot_matrix_into(P, M, N));
+    EXPECT_MATRIX_EQ({{38, 44, 50, 56}, {83, 98, 113, 128}}, P);
+
+    free_matrix(M);
+    free_matrix(N);
+    free_matrix(P);
+}
+
+TEST(dot_matrix_into, error) {
+    Matrix* M = create_matrix(2, 3);
+    Matrix* N = create_matrix(3, 4);
+    Matrix* P = create_matrix(4, 2);
+    EXPECT_EQ(-1, dot_matrix_into(P, M, N));
+
+    free_matrix(M);
+    free_matrix(N);
+    free_matrix(P);
+}
+
+TEST(dot_matrix_trans, success) {
+    Matrix* M = create_matrix_from_stdvec({{1, 2, 3}, {4, 5, 6}});
+    Matrix* N = create_matrix_from_stdvec({{1, 2}, {3, 4}, {5, 6}});
+
+    Matrix* A = dot_matrix_trans(M, false, N, false);
+    EXPECT_MATRIX_EQ({{22, 28}, {49, 64}}, A);
+
+    Matrix* B = dot_matrix_trans(M, true, M, false);
+    EXPECT_MATRIX_EQ({{17, 22, 27}, {22, 29, 36}, {27, 36, 45}}, B);
+
+    Matrix* C = dot_matrix_trans(M, false, M, true);
+    EXPECT_MATRIX_EQ({{14, 32}, {32, 77}}, C);
+
+    Matrix* D = dot_matrix_trans(M, true, N, true);
+    EXPECT_MATRIX_EQ({{9, 19, 29}, {12, 26, 40}, {15, 33, 51}}, D);
+
+    free_matrix(M);
+    free_matrix(N);
+    free_matrix(A);
+    free_matrix(B);
+    free_matrix(C);
+    free_matrix(D);
+}
+
+TEST(dot_matrix_trans, error) {
+    Matrix* M = create_matrix(2, 3);
+    Matrix* N = create_matrix(2, 3);
+
+    EXPECT_EQ(nullptr, dot_matrix_trans(M, false, N, false));
+    EXPECT_EQ(nullptr, dot_matrix_trans(M, true, N, true));
+
+    free_matrix(M);
+    free_matrix(N);
+}
+
 TEST(product_vector_matrix, success) {
     Vector* v = create_vector_from_stdvec({1, 2, 3});
     Matrix* M = create_matrix_from_stdvec({{1, 2, 3}, {4, 5, 6}, {7, 8, 9}});
@@ -602,6 +722,73 @@ TEST(matrix_4d_transpose, success2) {
     free_matrix_4d(MT);
 }
 
+TEST(matrix_4d_permute, success) {
+    Matrix4d* M = create_matrix_4d(2, 3, 4, 5);
+    init_matrix_4d_random(M);
+
+    Matrix4d* P = matrix_4d_permute(M, 0, 3, 1, 2);
+    EXPECT_EQ(M->data, P->data);
+    EXPECT_FALSE(matrix_4d_is_contiguous(P));
+    EXPECT_EQ(nullptr, P->elements);
+    const int sizes[] = {2, 5, 3, 4};
+    const int strides[] = {60, 1, 20, 5};
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(sizes[i], P->sizes[i]);
+        EXPECT_EQ(strides[i], P->strides[i]);
+    }
+
+    // moving a size 1 axis keeps the order of the values
+    Matrix4d* O = create_matrix_4d(3, 1, 4, 5);
+    Matrix4d* Q = matrix_4d_permute(O, 1, 0, 2, 3);
+    EXPECT_TRUE(matrix_4d_is_contiguous(Q));
+
+    // a view gets its elements table on first use, and only when contiguous
+    EXPECT_EQ(nullptr, Q->elements);
+    real**** e = matrix_4d_elements(Q);
+    ASSERT_NE(nullptr, e);
+    EXPECT_EQ(e, Q->elements);
+    EXPECT_EQ(O->data + 2 * 20 + 3 * 5 + 4, &e[0][2][3][4]);
+    EXPECT_EQ(nullptr, matrix_4d_elements(P));
+
+    EXPECT_EQ(nullptr, matrix_4d_permute(M, 0, 1, 1, 2));
+
+    free_matrix_4d(M);
+    free_matrix_4d(P);
+    free_matrix_4d(O);
+    free_matrix_4d(Q);
+}
+
+TEST(matrix_4d_contiguous, success) {
+    // sizes that are not multiples of the transpose tile
+    Matrix4d* M = create_matrix_4d(3, 7, 37, 35);
+    init_matrix_4d_random(M);
+
+    const int perms[][4] = {{0, 3, 1, 2}, {0, 2, 3, 1}, {3, 1, 0, 2}, {0, 1, 3, 2}, {0, 1, 2, 3}};
+    for (const int* n : perms) {
+        Matrix4d* P = matrix_4d_permute(M, n[0], n[1], n[2], n[3]);
+        Matrix4d* R = matrix_4d_contiguous(P);
+        EXPECT_TRUE(matrix_4d_is_contiguous(R));
+        real**** r = matrix_4d_elements(R);
+
+        int idx[4];
+        for (idx[0] = 0; idx[0] < M->sizes[0]; ++idx[0]) {
+            for (idx[1] = 0; idx[1] < M->sizes[1]; ++idx[1]) {
+                for (idx[2] = 0; idx[2] < M->sizes[2]; ++idx[2]) {
+                    for (idx[3] = 0; idx[3] < M->sizes[3]; ++idx[3]) {
+                        EXPECT_EQ(M->elements[idx[0]][idx[1]][idx[2]][idx[3]],
+                                  r[idx[n[0]]][idx[n[1]]][idx[n[2]]][idx[n[3]]]);
+                    }
+                }
+            }
+        }
+
+        free_matrix_4d(P);
+        free_matrix_4d(R);
+    }
+
+    free_matrix_4d(M);
+}
+
 TEST(vector_reshape_to_4d, success) {
     Vector* v = create_vector_from_stdvec({
         1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 
@@ -719,6 +906,31 @@ TEST(matrix_reshape, success3) {
     free_matrix(R);
 }
 
+TEST(matrix_reshape, view) {
+    Matrix* M = create_matrix_from_stdvec({{1, 2, 3}, {4, 5, 6}});
+    Matrix* R = matrix_reshape(M, 3, -1);
+    EXPECT_EQ(M->data, R->data);
+    EXPECT_EQ(2, M->storage->refs);
+
+    // writes are shared and either side can be freed first
+    R->elements[2][1] = 60;
+    EXPECT_DOUBLE_EQ(60, M->elements[1][2]);
+    free_matrix(M);
+    EXPECT_EQ(1, R->storage->refs);
+    EXPECT_MATRIX_EQ({{1, 2}, {3, 4}, {5, 60}}, R);
+
+    free_matrix(R);
+}
+
+TEST(matrix_reshape, error) {
+    Matrix* M = create_matrix(2, 3);
+    EXPECT_EQ(nullptr, matrix_reshape(M, 4, -1));
+    EXPECT_EQ(nullptr, matrix_reshape(M, 4, 2));
+    EXPECT_EQ(1, M->storage->refs);
+
+    free_matrix(M);
+}
+
 TEST(matrix_reshape_to_2d, success) {
     Matrix4d* M = create_matrix4d_from_stdvec({
        {
@@ -980,6 +1192,17 @@ TEST(matrix_add_vector, error) {
     free_vector(v);
 }
 
+TEST(matrix_add_vector_into, in_place) {
+    Matrix* M = create_matrix_from_stdvec({{1, 2, 3}, {4, 5, 6}, {7, 8, 9}});
+    Vector* v = create_vector_from_stdvec({1, 10, 100});
+
+    EXPECT_EQ(0, matrix_add_vector_into(M, M, v));
+    EXPECT_MATRIX_EQ({{2, 12, 103}, {5, 15, 106}, {8, 18, 109}}, M);
+
+    free_matrix(M);
+    free_vector(v);
+}
+
 TEST(matrix_add_matrix, success) {
     Matrix* M = create_matrix_from_stdvec({{1, 2, 3}, {4, 5, 6}, {7, 8, 9}});
     Matrix* N = create_matrix_from_stdvec({{1, 2, 3}, {4, 5, 6}, {7, 8, 9}});
@@ -1375,6 +1598,38 @@ TEST(im2col, success6) {
     free_matrix(N);
 }
 
+TEST(im2col, pad) {
+    // padding inline must give what im2col of an explicitly padded copy gives,
+    // also for non-square filters, strides and a permuted view as input
+    Matrix4d* M = create_matrix_4d(2, 3, 5, 4);
+    init_matrix_4d_random(M);
+    Matrix4d* V = matrix_4d_permute(M, 0, 1, 3, 2);
+
+    for (int pad = 0; pad <= 2; ++pad) {
+        for (int stride = 1; stride <= 2; ++stride) {
+            Matrix4d* P = matrix_4d_pad(M, pad);
+            Matrix* E = im2col(P, 3, 2, stride, 0);
+            Matrix* N = im2col(M, 3, 2, stride, pad);
+            EXPECT_EQ(0, memcmp(E->data, N->data, sizeof(real) * matrix_size(E)));
+
+            Matrix4d* C = matrix_4d_contiguous(V);
+            Matrix* F = im2col(C, 3, 2, stride, pad);
+            Matrix* G = im2col(V, 3, 2, stride, pad);
+            EXPECT_EQ(0, memcmp(F->data, G->data, sizeof(real) * matrix_size(F)));
+
+            free_matrix_4d(P);
+            free_matrix(E);
+            free_matrix(N);
+            free_matrix_4d(C);
+            free_matrix(F);
+            free_matrix(G);
+        }
+    }
+
+    free_matrix_4d(M);
+    free_matrix_4d(V);
+}
+
 TEST(col2im, success) {
     Matrix* M = create_matrix_from_stdvec(
     {
@@ -1704,6 +1959,61 @@ TEST(col2im, success6) {
     free_matrix_4d(N);
 }
 
+TEST(col2im, pad) {
+    // col2im is the adjoint of im2col: <im2col(x), c> == <x, col2im(c)> for
+    // any padding, stride and filter shape, with the padding taps dropped
+    int sizes[4] = {3, 2, 6, 5};
+    Matrix4d* X = create_matrix_4d(sizes[0], sizes[1], sizes[2], sizes[3]);
+    init_matrix_4d_random(X);
+
+    for (int pad = 0; pad <= 2; ++pad) {
+        for (int stride = 1; stride <= 2; ++stride) {
+            Matrix* col = im2col(X, 2, 3, stride, pad);
+            Matrix* D = create_matrix(col->rows, col->cols);
+            init_matrix_random(D);
+            Matrix4d* R = col2im(D, sizes, 2, 3, stride, pad);
+
+            double lhs = 0, rhs = 0;
+            for (int i = 0; i < matrix_size(col); ++i) {
+                lhs += col->data[i] * D->data[i];
+            }
+            for (int i = 0; i < matrix_4d_size(X); ++i) {
+                rhs += X->data[i] * R->data[i];
+            }
+            EXPECT_NEAR(lhs, rhs, REAL_NEAR_TOL * std::max(1.0, std::fabs(lhs)));
+
+            free_matrix(col);
+            free_matrix(D);
+            free_matrix_4d(R);
+        }
+    }
+
+    free_matrix_4d(X);
+}
+
+TEST(col2im_into, success) {
+    Matrix4d* X = create_matrix_4d(2, 3, 5, 5);
+    init_matrix_4d_random(X);
+    Matrix* col = im2col(X, 3, 3, 1, 1);
+
+    int sizes[4] = {2, 3, 5, 5};
+    Matrix4d* E = col2im(col, sizes, 3, 3, 1, 1);
+    Matrix4d* R = create_matrix_4d(2, 3, 5, 5);
+    EXPECT_EQ(0, col2im_into(R, col, 3, 3, 1, 1));
+    for (int i = 0; i < matrix_4d_size(E); ++i) {
+        EXPECT_DOUBLE_EQ(E->data[i], R->data[i]);
+    }
+
+    Matrix4d* B = create_matrix_4d(2, 3, 4, 4);
+    EXPECT_EQ(-1, col2im_into(B, col, 3, 3, 1, 1));
+
+    free_matrix_4d(X);
+    free_matrix(col);
+    free_matrix_4d(E);
+    free_matrix_4d(R);
+    free_matrix_4d(B);
+}
+
 TEST(matrix_4d_pad, success) {
     Matrix4d* M = create_matrix4d_from_stdvec(
     {
@@ -1815,6 +2125,25 @@ TEST(matrix_4d_pad, success2) {
 }
 
 
+TEST(matrix_4d_pad, permuted_view) {
+    Matrix4d* M = create_matrix_4d(2, 3, 4, 5);
+    init_matrix_4d_random(M);
+    Matrix4d* P = matrix_4d_permute(M, 0, 3, 1, 2);
+    ASSERT_EQ(nullptr, P->elements);
+
+    // read through the strides, the same as padding a copy
+    Matrix4d* C = matrix_4d_contiguous(P);
+    Matrix4d* N = matrix_4d_pad(P, 1);
+    Matrix4d* E = matrix_4d_pad(C, 1);
+    EXPECT_EQ(0, memcmp(E->data, N->data, sizeof(real) * matrix_4d_size(E)));
+
+    free_matrix_4d(M);
+    free_matrix_4d(P);
+    free_matrix_4d(C);
+    free_matrix_4d(N);
+    free_matrix_4d(E);
+}
+
 TEST(create_image_batch, success) {
     double** images = (double**)malloc(sizeof(double*) * 5);
     for (int i = 0; i < 5; ++i) {
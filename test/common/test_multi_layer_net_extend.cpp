@@ -0,0 +1,44 @@
+#include "gtest/gtest.h"
+
+#include <vector>
+
+extern "C" {
+#include <multi_layer_net_extend.h>
+#include <mnist.h>
+}
+
+TEST(multi_layer_net_extend_freeze, success) {
+    const int size = 200;
+    std::vector<std::vector<double>> pixels(size, std::vector<double>(NUM_OF_PIXELS));
+    std::vector<double*> images(size);
+    std::vector<uint8_t> labels(size);
+    Matrix* X = create_matrix(size, NUM_OF_PIXELS);
+    Vector* t = create_vector(size);
+    for (int i = 0; i < size; ++i) {
+        for (int j = 0; j < NUM_OF_PIXELS; ++j) {
+            pixels[i][j] = (double)rand() / RAND_MAX;
+            X->elements[i][j] = pixels[i][j];
+        }
+        images[i] = pixels[i].data();
+        labels[i] = rand() % 10;
+        t->elements[i] = labels[i];
+    }
+
+    for (int d = 0; d < 2; ++d) {
+        MultiLayerNetExtend* net = create_multi_layer_net_extend(NUM_OF_PIXELS, 2, 20, 10, size, He, 0, d == 1, 0.3);
+        // a few steps so that the running statistics are not all zero
+        for (int s = 0; s < 3; ++s) {
+            multi_layer_net_extend_gradient(net, X, t);
+        }
+
+        MultiLayerNet* frozen = multi_layer_net_extend_freeze(net);
+        EXPECT_DOUBLE_EQ(multi_layer_net_extend_accuracy(net, images.data(), labels.data(), size),
+                         multi_layer_net_accuracy(frozen, images.data(), labels.data(), size));
+
+        free_multi_layer_net(frozen);
+        free_multi_layer_net_extend(net);
+    }
+
+    free_matrix(X);
+    free_vector(t);
+}
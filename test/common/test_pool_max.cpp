@@ -0,0 +1,121 @@
+#include "gtest/gtest.h"
+
+#include "utest_util.h"
+
+extern "C" {
+#include <pool_max.h>
+}
+
+struct PoolCase {
+    int N, C, H, W, PH, PW, stride, pad;
+};
+
+// the ch07/ch08 2x2 pools, overlapping windows, odd sizes and padding
+static const PoolCase CASES[] = {
+    {2, 3, 4, 4, 2, 2, 2, 0},
+    {2, 2, 7, 5, 3, 3, 2, 0},
+    {1, 3, 6, 6, 3, 2, 1, 1},
+    {3, 1, 5, 7, 2, 3, 3, 1},
+};
+
+static Matrix4d* random_4d(int s1, int s2, int s3, int s4) {
+    Matrix4d* M = create_matrix_4d(s1, s2, s3, s4);
+    init_matrix_4d_random(M);
+    return M;
+}
+
+static int out_size(int n, int k, int stride, int pad) {
+    return 1 + (n + 2 * pad - k) / stride;
+}
+
+TEST(pool_max_forward, success) {
+    for (const PoolCase& c : CASES) {
+        const int OH = out_size(c.H, c.PH, c.stride, c.pad);
+        const int OW = out_size(c.W, c.PW, c.stride, c.pad);
+        Matrix4d* X = random_4d(c.N, c.C, c.H, c.W);
+        Matrix4d* out = create_matrix_4d(c.N, c.C, OH, OW);
+        std::vector<uint8_t> arg_max(matrix_4d_size(out));
+
+        EXPECT_EQ(0, pool_max_forward(out, arg_max.data(), X, c.PH, c.PW, c.stride, c.pad));
+
+        // every output is the largest tap inside the image, found at arg_max
+        for (int n = 0; n < c.N; ++n) {
+            for (int ch = 0; ch < c.C; ++ch) {
+                for (int oh = 0; oh < OH; ++oh) {
+                    for (int ow = 0; ow < OW; ++ow) {
+                        double max = -DBL_MAX;
+                        for (int kh = 0; kh < c.PH; ++kh) {
+                            for (int kw = 0; kw < c.PW; ++kw) {
+                                const int h = oh * c.stride - c.pad + kh;
+                                const int w = ow * c.stride - c.pad + kw;
+                                if (h >= 0 && h < c.H && w >= 0 && w < c.W) {
+                                    max = std::max(max, (double)X->elements[n][ch][h][w]);
+                                }
+                            }
+                        }
+                        EXPECT_REAL_EQ(max, out->elements[n][ch][oh][ow]);
+
+                        const int idx = arg_max[((n * c.C + ch) * OH + oh) * OW + ow];
+                        const int h = oh * c.stride - c.pad + idx / c.PW;
+                        const int w = ow * c.stride - c.pad + idx % c.PW;
+                        EXPECT_REAL_EQ(max, X->elements[n][ch][h][w]);
+                    }
+                }
+            }
+        }
+
+        free_matrix_4d(X);
+        free_matrix_4d(out);
+    }
+}
+
+TEST(pool_max_forward, error) {
+    Matrix4d* X = create_matrix_4d(1, 2, 4, 4);
+    Matrix4d* out = create_matrix_4d(1, 2, 3, 3);
+    Matrix4d* big = create_matrix_4d(1, 2, 20, 20);
+    Matrix4d* one = create_matrix_4d(1, 2, 1, 1);
+    uint8_t arg_max[18];
+
+    EXPECT_EQ(-1, pool_max_forward(out, arg_max, X, 2, 2, 2, 0));
+    // 17x17 windows have more taps than a byte can index
+    EXPECT_EQ(-1, pool_max_forward(one, arg_max, big, 17, 17, 1, 0));
+
+    free_matrix_4d(X);
+    free_matrix_4d(out);
+    free_matrix_4d(big);
+    free_matrix_4d(one);
+}
+
+TEST(pool_max_backward, success) {
+    for (const PoolCase& c : CASES) {
+        const int OH = out_size(c.H, c.PH, c.stride, c.pad);
+        const int OW = out_size(c.W, c.PW, c.stride, c.pad);
+        Matrix4d* X = random_4d(c.N, c.C, c.H, c.W);
+        Matrix4d* out = create_matrix_4d(c.N, c.C, OH, OW);
+        std::vector<uint8_t> arg_max(matrix_4d_size(out));
+        pool_max_forward(out, arg_max.data(), X, c.PH, c.PW, c.stride, c.pad);
+
+        Matrix4d* dout = random_4d(c.N, c.C, OH, OW);
+        Matrix4d* dx = create_matrix_4d(c.N, c.C, c.H, c.W);
+        EXPECT_EQ(0, pool_max_backward(dx, dout, arg_max.data(), c.PH, c.PW, c.stride, c.pad));
+
+        // overlapping windows that share a maximum add up their gradients
+        std::vector<double> E(matrix_4d_size(X), 0);
+        for (int i = 0; i < matrix_4d_size(out); ++i) {
+            const int ow = i % OW;
+            const int oh = (i / OW) % OH;
+            const int p = i / (OH * OW);
+            const int h = oh * c.stride - c.pad + arg_max[i] / c.PW;
+            const int w = ow * c.stride - c.pad + arg_max[i] % c.PW;
+            E[(p * c.H + h) * c.W + w] += dout->data[i];
+        }
+        for (int i = 0; i < matrix_4d_size(dx); ++i) {
+            EXPECT_NEAR(E[i], dx->data[i], REAL_NEAR_TOL);
+        }
+
+        free_matrix_4d(X);
+        free_matrix_4d(out);
+        free_matrix_4d(dout);
+        free_matrix_4d(dx);
+    }
+}
@@ -0,0 +1,211 @@
+#include "gtest/gtest.h"
+
+#include "utest_util.h"
+
+extern "C" {
+#include <sequential.h>
+}
+
+static Matrix* random_matrix(int rows, int cols) {
+    Matrix* M = create_matrix(rows, cols);
+    init_matrix_random(M);
+    return M;
+}
+
+static Vector* bias(int size) {
+    Vector* b = create_vector(size);
+    for (int i = 0; i < size; ++i) {
+        b->elements[i] = 0.1 * i - 0.2;
+    }
+
+    return b;
+}
+
+static Affine* random_affine(int rows, int cols) {
+    return create_affine(random_matrix(rows, cols), bias(cols));
+}
+
+static Affine* clone_affine(const Affine* A) {
+    Matrix* W = create_matrix(A->W->rows, A->W->cols);
+    Vector* b = create_vector(A->b->size);
+    copy_matrix(W, A->W);
+    copy_vector(b, A->b);
+
+    return create_affine(W, b);
+}
+
+static Vector* labels(int n, int classes) {
+    Vector* t = create_vector(n);
+    for (int i = 0; i < n; ++i) {
+        t->elements[i] = i % classes;
+    }
+
+    return t;
+}
+
+TEST(tensor, success) {
+    Tensor T = tensor_2d(create_matrix(2, 3));
+    EXPECT_EQ(TENSOR_2D, T.kind);
+    EXPECT_FALSE(tensor_is_null(T));
+    free_tensor(T);
+
+    Tensor T4 = tensor_4d(create_matrix_4d(1, 2, 3, 4));
+    EXPECT_EQ(TENSOR_4D, T4.kind);
+    EXPECT_FALSE(tensor_is_null(T4));
+    free_tensor(T4);
+
+    EXPECT_TRUE(tensor_is_null(tensor_4d(NULL)));
+}
+
+TEST(sequential_predict, success) {
+    Sequential* net = create_sequential();
+    Affine* A0 = random_affine(4, 5);
+    Relu* R = create_relu();
+    Affine* A1 = random_affine(5, 3);
+    sequential_add(net, &AFFINE_OPS, A0);
+    sequential_add(net, &RELU_OPS, R);
+    sequential_add(net, &AFFINE_OPS, A1);
+    EXPECT_EQ(3, net->size);
+
+    Matrix* X = random_matrix(6, 4);
+    Matrix* T = affine_forward(A0, X);
+    Matrix* T2 = relu_forward(R, T);
+    Matrix* E = affine_forward(A1, T2);
+
+    Tensor Y = sequential_predict(net, tensor_2d(X), true);
+    ASSERT_EQ(TENSOR_2D, Y.kind);
+    EXPECT_EQ(0, memcmp(E->data, Y.m->data, sizeof(real) * 6 * 3));
+
+    free_matrix(X);
+    free_matrix(T);
+    free_matrix(T2);
+    free_matrix(E);
+    free_tensor(Y);
+    free_sequential(net);
+}
+
+TEST(sequential_predict, fuses_convolution_relu) {
+    Sequential* net = create_sequential();
+    Matrix4d* W = create_matrix_4d(3, 2, 3, 3);
+    init_matrix_4d_random(W);
+    sequential_add(net, &CONVOLUTION_OPS, create_convolution(W, bias(3), 1, 1));
+    sequential_add(net, &RELU_4D_OPS, create_relu_4d());
+    sequential_add(net, &POOLING_OPS, create_pooling(2, 2, 2, 0));
+    sequential_add(net, &AFFINE_OPS, random_affine(3 * 3 * 3, 4));
+
+    Matrix4d* X = create_matrix_4d(2, 2, 6, 6);
+    init_matrix_4d_random(X);
+
+    Tensor Y = sequential_predict(net, tensor_4d(X), true);
+    Tensor F = sequential_predict(net, tensor_4d(X), false);
+    ASSERT_FALSE(tensor_is_null(Y));
+    ASSERT_FALSE(tensor_is_null(F));
+    for (int i = 0; i < 2 * 4; ++i) {
+        EXPECT_NEAR(Y.m->data[i], F.m->data[i], REAL_NEAR_TOL);
+    }
+
+    free_tensor(Y);
+    free_tensor(F);
+    free_matrix_4d(X);
+    free_sequential(net);
+}
+
+TEST(sequential_predict, invalid_tensor) {
+    Sequential* net = create_sequential();
+    sequential_add(net, &POOLING_OPS, create_pooling(2, 2, 2, 0));
+    Matrix* X = create_matrix(2, 2);
+
+    EXPECT_TRUE(tensor_is_null(sequential_predict(net, tensor_2d(X), true)));
+
+    free_matrix(X);
+    free_sequential(net);
+}
+
+TEST(sequential_gradient, success) {
+    // the same layers by hand and through the container
+    Affine* A0 = random_affine(4, 5);
+    Affine* A1 = random_affine(5, 3);
+    Affine* B0 = clone_affine(A0);
+    Affine* B1 = clone_affine(A1);
+    Relu* R = create_relu();
+    SoftmaxWithLoss* S = create_softmax_with_loss();
+
+    Sequential* net = create_sequential();
+    sequential_add(net, &AFFINE_OPS, B0);
+    sequential_add(net, &RELU_OPS, create_relu());
+    sequential_add(net, &AFFINE_OPS, B1);
+
+    Matrix* X = random_matrix(6, 4);
+    Vector* t = labels(6, 3);
+
+    Matrix* T = affine_forward(A0, X);
+    Matrix* T2 = relu_forward(R, T);
+    Matrix* T3 = affine_forward(A1, T2);
+    const double loss = softmax_with_loss_forward(S, T3, t);
+    Matrix* D = softmax_with_loss_backward(S);
+    Matrix* D2 = affine_backward(A1, D);
+    Matrix* D3 = relu_backward(R, D2);
+    Matrix* D4 = affine_backward(A0, D3);
+
+    EXPECT_DOUBLE_EQ(loss, sequential_loss(net, tensor_2d(X), t));
+    sequential_gradient(net, tensor_2d(X), t);
+
+    const int n = sequential_params(net, NULL);
+    ASSERT_EQ(4, n);
+    Param params[4];
+    sequential_params(net, params);
+    const Affine* hand[2] = {A0, A1};
+    for (int l = 0; l < 2; ++l) {
+        const Param& W = params[l * 2];
+        const Param& b = params[l * 2 + 1];
+        ASSERT_EQ(hand[l]->W->rows * hand[l]->W->cols, W.size);
+        ASSERT_TRUE(W.grad != NULL && b.grad != NULL);
+        for (int i = 0; i < W.size; ++i) {
+            EXPECT_REAL_EQ(hand[l]->dW->data[i], W.grad[i]);
+        }
+        for (int i = 0; i < b.size; ++i) {
+            EXPECT_REAL_EQ(hand[l]->db->elements[i], b.grad[i]);
+        }
+    }
+
+    Matrix* temps[] = {X, T, T2, T3, D, D2, D3, D4};
+    for (Matrix* M : temps) {
+        free_matrix(M);
+    }
+    free_vector(t);
+    free_affine(A0);
+    free_affine(A1);
+    free_relu(R);
+    free_softmax_with_loss(S);
+    free_sequential(net);
+}
+
+TEST(sequential_gradient, failure) {
+    Sequential* net = create_sequential();
+    sequential_add(net, &POOLING_OPS, create_pooling(2, 2, 2, 0));
+    Matrix* X = create_matrix(2, 2);
+    Vector* t = labels(2, 2);
+
+    // the forward fails before any gradient was written
+    EXPECT_EQ(-1, sequential_gradient(net, tensor_2d(X), t));
+
+    free_matrix(X);
+    free_vector(t);
+    free_sequential(net);
+}
+
+TEST(sequential_gradient, grad_disabled) {
+    Sequential* net = create_sequential();
+    sequential_add(net, &AFFINE_OPS, random_affine(4, 3));
+    Matrix* X = random_matrix(2, 4);
+    Vector* t = labels(2, 3);
+
+    layer_set_grad_enabled(false);
+    EXPECT_EQ(-1, sequential_gradient(net, tensor_2d(X), t));
+    layer_set_grad_enabled(true);
+    EXPECT_EQ(0, sequential_gradient(net, tensor_2d(X), t));
+
+    free_matrix(X);
+    free_vector(t);
+    free_sequential(net);
+}
@@ -0,0 +1,129 @@
+#include "gtest/gtest.h"
+
+#include "utest_util.h"
+
+#include <cmath>
+#include <vector>
+
+extern "C" {
+#include <simd.h>
+}
+
+// odd lengths and an offset start so that every level runs its vector loop,
+// its tail and unaligned loads
+static const int LENGTHS[] = {0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 33, 100, 257};
+
+static std::vector<real> random_values(int n, double lo, double hi) {
+    std::vector<real> v(n + 1);
+    for (int i = 0; i < n + 1; ++i) {
+        v[i] = lo + (hi - lo) * rand() / RAND_MAX;
+    }
+
+    return v;
+}
+
+TEST(simd_kernels, success) {
+    const SimdKernels* K = simd_kernels();
+    ASSERT_TRUE(K != NULL);
+    EXPECT_EQ(K, simd_kernels_level(K->level));
+    EXPECT_TRUE(simd_kernels_level(SIMD_SCALAR) != NULL);
+}
+
+TEST(simd_kernels_level, matches_scalar) {
+    const SimdKernels* S = simd_kernels_level(SIMD_SCALAR);
+    for (int l = SIMD_SCALAR; l < SIMD_LEVEL_NUM; ++l) {
+        const SimdKernels* K = simd_kernels_level((SimdLevel)l);
+        if (K == NULL) {
+            continue;
+        }
+
+        for (int n : LENGTHS) {
+            std::vector<real> a = random_values(n, -2.0, 2.0);
+            std::vector<real> b = random_values(n, 0.5, 3.0);
+            std::vector<real> r1(n + 1), r2(n + 1);
+
+            S->add(r1.data(), a.data() + 1, b.data() + 1, n);
+            K->add(r2.data(), a.data() + 1, b.data() + 1, n);
+            EXPECT_EQ(r1, r2) << K->name << " add " << n;
+
+            S->sub(r1.data(), a.data() + 1, b.data() + 1, n);
+            K->sub(r2.data(), a.data() + 1, b.data() + 1, n);
+            EXPECT_EQ(r1, r2) << K->name << " sub " << n;
+
+            S->mul(r1.data(), a.data() + 1, b.data() + 1, n);
+            K->mul(r2.data(), a.data() + 1, b.data() + 1, n);
+            EXPECT_EQ(r1, r2) << K->name << " mul " << n;
+
+            S->div(r1.data(), a.data() + 1, b.data() + 1, n);
+            K->div(r2.data(), a.data() + 1, b.data() + 1, n);
+            EXPECT_EQ(r1, r2) << K->name << " div " << n;
+
+            S->scale(r1.data(), a.data() + 1, -0.3, n);
+            K->scale(r2.data(), a.data() + 1, -0.3, n);
+            EXPECT_EQ(r1, r2) << K->name << " scale " << n;
+
+            S->sqrt(r1.data(), b.data() + 1, n);
+            K->sqrt(r2.data(), b.data() + 1, n);
+            EXPECT_EQ(r1, r2) << K->name << " sqrt " << n;
+        }
+    }
+}
+
+TEST(simd_kernels_level, in_place) {
+    for (int l = SIMD_SCALAR; l < SIMD_LEVEL_NUM; ++l) {
+        const SimdKernels* K = simd_kernels_level((SimdLevel)l);
+        if (K == NULL) {
+            continue;
+        }
+
+        std::vector<real> a = random_values(37, -2.0, 2.0);
+        std::vector<real> r = a;
+        K->scale(r.data(), r.data(), 3.0, 37);
+        for (int i = 0; i < 37; ++i) {
+            EXPECT_EQ((real)(a[i] * 3.0), r[i]) << K->name;
+        }
+    }
+}
+
+TEST(simd_kernels_level, masks) {
+    for (int l = SIMD_SCALAR; l < SIMD_LEVEL_NUM; ++l) {
+        const SimdKernels* K = simd_kernels_level((SimdLevel)l);
+        if (K == NULL) {
+            continue;
+        }
+
+        for (int n : LENGTHS) {
+            std::vector<real> a = random_values(n, -2.0, 2.0);
+            for (int i = 1; i < n + 1; i += 5) {
+                a[i] = 0;
+            }
+            std::vector<real> d = random_values(n, -2.0, 2.0);
+            // stale bits must not survive a forward
+            std::vector<uint64_t> bits(SIMD_MASK_WORDS(n), ~0ull);
+            std::vector<real> r(n), g(n);
+
+            K->relu_mask(r.data(), bits.data(), a.data() + 1, n);
+            K->select_mask(g.data(), d.data() + 1, bits.data(), n);
+            for (int i = 0; i < n; ++i) {
+                const bool keep = a[i + 1] > 0;
+                EXPECT_EQ(keep, (bool)((bits[i / 64] >> (i % 64)) & 1)) << K->name << " " << n << " " << i;
+                EXPECT_EQ(keep ? a[i + 1] : 0, r[i]) << K->name << " relu_mask " << n;
+                EXPECT_EQ(keep ? d[i + 1] : 0, g[i]) << K->name << " select_mask " << n;
+            }
+        }
+    }
+}
+
+TEST(simd_pow, success) {
+    const SimdKernels* K = simd_kernels();
+    std::vector<real> a = random_values(19, 0.1, 4.0);
+    std::vector<real> r(19);
+
+    const double ks[] = {2.0, 0.5, 1.0, 3.0, -1.5};
+    for (double k : ks) {
+        simd_pow(K, r.data(), a.data(), k, 19);
+        for (int i = 0; i < 19; ++i) {
+            EXPECT_REAL_EQ(std::pow(a[i], k), r[i]) << k;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <vector>
+
+extern "C" {
+#include <thread_pool.h>
+#include <gemm.h>
+}
+
+static void mark_range(void* arg, int begin, int end) {
+    std::vector<std::atomic<int>>* hits = static_cast<std::vector<std::atomic<int>>*>(arg);
+    for (int i = begin; i < end; ++i) {
+        ++(*hits)[i];
+    }
+}
+
+static void nested_range(void* arg, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+        parallel_for(10, mark_range, arg);
+    }
+}
+
+TEST(thread_pool_num_threads, success) {
+    EXPECT_GE(thread_pool_num_threads(), 1);
+}
+
+TEST(parallel_for, success) {
+    std::vector<std::atomic<int>> hits(1000);
+
+    parallel_for(1000, mark_range, &hits);
+
+    for (int i = 0; i < 1000; ++i) {
+        EXPECT_EQ(1, hits[i]);
+    }
+}
+
+TEST(parallel_for, nested) {
+    std::vector<std::atomic<int>> hits(10);
+
+    parallel_for(8, nested_range, &hits);
+
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(8, hits[i]);
+    }
+}
+
+TEST(parallel_for, deterministic_gemm) {
+    const int m = 300, n = 200, k = 700;
+    std::vector<real> A(m * k), B(k * n), C1(m * n), C2(m * n);
+    for (int i = 0; i < m * k; ++i) {
+        A[i] = (double)rand() / RAND_MAX - 0.5;
+    }
+    for (int i = 0; i < k * n; ++i) {
+        B[i] = (double)rand() / RAND_MAX - 0.5;
+    }
+
+    gemm(false, false, m, n, k, 1.0, A.data(), k, B.data(), n, 0.0, C1.data(), n);
+    gemm(false, false, m, n, k, 1.0, A.data(), k, B.data(), n, 0.0, C2.data(), n);
+
+    for (int i = 0; i < m * n; ++i) {
+        EXPECT_EQ(C1[i], C2[i]);
+    }
+}
@@ -0,0 +1,170 @@
+#include "gtest/gtest.h"
+
+#include "utest_util.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+extern "C" {
+#include <vmath.h>
+}
+
+// odd lengths so that every level runs whole vectors and a padded tail
+static const int LENGTHS[] = {1, 3, 4, 7, 8, 9, 15, 16, 17, 33, 100, 257};
+
+typedef void (*ArrayFn)(real* dst, const real* a, int n);
+
+// the error bounds documented in vmath.h
+static const double EXP_ULP     = 2;
+static const double LOG_ULP     = 2;
+static const double SIGMOID_ULP = 3;
+static const double TANH_ULP    = 3;
+
+// |got - want| in units of the last place of want, rounded to real
+static double ulp_error(real got, long double want) {
+    const real w = (real)want;
+    const real up = std::nextafter(std::fabs(w), std::numeric_limits<real>::infinity()) - std::fabs(w);
+    return (double)(std::fabs((long double)got - want) / up);
+}
+
+static std::vector<real> random_values(int n, double lo, double hi) {
+    std::vector<real> v(n);
+    for (int i = 0; i < n; ++i) {
+        v[i] = lo + (hi - lo) * rand() / RAND_MAX;
+    }
+
+    return v;
+}
+
+static void expect_within(ArrayFn fn, long double (*ref)(long double), const std::vector<real>& a, double max_ulp,
+                          const char* level, const char* name) {
+    const int n = a.size();
+    std::vector<real> r(n);
+    fn(r.data(), a.data(), n);
+    for (int i = 0; i < n; ++i) {
+        EXPECT_LE(ulp_error(r[i], ref(a[i])), max_ulp) << level << " " << name << "(" << a[i] << ")";
+    }
+}
+
+static long double ref_exp(long double x)     { return std::exp(x); }
+static long double ref_log(long double x)     { return std::log(x); }
+static long double ref_sigmoid(long double x) { return 1 / (1 + std::exp(-x)); }
+static long double ref_tanh(long double x)    { return std::tanh(x); }
+
+TEST(vmath_kernels, success) {
+    const VmathKernels* K = vmath_kernels();
+    ASSERT_TRUE(K != NULL);
+    EXPECT_EQ(simd_kernels()->level, K->level);
+    EXPECT_EQ(K, vmath_kernels_level(K->level));
+    EXPECT_TRUE(vmath_kernels_level(SIMD_SCALAR) != NULL);
+}
+
+TEST(vmath_kernels_level, accuracy) {
+#ifdef USE_FLOAT
+    const double exp_range = 86;
+    const double log_lo = 1e-37, log_hi = 1e37;
+#else
+    const double exp_range = 700;
+    const double log_lo = 1e-300, log_hi = 1e300;
+#endif
+    for (int l = SIMD_SCALAR; l < SIMD_LEVEL_NUM; ++l) {
+        const VmathKernels* K = vmath_kernels_level((SimdLevel)l);
+        if (K == NULL) {
+            continue;
+        }
+
+        // both the full range and the few units around 0 activations see
+        std::vector<real> wide = random_values(20000, -exp_range, exp_range);
+        std::vector<real> near = random_values(20000, -4, 4);
+        std::vector<real> pos(20000);
+        for (int i = 0; i < 20000; ++i) {
+            pos[i] = std::exp(std::log(log_lo) + (std::log(log_hi) - std::log(log_lo)) * rand() / RAND_MAX);
+        }
+
+        expect_within(K->exp, ref_exp, wide, EXP_ULP, K->name, "exp");
+        expect_within(K->exp, ref_exp, near, EXP_ULP, K->name, "exp");
+        expect_within(K->log, ref_log, pos, LOG_ULP, K->name, "log");
+        expect_within(K->log, ref_log, random_values(20000, 0.5, 2), LOG_ULP, K->name, "log");
+        expect_within(K->sigmoid, ref_sigmoid, wide, SIGMOID_ULP, K->name, "sigmoid");
+        expect_within(K->sigmoid, ref_sigmoid, near, SIGMOID_ULP, K->name, "sigmoid");
+        expect_within(K->tanh, ref_tanh, random_values(20000, -30, 30), TANH_ULP, K->name, "tanh");
+        expect_within(K->tanh, ref_tanh, near, TANH_ULP, K->name, "tanh");
+    }
+}
+
+TEST(vmath_kernels_level, special_values) {
+    const real inf = std::numeric_limits<real>::infinity();
+    const real nan = std::numeric_limits<real>::quiet_NaN();
+    const real a[] = {0, -0.0, inf, -inf, nan, 1000, -1000, -1};
+    const int n = sizeof(a) / sizeof(a[0]);
+
+    for (int l = SIMD_SCALAR; l < SIMD_LEVEL_NUM; ++l) {
+        const VmathKernels* K = vmath_kernels_level((SimdLevel)l);
+        if (K == NULL) {
+            continue;
+        }
+
+        real r[n];
+        K->exp(r, a, n);
+        EXPECT_EQ(1, r[0]);
+        EXPECT_EQ(1, r[1]);
+        EXPECT_EQ(inf, r[2]);
+        EXPECT_EQ(0, r[3]);
+        EXPECT_TRUE(std::isnan(r[4]));
+        EXPECT_EQ(inf, r[5]);
+        EXPECT_EQ(0, r[6]);
+
+        K->log(r, a, n);
+        EXPECT_EQ(-inf, r[0]);
+        EXPECT_EQ(-inf, r[1]);
+        EXPECT_EQ(inf, r[2]);
+        EXPECT_TRUE(std::isnan(r[3]));
+        EXPECT_TRUE(std::isnan(r[4]));
+        EXPECT_TRUE(std::isnan(r[7]));
+
+        K->sigmoid(r, a, n);
+        EXPECT_EQ(0.5, r[0]);
+        EXPECT_EQ(1, r[2]);
+        EXPECT_EQ(0, r[3]);
+        EXPECT_TRUE(std::isnan(r[4]));
+        EXPECT_EQ(1, r[5]);
+        EXPECT_EQ(0, r[6]);
+
+        K->tanh(r, a, n);
+        EXPECT_EQ(0, r[0]);
+        EXPECT_TRUE(std::signbit(r[1]));
+        EXPECT_EQ(1, r[2]);
+        EXPECT_EQ(-1, r[3]);
+        EXPECT_TRUE(std::isnan(r[4]));
+        EXPECT_EQ(1, r[5]);
+        EXPECT_EQ(-1, r[6]);
+
+        // subnormal inputs to log
+        const real sub[] = {std::numeric_limits<real>::denorm_min(), std::numeric_limits<real>::min() / 3};
+        K->log(r, sub, 2);
+        for (int i = 0; i < 2; ++i) {
+            EXPECT_LE(ulp_error(r[i], std::log((long double)sub[i])), LOG_ULP) << K->name;
+        }
+    }
+}
+
+TEST(vmath_kernels_level, lengths) {
+    for (int l = SIMD_SCALAR; l < SIMD_LEVEL_NUM; ++l) {
+        const VmathKernels* K = vmath_kernels_level((SimdLevel)l);
+        if (K == NULL) {
+            continue;
+        }
+
+        for (int n : LENGTHS) {
+            // the element past the end must be left alone, and dst may alias a
+            std::vector<real> a = random_values(n + 1, -3, 3);
+            std::vector<real> r = a;
+            K->exp(r.data(), r.data(), n);
+            for (int i = 0; i < n; ++i) {
+                EXPECT_LE(ulp_error(r[i], std::exp((long double)a[i])), EXP_ULP) << K->name << " " << n;
+            }
+            EXPECT_EQ(a[n], r[n]) << K->name << " " << n;
+        }
+    }
+}
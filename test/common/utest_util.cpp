@@ -45,7 +45,7 @@ void EXPECT_VECTOR_EQ(const std::vector<double>& e, const Vector* v) {
     EXPECT_EQ(e.size(), v->size);
 
     for (int i = 0; i < v->size; ++i) {
-        EXPECT_DOUBLE_EQ(e[i], v->elements[i]);
+        EXPECT_REAL_EQ(e[i], v->elements[i]);
     }
 }
 
@@ -55,7 +55,7 @@ void EXPECT_MATRIX_EQ(const std::vector<std::vector<double>>& E, const Matrix* M
 
     for (int i = 0; i < M->rows; ++i) {
         for (int j = 0; j < M->cols; ++j) {
-            EXPECT_DOUBLE_EQ(E[i][j], M->elements[i][j]);
+            EXPECT_REAL_EQ(E[i][j], M->elements[i][j]);
         }
     }
 }
@@ -70,7 +70,9 @@ void EXPECT_MATRIX4D_EQ(const std::vector<std::vector<std::vector<std::vector<do
         for (int j = 0; j < M->sizes[1]; ++j) {
             for (int k = 0; k < M->sizes[2]; ++k) {
                 for (int l = 0; l < M->sizes[3]; ++l) {
-                    EXPECT_DOUBLE_EQ(E[i][j][k][l], M->elements[i][j][k][l]); 
+                    // through the strides, so views without a table compare too
+                    const real a = M->data[i * M->strides[0] + j * M->strides[1] + k * M->strides[2] + l * M->strides[3]];
+                    EXPECT_REAL_EQ(E[i][j][k][l], a);
                 }
             }
         }
@@ -81,7 +83,7 @@ void EXPECT_VECTOR_NEAR(const std::vector<double>& e, const Vector* v) {
     EXPECT_EQ(e.size(), v->size);
 
     for (int i = 0; i < v->size; ++i) {
-        EXPECT_NEAR(e[i], v->elements[i], 10e-8);
+        EXPECT_NEAR(e[i], v->elements[i], REAL_NEAR_TOL);
     }
 }
 
@@ -91,7 +93,7 @@ void EXPECT_MATRIX_NEAR(const std::vector<std::vector<double>>& E, const Matrix*
 
     for (int i = 0; i < M->rows; ++i) {
         for (int j = 0; j < M->cols; ++j) {
-            EXPECT_NEAR(E[i][j], M->elements[i][j], 10e-8);
+            EXPECT_NEAR(E[i][j], M->elements[i][j], REAL_NEAR_TOL);
         }
     }
 }
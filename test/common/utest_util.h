@@ -2,10 +2,27 @@
 #define UTEST_UTIL_H
 
 #include <vector>
+#include <cmath>
+#include <algorithm>
 extern "C" {
 #include <matrix.h>
 }
 
+//
+// Tolerances for values computed in `real`. A float build keeps about seven
+// significant digits, so its comparisons are relative instead of ULP based.
+// REAL_SUM_TOL is for long dot products such as gemm.
+//
+#ifdef USE_FLOAT
+#define EXPECT_REAL_EQ(e, a) EXPECT_NEAR(e, a, 1e-6 * std::max(1.0, std::fabs((double)(e))))
+#define REAL_NEAR_TOL 1e-5
+#define REAL_SUM_TOL  1e-4
+#else
+#define EXPECT_REAL_EQ(e, a) EXPECT_DOUBLE_EQ(e, a)
+#define REAL_NEAR_TOL 10e-8
+#define REAL_SUM_TOL  1e-10
+#endif
+
 Vector* create_vector_from_stdvec(const std::vector<double>& vec);
 Matrix* create_matrix_from_stdvec(const std::vector<std::vector<double>>& vec);
 Matrix4d* create_matrix4d_from_stdvec(const std::vector<std::vector<std::vector<std::vector<double>>>>& vec);